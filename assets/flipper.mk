@@ -19,6 +19,12 @@ FLIPPER_LD := arm-none-eabi-gcc
 FLIPPER_OBJCOPY := arm-none-eabi-objcopy
 FLIPPER_OBJDUMP := arm-none-eabi-objdump
 
+# The float ABI of the firmware and of its modules, which must match. The SAM4S has no FPU, so both
+# use soft. Builds for a part with one may use hard, and the kernel then preserves the FPU state of
+# each task lazily when switching tasks.
+FLIPPER_FLOAT_ABI ?= soft
+FLIPPER_FLOAT_ABI_FPU := $(if $(filter-out soft,$(FLIPPER_FLOAT_ABI)),-mfpu=fpv4-sp-d16)
+
 ARM_CFLAGS := -std=c99              \
               -Wall                 \
               -Wextra               \
@@ -27,7 +33,8 @@ ARM_CFLAGS := -std=c99              \
               -mthumb               \
               -march=armv7e-m       \
               -mtune=cortex-m4      \
-              -mfloat-abi=soft      \
+              -mfloat-abi=$(FLIPPER_FLOAT_ABI) \
+              $(FLIPPER_FLOAT_ABI_FPU)         \
               -g                    \
               -ffreestanding        \
               -fPIC                 \
@@ -37,6 +44,11 @@ ARM_CFLAGS := -std=c99              \
 
 FLIPPER_LDFLAGS := -nostdlib
 
+# The stack size in bytes given to the application, if it needs other than the default
+ifneq ($(STACK_SIZE), )
+FLIPPER_LDFLAGS += -Wl,--defsym=_STACK_SIZE=$(STACK_SIZE)
+endif
+
 # Build settings for code that runs on the host and communicates with the Flipper device
 HOST_BUILD := $(BUILD)/local
 HOST_TARGET := $(HOST_BUILD)/$(MODULE)
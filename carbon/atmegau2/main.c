@@ -19,8 +19,8 @@ void loop(void) {
 
 		if (_e == lf_success) {
 			lf_error_clear();
-			fmr_perform(&packet, &result);
-			megausb_bulk_transmit(&result, sizeof(struct _fmr_result));
+			/* Send the result, unless it was already sent as part of the reply. */
+			if (fmr_perform(&packet, &result) != FMR_REPLIED) megausb_bulk_transmit(&result, sizeof(struct _fmr_result));
 		}
 
 		wdt_reset();
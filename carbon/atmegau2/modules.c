@@ -9,3 +9,17 @@ const void *const lf_modules[] = {
 	&uart0,
 	&wdt
 };
+
+/* Identify this device to the host. Its capabilities are filled in by the message runtime. */
+const struct _lf_configuration lf_configuration = { "carbon-u2", 0, LF_VERSION, lf_device_8bit | lf_device_little_endian, { 0 } };
+
+/* Describe the standard modules to the host. The order must match the 'lf_modules' array. */
+const struct _fmr_module_descriptor lf_module_descriptors[] = {
+	{ "button", lf_function_count(button), 0 },
+	/* The bridge's GPIO port controls the power and reset lines of the 4S. */
+	{ "gpio", lf_function_count(gpio), fmr_module_private },
+	{ "led", lf_function_count(led), 0 },
+	{ "uart0", lf_function_count(uart0), 0 },
+	{ "wdt", lf_function_count(wdt), 0 },
+	{ NULL, 0, 0 }
+};
@@ -3,27 +3,51 @@
 
 lf_return_t fmr_push(struct _fmr_push_pull_packet *packet) {
 	int retval;
+	if (packet->header.type == fmr_send_class) {
+		/* If we are sending data, write it directly to the address given. */
+		megausb_bulk_receive((void *)(uintptr_t)*(uint64_t *)fmr_arguments(&packet->call), packet->length);
+		return lf_success;
+	}
 	void *swap = malloc(packet->length);
 	if (!swap) {
 		lf_error_raise(E_MALLOC, NULL);
 		return lf_error;
 	}
 	megausb_bulk_receive(swap, packet->length);
-	*(uint64_t *)(packet->call.parameters) = (uintptr_t)swap;
-	retval = fmr_execute(packet->call.index, packet->call.function, packet->call.ret, packet->call.argc, packet->call.types, (void *)(packet->call.parameters));
+	*(uint64_t *)fmr_arguments(&packet->call) = (uintptr_t)swap;
+	retval = fmr_execute(&packet->call, fmr_length_from(packet, &packet->call));
 	free(swap);
 	return retval;
 }
 
+int fmr_reply(void *source, lf_size_t length) {
+	return megausb_bulk_transmit(source, length);
+}
+
+int fmr_job_timer(uint32_t period) {
+	/* The U2 has no timer to spare for jobs, which are performed by the 4S. */
+	if (!period) return lf_success;
+	lf_error_raise(E_TIMER, error_message("No timer is available to perform jobs."));
+	return lf_error;
+}
+
+void fmr_job_signal(void) {
+	/* Jobs never tick on the U2. */
+}
+
 lf_return_t fmr_pull(struct _fmr_push_pull_packet *packet) {
 	lf_return_t retval;
+	if (packet->header.type == fmr_receive_class) {
+		/* If we are receiving data, simply push the memory. */
+		return megausb_bulk_transmit((void *)(uintptr_t)*(uint64_t *)fmr_arguments(&packet->call), packet->length);
+	}
 	void *swap = malloc(packet->length);
 	if (!swap) {
 		lf_error_raise(E_MALLOC, NULL);
 		return lf_error;
 	}
-	*(uint64_t *)(packet->call.parameters) = (uintptr_t)swap;
-	retval = fmr_execute(packet->call.index, packet->call.function, packet->call.ret, packet->call.argc, packet->call.types, (void *)(packet->call.parameters));
+	*(uint64_t *)fmr_arguments(&packet->call) = (uintptr_t)swap;
+	retval = fmr_execute(&packet->call, fmr_length_from(packet, &packet->call));
 	megausb_bulk_transmit(swap, packet->length);
 	free(swap);
 	return retval;
@@ -1,12 +1,23 @@
 #include <flipper/uart0.h>
+#include <flipper/ring.h>
 
 #include <flipper/atmegau2/megausb.h>
 
-uint8_t uart0_buffer[256];
-uint8_t idx = 0;
+/* Bytes received from the 4S, filled by the receive interrupt. It is the size of the buffer it replaced, as the 4S sends its replies
+   without waiting for the host to ask the U2 for them. */
+LF_RING(uart0_rx, 256);
+/* Bytes waiting to be sent to the 4S, drained by the data register empty interrupt. It holds all but one byte of a USB packet, so the
+   next packet can be received while the last is sent, without spending more of the U2's 1 KB of SRAM. */
+LF_RING(uart0_tx, 64);
 
 int uart0_configure(uint8_t baud, uint8_t interrupts) {
 
+	/* Wait for any queued bytes to be sent before changing the baud rate. They are never sent if interrupts are masked. */
+	uint8_t timeout = UDFNUML + LF_UART_TIMEOUT_MS;
+	while (!lf_ring_empty(&uart0_tx)) {
+		lf_assert(UDFNUML != timeout, failure, E_UART0_PUSH_TIMEOUT, "Timeout occurred while flushing uart0.");
+	}
+
 	UBRR1L = baud;
 	UCSR1A &= ~(1 << U2X1);
 	/* 8n1 */
@@ -20,22 +31,33 @@ int uart0_configure(uint8_t baud, uint8_t interrupts) {
 		UCSR1B &= ~(1 << RXCIE1);
 	}
 
+	/* Discard anything received at the previous baud rate. */
+	uart0_rx.tail = uart0_rx.head;
+
 	/* Enable the FSI line as an input. */
 	FSI_DDR &= ~(1 << FSI_PIN);
 	return lf_success;
+failure:
+	return lf_error;
 }
 
 int uart0_ready(void) {
-	return (UCSR1A & (1 << RXC1));
+	return !lf_ring_empty(&uart0_rx) || (UCSR1A & (1 << RXC1));
 }
 
 int uart0_push(void *source, lf_size_t length) {
-	while (length --) {
-		uint8_t timeout = UDFNUML + LF_UART_TIMEOUT_MS;
-		while (!(UCSR1A & (1 << UDRE1))) {
+	uint8_t timeout = UDFNUML + LF_UART_TIMEOUT_MS;
+	while (length) {
+		if (lf_ring_put(&uart0_tx, *(uint8_t *)source)) {
+			source ++;
+			length --;
+			/* Restart the timeout whenever the transmitter makes progress. */
+			timeout = UDFNUML + LF_UART_TIMEOUT_MS;
+			/* Let the data register empty interrupt drain the ring. */
+			UCSR1B |= (1 << UDRIE1);
+		} else {
 			lf_assert(UDFNUML != timeout, failure, E_UART0_PUSH_TIMEOUT, "Timeout occurred while pushing to uart0.");
 		}
-		UDR1 = *(uint8_t *)(source ++);
 	}
 	return lf_success;
 failure:
@@ -43,26 +65,20 @@ failure:
 }
 
 int uart0_pull(void *destination, lf_size_t length) {
-	/* Drain the buffered data. */
-	if (idx) {
-		if (length > idx) {
-			memcpy(destination, uart0_buffer, idx);
-			destination += idx;
-			length -= idx;
-			idx = 0;
-		} else {
-			memcpy(destination, uart0_buffer, length);
-			memmove(uart0_buffer, uart0_buffer + length, idx - length);
-			idx -= length;
-			return lf_success;
+	uint8_t timeout = UDFNUML + LF_UART_TIMEOUT_MS;
+	while (length) {
+		/* Without the receive interrupt, the ring is not filled, so read the data register directly. */
+		if (!(UCSR1B & (1 << RXCIE1)) && lf_ring_empty(&uart0_rx) && (UCSR1A & (1 << RXC1))) {
+			lf_ring_put(&uart0_rx, UDR1);
 		}
-	}
-	while (length--) {
-		uint8_t timeout = UDFNUML + LF_UART_TIMEOUT_MS;
-		while (!(UCSR1A & (1 << RXC1))) {
+		if (lf_ring_get(&uart0_rx, destination)) {
+			destination ++;
+			length --;
+			/* Restart the timeout whenever the receiver makes progress. */
+			timeout = UDFNUML + LF_UART_TIMEOUT_MS;
+		} else {
 			lf_assert(UDFNUML != timeout, failure, E_UART0_PULL_TIMEOUT, "Timeout occurred while pulling from uart0.");
 		}
-		*(uint8_t *)(destination ++) = UDR1;
 	}
 	return lf_success;
 failure:
@@ -70,9 +86,21 @@ failure:
 }
 
 ISR(USART1_RX_vect) {
+	uint8_t byte = UDR1;
 	if (FSI_IN & (1 << FSI_PIN)) {
-		uart0_buffer[idx++] = UDR1;
+		/* If the ring is full, the byte is dropped and the puller will time out. */
+		lf_ring_put(&uart0_rx, byte);
+	} else {
+		usb_debug_putchar(byte);
+	}
+}
+
+ISR(USART1_UDRE_vect) {
+	uint8_t byte;
+	if (lf_ring_get(&uart0_tx, &byte)) {
+		UDR1 = byte;
 	} else {
-		usb_debug_putchar(UDR1);
+		/* Nothing left to send, so stop the interrupt until more is queued. */
+		UCSR1B &= ~(1 << UDRIE1);
 	}
 }
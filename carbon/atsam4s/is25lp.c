@@ -1,5 +1,9 @@
 #include <flipper/is25lp.h>
 #include <flipper/spi.h>
+#include <os/scheduler.h>
+
+/* The interval at which a task polls the status of the flash while it is busy, sleeping in between. */
+#define IS25LP_POLL_US 100
 
 int is25lp_configure(void) {
 	/* Create a pinmask for the NVM pins. */
@@ -27,6 +31,7 @@ void is25lp_wait_ready(void) {
 			break;
 		}
 		spi_end();
+		os_sleep_us(IS25LP_POLL_US);
 	}
 }
 
@@ -1,10 +1,46 @@
 #include <flipper.h>
+#include <os/coop.h>
 #include <os/scheduler.h>
+#include <os/sync.h>
+#include <os/timer.h>
+#include <os/trace.h>
 
 /* How many clock cycles to wait before giving up initialization. */
 #define CLOCK_TIMEOUT 5000
 
-struct _fmr_packet packet;
+/* The priority of the task that performs packets, above that of applications so that the host is served promptly. */
+#define FMR_TASK_PRIORITY 24
+#define FMR_TASK_STACK_SIZE_WORDS 512
+/* Marks that the UART is not receiving a packet. */
+#define FMR_IDLE 0xFF
+/* Received in place of a packet's index once jobs are due. */
+#define FMR_JOBS 0xFE
+
+/* Packets are received into one buffer while the packet in the other is performed. */
+static struct _fmr_packet fmr_packets[2];
+/* The buffer the UART is receiving a packet into, if any. */
+static volatile uint8_t fmr_receiving = FMR_IDLE;
+/* The bitmap of the buffers holding packets that have yet to be performed. */
+static volatile uint8_t fmr_pending;
+/* The data following the packet in each buffer, received by the interrupt so that the host can send it without waiting. */
+static struct {
+	/* Where the data is received, or NULL if it is discarded. */
+	uint8_t *buffer;
+	/* Whether the buffer was allocated to hold the data, and whether the task performing the packet has taken it. */
+	bool allocated;
+	bool claimed;
+} fmr_data[2];
+/* The buffer whose data the UART is receiving, if any, where the next chunk of it goes, and how much of it remains. */
+static volatile uint8_t fmr_receiving_data = FMR_IDLE;
+static uint8_t *fmr_data_next;
+static volatile lf_size_t fmr_data_remaining;
+/* Receives the data that there was no room for. */
+static uint8_t fmr_discard[32];
+/* Sets the flag of a buffer once the data following its packet has been received. */
+static struct _os_event fmr_data_received;
+/* The indices of the received packets, in the order they were received, and a mark once jobs are due. */
+static struct _os_mq fmr_received;
+static uint8_t fmr_received_storage[3];
 
 extern void uart0_put(uint8_t byte);
 
@@ -13,10 +49,163 @@ int debug_putchar(char c, FILE *stream) {
 	return 0;
 }
 
+/* Gives whether a packet is followed by data, which the task that performs it receives itself. */
+static bool fmr_followed(struct _fmr_packet *packet) {
+	uint8_t class = fmr_packet_class(packet->header.type);
+	return (class == fmr_push_class || class == fmr_send_class || class == fmr_ram_load_class) && !(packet->header.type & fmr_inline_flag);
+}
+
+/* Receives the next packet into a free buffer, unless a packet or the data following one is already being received. */
+void fmr_receive_next(void) {
+	os_schedule_lock();
+	if (fmr_receiving == FMR_IDLE && fmr_receiving_data == FMR_IDLE) {
+		uint8_t i = (fmr_pending & (1 << 0)) ? 1 : 0;
+		if (!(fmr_pending & (1 << i))) {
+			fmr_receiving = i;
+			uart0_pull(&fmr_packets[i], sizeof(struct _fmr_packet));
+			/* Enable the PDC receive complete interrupt. */
+			UART0->UART_IER = UART_IER_ENDRX;
+		}
+	}
+	os_schedule_unlock();
+}
+
+/* Gives whether the header of a packet can be trusted for its class and the length of the data following it. */
+static bool fmr_valid(struct _fmr_packet *packet) {
+	if (packet->header.magic != FMR_MAGIC_NUMBER || packet->header.length > FMR_MAX_PACKET_SIZE) return false;
+	lf_crc_t _crc = packet->header.checksum;
+	packet->header.checksum = 0x00;
+	bool valid = (lf_crc(packet, packet->header.length) == _crc);
+	packet->header.checksum = _crc;
+	return valid;
+}
+
+/* Drops the bytes of an invalid packet up to the next magic number in its buffer, or all of them if there is none, and receives the
+   rest of a packet behind those that are kept. The packet is checked again once it is whole, so the stream is skipped until a valid
+   packet is found. */
+static void fmr_resync(uint8_t i) {
+	uint8_t *bytes = (uint8_t *)&fmr_packets[i];
+	lf_size_t kept = sizeof(struct _fmr_packet) - 1;
+	while (kept && bytes[sizeof(struct _fmr_packet) - kept] != FMR_MAGIC_NUMBER) kept --;
+	memmove(bytes, bytes + sizeof(struct _fmr_packet) - kept, kept);
+	uart0_pull(bytes + kept, sizeof(struct _fmr_packet) - kept);
+	UART0->UART_IER = UART_IER_ENDRX;
+}
+
+/* Ends the receipt of the data following the packet in a buffer, and receives the next packet. */
+static void fmr_data_done(uint8_t i) {
+	fmr_receiving_data = FMR_IDLE;
+	os_event_set(&fmr_data_received, (1 << i));
+	fmr_receive_next();
+}
+
+/* Receives the next chunk of data, which is at most what the PDC can count, or what fits in the discard buffer if the data has nowhere to go. */
+static void fmr_data_chunk(void) {
+	lf_size_t length = fmr_data_remaining;
+	if (fmr_data[fmr_receiving_data].buffer) {
+		if (length > 0xFFFF) length = 0xFFFF;
+		uart0_pull(fmr_data_next, length);
+		fmr_data_next += length;
+	} else {
+		if (length > sizeof(fmr_discard)) length = sizeof(fmr_discard);
+		uart0_pull(fmr_discard, length);
+	}
+	fmr_data_remaining -= length;
+	UART0->UART_IER = UART_IER_ENDRX;
+}
+
+/* Begins receiving the data following the packet in a buffer. Called by the interrupt, so the buffer is allocated here. */
+static void fmr_data_begin(uint8_t i) {
+	struct _fmr_push_pull_packet *packet = (struct _fmr_push_pull_packet *)&fmr_packets[i];
+	fmr_data[i].buffer = NULL;
+	fmr_data[i].allocated = fmr_data[i].claimed = false;
+	/* The packet has been validated, so its length can be trusted. */
+	if (!packet->length) {
+		os_event_set(&fmr_data_received, (1 << i));
+		fmr_receive_next();
+		return;
+	}
+	if (fmr_packet_class(packet->header.type) == fmr_send_class) {
+		/* Sent data is written directly to the address given. */
+		fmr_data[i].buffer = (uint8_t *)(uintptr_t)*(uint64_t *)fmr_arguments(&packet->call);
+	} else {
+		fmr_data[i].buffer = malloc(packet->length);
+		fmr_data[i].allocated = (fmr_data[i].buffer != NULL);
+	}
+	fmr_receiving_data = i;
+	fmr_data_next = fmr_data[i].buffer;
+	fmr_data_remaining = packet->length;
+	fmr_data_chunk();
+}
+
+/* Waits for the data following a packet being performed, and takes the buffer it was received into. Gives NULL if the data was discarded. */
+void *fmr_data_claim(void *packet) {
+	uint8_t i = (struct _fmr_packet *)packet - fmr_packets;
+	os_event_wait(&fmr_data_received, (1 << i), 0);
+	fmr_data[i].claimed = true;
+	return fmr_data[i].buffer;
+}
+
+/* Waits for the data following a packet that has been performed, freeing its buffer if it was not taken. */
+static void fmr_data_release(uint8_t i) {
+	os_event_wait(&fmr_data_received, (1 << i), OS_EVENT_CLEAR);
+	if (fmr_data[i].allocated && !fmr_data[i].claimed) free(fmr_data[i].buffer);
+}
+
+/* Performs packets as they are received, so that calls run with interrupts and preemption enabled. */
+static void fmr_task(void) {
+	while (1) {
+		uint8_t index;
+		os_mq_receive(&fmr_received, &index, true);
+		/* Jobs are performed between packets, so that they never run alongside one. */
+		if (index == FMR_JOBS) {
+			fmr_job_perform();
+			continue;
+		}
+		struct _fmr_packet *packet = &fmr_packets[index];
+		gpio_write(FMR_PIN, 0);
+		struct _fmr_result result;
+		lf_error_clear();
+		os_trace(lf_trace_execute, fmr_packet_class(packet->header.type));
+		int _e = fmr_perform(packet, &result);
+		/* The host is answered only once the data following the packet has been received. */
+		if (fmr_followed(packet)) fmr_data_release(index);
+		/* Send the result, unless it was already sent as part of the reply. */
+		if (_e != FMR_REPLIED) uart0_push(&result, sizeof(struct _fmr_result));
+		os_trace(lf_trace_respond, fmr_packet_class(packet->header.type));
+		/* Free the buffer, receiving into it if the UART was waiting for one. */
+		os_schedule_lock();
+		fmr_pending &= ~(1 << index);
+		os_schedule_unlock();
+		fmr_receive_next();
+		gpio_write(0, FMR_PIN);
+	}
+}
+
+/* Wakes the task that performs packets to perform the jobs that are due. At most one mark is queued at a time, so there is always room for it. */
+void fmr_job_signal(void) {
+	uint8_t jobs = FMR_JOBS;
+	os_mq_send(&fmr_received, &jobs, false);
+}
+
+/* The system task runs only when no other task is ready. It frees the tasks that have ended, then sleeps the CPU until an interrupt makes
+   a task ready. */
 void os_kernel_task(void) {
+	/* Launch the task that calls the callbacks of timers. */
+	os_timer_init();
+	/* Launch the task that runs stackless tasks. */
+	os_coop_init();
+	/* Launch the task that performs packets, and receive the first packet. */
+	struct _os_task *task = os_task_create(fmr_task, NULL, NULL, FMR_TASK_STACK_SIZE_WORDS * sizeof(uint32_t));
+	if (task) {
+		task->priority = task->base = FMR_TASK_PRIORITY;
+		os_task_add(task);
+		fmr_receive_next();
+		os_task_next();
+	}
 	while (1) {
-		printf("Hello!\n");
-		for (int i = 0x1FFFFFC; i > 0; i --) __asm__ __volatile__ ("nop");
+		os_task_reap();
+		__WFI();
 	}
 }
 
@@ -68,10 +257,9 @@ int main(void) {
 	gpio_enable(FMR_PIN, 0);
 	gpio_write(0, FMR_PIN);
 
-	/* Pull an FMR packet asynchronously to launch FMR. */
-	uart0_pull(&packet, sizeof(struct _fmr_packet));
-	/* Enable the PDC receive complete interrupt. */
-	UART0->UART_IER = UART_IER_ENDRX;
+	/* Packets are received once the task that performs them is running. */
+	os_mq_init(&fmr_received, fmr_received_storage, sizeof(uint8_t), sizeof(fmr_received_storage));
+	os_event_init(&fmr_data_received);
 
 	/* Launch the kernel task. */
 	os_scheduler_init();
@@ -80,30 +268,38 @@ int main(void) {
 
 void uart0_isr(void) {
 
-	__disable_irq();
+	os_trace(lf_trace_isr_enter, 0);
 
 	uint32_t _sr = UART0->UART_SR;
 
-	/* If an entire packet has been received, process it. */
-	if (_sr & UART_SR_ENDRX) {
-		gpio_write(FMR_PIN, 0);
-
-		UART0->UART_PTCR = UART_PTCR_RXTDIS | UART_PTCR_TXTDIS;
-
-		struct _fmr_result result;
-		lf_error_clear();
-		fmr_perform(&packet, &result);
-		uart0_push(&result, sizeof(struct _fmr_result));
-		uart0_pull(&packet, sizeof(struct _fmr_packet));
-
-		/* Wait a bit before raising the FMR pin. */
-		for (size_t i = 0; i < 0x3FF; i ++) __asm__ __volatile__("nop");
-
-		gpio_write(0, FMR_PIN);
-	} else {
+	/* If an entire packet has been received, hand it to the task that performs packets. */
+	if (_sr & UART0->UART_IMR & UART_SR_ENDRX) {
+		/* The interrupt stays disabled until the next packet is being received. */
+		UART0->UART_IDR = UART_IDR_ENDRX;
+		UART0->UART_PTCR = UART_PTCR_RXTDIS;
+		if (fmr_receiving_data != FMR_IDLE) {
+			/* A chunk of the data following a packet has been received. */
+			if (fmr_data_remaining) fmr_data_chunk();
+			else fmr_data_done(fmr_receiving_data);
+		} else if (!fmr_valid(&fmr_packets[fmr_receiving])) {
+			/* Neither the class of an invalid packet nor the length of the data following it can be trusted, so the data would
+			   otherwise be taken for packets. It is dropped along with the packet, and the host times out waiting for a result. */
+			fmr_resync(fmr_receiving);
+		} else {
+			uint8_t i = fmr_receiving;
+			struct _fmr_packet *packet = &fmr_packets[i];
+			fmr_receiving = FMR_IDLE;
+			fmr_pending |= (1 << i);
+			os_trace(lf_trace_receive, fmr_packet_class(packet->header.type));
+			/* The data following a packet is received before the next packet, which is received into the other buffer while this one is performed. */
+			if (fmr_followed(packet)) fmr_data_begin(i);
+			else fmr_receive_next();
+			os_mq_send(&fmr_received, &i, false);
+		}
+	} else if (!(_sr & UART_SR_ENDRX)) {
 		UART0->UART_CR = UART_CR_RSTSTA;
 	}
 
-	__enable_irq();
+	os_trace(lf_trace_isr_exit, 0);
 
 }
@@ -8,6 +8,7 @@ const void *const lf_modules[] = {
 	&dac,
 	&fld,
 	&gpio,
+	&heap,
 	&i2c,
 	&led,
 	&pwm,
@@ -17,8 +18,38 @@ const void *const lf_modules[] = {
 	&task,
 	&temp,
 	&timer,
+	&trace,
 	&uart0,
 	&usart,
 	&usb,
 	&wdt
 };
+
+/* Identify this device to the host. Its capabilities are filled in by the message runtime. */
+const struct _lf_configuration lf_configuration = { "carbon-4s", 0, LF_VERSION, lf_device_32bit | lf_device_little_endian, { 0 } };
+
+/* Describe the standard modules to the host. The order must match the 'lf_modules' array. */
+const struct _fmr_module_descriptor lf_module_descriptors[] = {
+	{ "adc", lf_function_count(adc), 0 },
+	{ "button", lf_function_count(button), 0 },
+	{ "dac", lf_function_count(dac), 0 },
+	{ "fld", lf_function_count(fld), 0 },
+	{ "gpio", lf_function_count(gpio), 0 },
+	{ "heap", lf_function_count(heap), 0 },
+	{ "i2c", lf_function_count(i2c), 0 },
+	{ "led", lf_function_count(led), 0 },
+	{ "pwm", lf_function_count(pwm), 0 },
+	{ "rtc", lf_function_count(rtc), 0 },
+	{ "spi", lf_function_count(spi), 0 },
+	{ "swd", lf_function_count(swd), 0 },
+	{ "task", lf_function_count(task), 0 },
+	{ "temp", lf_function_count(temp), 0 },
+	{ "timer", lf_function_count(timer), 0 },
+	{ "trace", lf_function_count(trace), 0 },
+	/* The 4S's uart0 bus carries its message runtime traffic to and from the bridge. */
+	{ "uart0", lf_function_count(uart0), fmr_module_private },
+	{ "usart", lf_function_count(usart), 0 },
+	{ "usb", lf_function_count(usb), 0 },
+	{ "wdt", lf_function_count(wdt), 0 },
+	{ NULL, 0, 0 }
+};
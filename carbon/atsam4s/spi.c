@@ -1,7 +1,22 @@
 #include <flipper/spi.h>
+#include <os/sync.h>
+#include <os/trace.h>
 
+/* Posted by the interrupt handler when a PDC transfer finishes. */
+static struct _os_semaphore spi_done;
+
+/* Waits for a PDC transfer to finish. Tasks sleep until the interrupt handler wakes them; anything else polls. */
+static void spi_wait(uint32_t flag) {
+	if (os_can_block()) {
+		SPI->SPI_IER = flag;
+		os_semaphore_wait(&spi_done);
+	} else {
+		while (!(SPI->SPI_SR & flag));
+	}
+}
 
 int spi_configure() {
+	os_semaphore_init(&spi_done, 0);
 	/* Enable the SPI clock. */
 	PMC->PMC_PCER0 = (1 << ID_SPI);
 	/* Create a pinmask for the peripheral pins. */
@@ -74,7 +89,7 @@ int spi_push(void *source, uint32_t length) {
 	/* Enable the PDC transmitter to start the transmission. */
 	SPI->SPI_PTCR = SPI_PTCR_TXTEN;
 	/* Wait until the transfer has finished. */
-	while (!(SPI->SPI_SR & SPI_SR_ENDTX));
+	spi_wait(SPI_SR_ENDTX);
 	/* Disable the PDC transmitter. */
 	SPI->SPI_PTCR = SPI_PTCR_TXTDIS;
 	return lf_success;
@@ -84,26 +99,34 @@ int spi_pull(void *destination, uint32_t length) {
 	/* Set the transmission length and destination pointer. */
 	SPI->SPI_RCR = length;
 	SPI->SPI_RPR = (uintptr_t)(destination);
-	/* Enable the receiver. */
-	SPI->SPI_PTCR = SPI_PTCR_RXTEN;
-	/* If defined, usart_pull will not use interrupts. */
+	/* Clock in the data by transmitting zeros from the destination, which the transmitter reads ahead of the receiver writing it. */
+	memset(destination, 0, length);
+	SPI->SPI_TCR = length;
+	SPI->SPI_TPR = (uintptr_t)(destination);
+	/* Enable the receiver and the transmitter. */
+	SPI->SPI_PTCR = SPI_PTCR_RXTEN | SPI_PTCR_TXTEN;
 	/* Wait until the transfer has finished. */
-	while (!(SPI->SPI_SR & SPI_SR_ENDRX)) {
-		SPI->SPI_TDR = 0x00;
-		while (!(SPI->SPI_SR & SPI_SR_TDRE));
-	}
+	spi_wait(SPI_SR_ENDRX);
 	SPI->SPI_CR |= SPI_CR_LASTXFER;
-	/* Disable the PDC receiver. */
-	SPI->SPI_PTCR = SPI_PTCR_RXTDIS;
+	/* Disable the PDC receiver and transmitter. */
+	SPI->SPI_PTCR = SPI_PTCR_RXTDIS | SPI_PTCR_TXTDIS;
 	return lf_success;
 }
 
 /* Interrupt hander for this peripheral. */
 
 void spi_isr(void) {
+	os_trace(lf_trace_isr_enter, 0);
+	/* Wake the task waiting for the end of a PDC transfer. The interrupt is disabled, since the flag stays set until the next transfer. */
+	uint32_t done = SPI->SPI_SR & SPI->SPI_IMR & (SPI_SR_ENDTX | SPI_SR_ENDRX);
+	if (done) {
+		SPI->SPI_IDR = done;
+		os_semaphore_post(&spi_done);
+	}
 	/* Falls through if a mode fault has occured. This fires when the masters drive the slave out of sync. */
 	if (SPI->SPI_SR & SPI_SR_MODF) {
 		/* Re-enable the SPI bus. */
 		SPI->SPI_CR = SPI_CR_SPIEN;
 	}
+	os_trace(lf_trace_isr_exit, 0);
 }
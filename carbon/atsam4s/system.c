@@ -5,39 +5,28 @@
 /* Buffer space for incoming message runtime packets. */
 struct _fmr_packet packet;
 
-void uart0_pull_wait(void *destination, lf_size_t length) {
-	/* Disable the PDC receive complete interrupt. */
-	UART0->UART_IDR = UART_IDR_ENDRX;
-	/* Set the transmission length and destination pointer. */
-	UART0->UART_RCR = length;
-	UART0->UART_RPR = (uintptr_t)(destination);
-	/* Enable the receiver. */
-	UART0->UART_PTCR = UART_PTCR_RXTEN;
-	/* Wait until the transfer has finished. */
-	while (!(UART0->UART_SR & UART_SR_ENDRX));
-	/* Disable the PDC receiver. */
-	UART0->UART_PTCR = UART_PTCR_RXTDIS;
-	/* Enable the PDC receive complete interrupt. */
-	UART0->UART_IER = UART_IER_ENDRX;
+extern void *fmr_data_claim(void *packet);
+
+int fmr_reply(void *source, lf_size_t length) {
+	return uart0_push(source, length);
 }
 
 lf_return_t fmr_push(struct _fmr_push_pull_packet *packet) {
 	lf_return_t _e = lf_success;
-	void *push_buffer = malloc(packet->length);
+	/* The data was received by the UART interrupt, straight to the address given if it was sent. */
+	void *push_buffer = fmr_data_claim(packet);
 	if (!push_buffer) {
 		lf_error_raise(E_MALLOC, NULL);
 		return lf_error;
 	}
-	uart0_pull_wait(push_buffer, packet->length);
 	if (packet->header.type == fmr_send_class) {
-		/* If we are copying data, simply return a pointer to the copied data. */
-		_e = (uintptr_t)push_buffer;
+		return lf_success;
 	} else if (packet->header.type == fmr_ram_load_class) {
 		_e = os_load_image(push_buffer);
 		return lf_success;
 	} else {
-		*(uint64_t *)(packet->call.parameters) = (uintptr_t)push_buffer;
-		_e = fmr_execute(packet->call.index, packet->call.function, packet->call.ret, packet->call.argc, packet->call.types, (void *)(packet->call.parameters));
+		*(uint64_t *)fmr_arguments(&packet->call) = (uintptr_t)push_buffer;
+		_e = fmr_execute(&packet->call, fmr_length_from(packet, &packet->call));
 		free(push_buffer);
 	}
 	return _e;
@@ -47,15 +36,15 @@ lf_return_t fmr_pull(struct _fmr_push_pull_packet *packet) {
 	lf_return_t _e = lf_success;
 	if (packet->header.type == fmr_receive_class) {
 		/* If we are receiving data, simply push the memory. */
-		_e = uart0_push((void *)*(uint64_t *)(packet->call.parameters), packet->length);
+		_e = uart0_push((void *)(uintptr_t)*(uint64_t *)fmr_arguments(&packet->call), packet->length);
 	} else {
 		void *pull_buffer = malloc(packet->length);
 		if (!pull_buffer) {
 			lf_error_raise(E_MALLOC, NULL);
 			return lf_error;
 		}
-		*(uint64_t *)(packet->call.parameters) = (uintptr_t)pull_buffer;
-		_e = fmr_execute(packet->call.index, packet->call.function, packet->call.ret, packet->call.argc, packet->call.types, (void *)(packet->call.parameters));
+		*(uint64_t *)fmr_arguments(&packet->call) = (uintptr_t)pull_buffer;
+		_e = fmr_execute(&packet->call, fmr_length_from(packet, &packet->call));
 		uart0_push(pull_buffer, packet->length);
 		free(pull_buffer);
 	}
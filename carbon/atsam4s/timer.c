@@ -1,97 +1,148 @@
 #include <flipper/timer.h>
 #include <flipper/error.h>
+#include <os/scheduler.h>
+#include <os/timer.h>
+#include <os/trace.h>
 
-/* NOTE: TC0 is reserved by the system scheduler. */
+/* Channel 0 of TC0 ticks the timer wheel, and channel 2 ticks the jobs performed on behalf of the host. */
+TcChannel *TCW = &(TC0->TC_CHANNEL[0]);
+TcChannel *TCJ = &(TC0->TC_CHANNEL[2]);
 
-/* Expose channel A within TC0. */
-TcChannel *TCA = &(TC0->TC_CHANNEL[0]);
-
-/* A data structure to hold information pertainent to each timer. */
-struct _lf_timer {
-	/* A pointer to the timer channel. */
-	TcChannel *CH;
-	/* Whether or not the timer is in use. */
-	bool available;
-	/* The callback function registered to the timer event. */
-	void (* callback)(void);
+/* A timer started by the host, which calls a function of the device. */
+struct _timer_handle {
+	struct _os_timer timer;
+	/* The identifier given to the host. */
+	int id;
+	/* The function called when the timer expires, and its parameter. */
+	void (* callback)(void *ctx);
+	void *ctx;
+	/* The next timer started by the host. */
+	struct _timer_handle *next;
 };
 
-/* Initialize an array of all the timers. */
-struct _lf_timer timers[] = { { &(TC0->TC_CHANNEL[0]), true, NULL },
-							  { &(TC0->TC_CHANNEL[1]), true, NULL },
-							  { &(TC0->TC_CHANNEL[2]), true, NULL },
-							  { &(TC0->TC_CHANNEL[3]), true, NULL } };
+/* The timers started by the host, and the identifier given to the next. */
+static struct _timer_handle *timer_handles;
+static int timer_next_id;
 
-int timer_configure(void) {
-	/* Iterate through the timers and configure their defaults. */
-	for (size_t i = 0; i < sizeof(timers)/sizeof(struct _lf_timer); i ++) {
-		/* Enable the timer's peripheral clock. */
-		PMC->PMC_PCER0 |= (1 << (ID_TC0 + i));
-		/* Disable the source clock to TCA. */
-		timers[i].CH->TC_CCR = TC_CCR_CLKDIS;
-		/* Select the incoming clock signal as MCK / 128. */
-		timers[i].CH->TC_CMR = TC_CMR_TCCLKS_TIMER_CLOCK4;
-		/* Enable the TCA C compare interrupt. */
-		timers[i].CH->TC_IER = TC_IER_CPCS;
-		/* Set the compare value into C. */
-		timers[i].CH->TC_RC = 0xFFFF;
-		/* Enable the timer's interrupt. */
-		NVIC_EnableIRQ(TC0_IRQn + i);
+int fmr_job_timer(uint32_t period) {
+	/* Stop the channel while it is reprogrammed. */
+	TCJ->TC_CCR = TC_CCR_CLKDIS;
+	if (!period) {
+		NVIC_DisableIRQ(TC2_IRQn);
+		return lf_success;
 	}
+	/* The channel counts MCK / 128, and restarts each time it reaches RC. */
+	uint32_t ticks = (uint64_t)period * (F_CPU / 128) / 1000000;
+	lf_assert(ticks && ticks <= 0xFFFF, failure, E_TIMER, "Jobs cannot be ticked every %i microseconds.", period);
+	PMC->PMC_PCER0 |= (1 << ID_TC2);
+	TCJ->TC_CMR = TC_CMR_TCCLKS_TIMER_CLOCK4 | TC_CMR_WAVE | TC_CMR_WAVSEL_UP_RC;
+	TCJ->TC_RC = ticks;
+	TCJ->TC_IER = TC_IER_CPCS;
+	NVIC_EnableIRQ(TC2_IRQn);
+	/* Enable the clock and start the timer. */
+	TCJ->TC_CCR = TC_CCR_CLKEN | TC_CCR_SWTRG;
 	return lf_success;
+failure:
+	return lf_error;
 }
 
-/* Registers a callback with the next available timer. */
-int timer_register(uint32_t ticks, void *callback) {
-	/* Loop through the timers until a free timer is found. */
-	for (size_t i = 0; i < sizeof(timers); i ++) {
-		if (timers[i].available) {
-			/* Hold the timer. */
-			timers[i].available = false;
-			/* Set the callback address. */
-			timers[i].callback = callback;
-			/* Set the compare value into C. */
-			timers[i].CH->TC_RC = ticks;
-			/* Enable the clock and start the timer. */
-			timers[i].CH->TC_CCR = TC_CCR_CLKEN | TC_CCR_SWTRG;
-			return lf_success;
-		}
+void os_timer_clock(bool run) {
+	if (!run) {
+		TCW->TC_CCR = TC_CCR_CLKDIS;
+		NVIC_DisableIRQ(TC0_IRQn);
+		return;
 	}
-	lf_error_raise(E_TIMER, error_message("No timer is available to register a callback."));
-	return lf_error;
+	/* The channel counts MCK / 128, and restarts each time it reaches RC. */
+	PMC->PMC_PCER0 |= (1 << ID_TC0);
+	TCW->TC_CMR = TC_CMR_TCCLKS_TIMER_CLOCK4 | TC_CMR_WAVE | TC_CMR_WAVSEL_UP_RC;
+	TCW->TC_RC = (uint64_t)OS_TIMER_TICK_US * (F_CPU / 128) / 1000000;
+	TCW->TC_IER = TC_IER_CPCS;
+	NVIC_EnableIRQ(TC0_IRQn);
+	TCW->TC_CCR = TC_CCR_CLKEN | TC_CCR_SWTRG;
 }
 
-void tcx_isr(uint8_t timer) {
-	/* Read the interrupt flag to clear it. */
-	timers[timer].CH->TC_SR;
-	/* Perform the timer callback. */
-	timers[timer].callback();
-	/* Stop the timer. */
-	timers[timer].CH->TC_CCR = TC_CCR_CLKDIS;
-	/* Release the timer. */
-	timers[timer].available = true;
+int timer_configure(void) {
+	/* The wheel's tick is started by the first timer, so there is nothing to configure. */
+	return lf_success;
 }
 
-void tc0_isr(void) {
-	tcx_isr(0);
+/* Finds the timer started by the host with the given identifier, taking it out of the timers started by the host. Must be called with the schedule locked. */
+static struct _timer_handle *timer_take(int id) {
+	for (struct _timer_handle **link = &timer_handles; *link; link = &(*link)->next) {
+		struct _timer_handle *handle = *link;
+		if (handle->id != id) continue;
+		*link = handle->next;
+		return handle;
+	}
+	return NULL;
 }
 
-void tc1_isr(void) {
-	tcx_isr(1);
+/* Calls the function of a timer started by the host. */
+static void timer_expired(void *_handle) {
+	struct _timer_handle *handle = _handle;
+	void (* callback)(void *ctx) = handle->callback;
+	void *ctx = handle->ctx;
+	/* A timer that expires once is finished with, unless the host stopped it already. */
+	if (!handle->timer.period) {
+		os_schedule_lock();
+		handle = timer_take(handle->id);
+		os_schedule_unlock();
+		free(handle);
+	}
+	callback(ctx);
 }
 
-void tc2_isr(void) {
-	tcx_isr(2);
+int timer_start(void *callback, void *ctx, uint32_t delay, uint32_t period) {
+	struct _timer_handle *handle = NULL;
+	lf_assert(callback, failure, E_NULL, "No function was given for the timer to call.");
+	handle = malloc(sizeof(struct _timer_handle));
+	lf_assert(handle, failure, E_MALLOC, "Failed to allocate a timer.");
+	handle->callback = callback;
+	handle->ctx = ctx;
+	os_timer_create(&handle->timer, timer_expired, handle);
+	os_schedule_lock();
+	handle->id = timer_next_id ++ & INT32_MAX;
+	handle->next = timer_handles;
+	timer_handles = handle;
+	os_schedule_unlock();
+	int id = handle->id;
+	int _e = os_timer_start(&handle->timer, delay, period);
+	if (_e != lf_success) {
+		/* A timer that was not started is taken back out of the timers started by the host. */
+		os_schedule_lock();
+		handle = timer_take(id);
+		os_schedule_unlock();
+	}
+	lf_assert(_e == lf_success, failure, E_TIMER, "Failed to start a timer.");
+	return id;
+failure:
+	free(handle);
+	return lf_error;
 }
 
-void tc3_isr(void) {
-	tcx_isr(3);
+int timer_stop(int id) {
+	os_schedule_lock();
+	struct _timer_handle *handle = timer_take(id);
+	/* The timer's callback cannot be called once the timer is stopped, so it can be freed. */
+	if (handle) os_timer_stop(&handle->timer);
+	os_schedule_unlock();
+	lf_assert(handle, failure, E_TIMER, "No timer has the identifier %i.", id);
+	free(handle);
+	return lf_success;
+failure:
+	return lf_error;
 }
 
-void tc4_isr(void) {
-	tcx_isr(4);
+void tc0_isr(void) {
+	os_trace(lf_trace_isr_enter, 0);
+	/* Read the interrupt flag to clear it. */
+	TCW->TC_SR;
+	os_timer_tick();
+	os_trace(lf_trace_isr_exit, 0);
 }
 
-void tc5_isr(void) {
-	tcx_isr(5);
+void tc2_isr(void) {
+	/* Read the interrupt flag to clear it. */
+	TCJ->TC_SR;
+	fmr_job_tick();
 }
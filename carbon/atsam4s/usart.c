@@ -1,8 +1,24 @@
 #include <flipper/usart.h>
+#include <os/sync.h>
+#include <os/trace.h>
 
 #define USART0_BAUDRATE 230400
 
+/* Posted by the interrupt handler when a PDC transfer finishes. */
+static struct _os_semaphore usart_done;
+
+/* Waits for a PDC transfer to finish. Tasks sleep until the interrupt handler wakes them; anything else polls. */
+static void usart_wait(uint32_t flag) {
+	if (os_can_block()) {
+		USART0 -> US_IER = flag;
+		os_semaphore_wait(&usart_done);
+	} else {
+		while (!(USART0 -> US_CSR & flag));
+	}
+}
+
 int usart_configure(void) {
+	os_semaphore_init(&usart_done, 0);
 	/* Create a pinmask for the peripheral pins. */
 	const unsigned int USART0_PIN_MASK = (PIO_PA5A_RXD0 | PIO_PA6A_TXD0);
 	/* Enable the peripheral clock. */
@@ -70,7 +86,7 @@ int usart_push(void *source, lf_size_t length) {
 	/* Enable the PDC transmitter. */
 	USART0 -> US_PTCR = US_PTCR_TXTEN;
 	/* Wait until the transfer has finished. */
-	while (!(USART0 -> US_CSR & US_CSR_ENDTX));
+	usart_wait(US_CSR_ENDTX);
 	/* Disable the PDC transmitter. */
 	USART0 -> US_PTCR = US_PTCR_TXTDIS;
 	return lf_success;
@@ -83,7 +99,7 @@ int usart_pull(void *destination, lf_size_t length) {
 	/* Enable the receiver. */
 	USART0 -> US_PTCR = US_PTCR_RXTEN;
 	/* Wait until the transfer has finished. */
-	while (!(USART0 -> US_CSR & US_CSR_ENDRX));
+	usart_wait(US_CSR_ENDRX);
 	/* Disable the PDC receiver. */
 	USART0 -> US_PTCR = US_PTCR_RXTDIS;
 	return lf_success;
@@ -92,5 +108,12 @@ int usart_pull(void *destination, lf_size_t length) {
 /* Interrupt hander for this peripheral. */
 
 void usart0_isr(void) {
-
+	os_trace(lf_trace_isr_enter, 0);
+	/* Wake the task waiting for the end of a PDC transfer. The interrupt is disabled, since the flag stays set until the next transfer. */
+	uint32_t done = USART0 -> US_CSR & USART0 -> US_IMR & (US_CSR_ENDTX | US_CSR_ENDRX);
+	if (done) {
+		USART0 -> US_IDR = done;
+		os_semaphore_post(&usart_done);
+	}
+	os_trace(lf_trace_isr_exit, 0);
 }
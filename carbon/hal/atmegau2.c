@@ -6,6 +6,8 @@
 int carbon_select_u2_gpio(struct _lf_device *device) {
 	struct _carbon_context *context = device->_ctx;
 	lf_assert(context, failure, E_NULL, "No context for selected carbon device.");
+	/* Pin the module to the bridge if the device routes its calls. */
+	if (context->routec) return carbon_pin_module(device, &_gpio, carbon_u2_chip);
 	struct _lf_device *u2 = context->_u2;
 	LF_MODULE_SET_DEVICE_AND_ID(_gpio, u2, _gpio_id);
 	return lf_success;
@@ -9,6 +9,7 @@ int carbon_select_atsam4s(struct _lf_device *device) {
 	LF_MODULE_SET_DEVICE_AND_ID(_dac, device, _dac_id);
 	LF_MODULE_SET_DEVICE_AND_ID(_fld, device, _fld_id);
 	LF_MODULE_SET_DEVICE_AND_ID(_gpio, device, _gpio_id);
+	LF_MODULE_SET_DEVICE_AND_ID(_heap, device, _heap_id);
 	LF_MODULE_SET_DEVICE_AND_ID(_i2c, device, _i2c_id);
 	LF_MODULE_SET_DEVICE_AND_ID(_led, device, _led_id);
 	LF_MODULE_SET_DEVICE_AND_ID(_pwm, device, _pwm_id);
@@ -18,6 +19,7 @@ int carbon_select_atsam4s(struct _lf_device *device) {
 	LF_MODULE_SET_DEVICE_AND_ID(_task, device, _task_id);
 	LF_MODULE_SET_DEVICE_AND_ID(_temp, device, _temp_id);
 	LF_MODULE_SET_DEVICE_AND_ID(_timer, device, _timer_id);
+	LF_MODULE_SET_DEVICE_AND_ID(_trace, device, _trace_id);
 	LF_MODULE_SET_DEVICE_AND_ID(_uart0, device, _uart0_id);
 	LF_MODULE_SET_DEVICE_AND_ID(_usart, device, _usart_id);
 	LF_MODULE_SET_DEVICE_AND_ID(_usb, device, _usb_id);
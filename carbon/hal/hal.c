@@ -27,6 +27,163 @@
 extern int carbon_select_atmegau2(struct _lf_device *device);
 extern int carbon_select_atsam4s(struct _lf_device *device);
 
+/* The standard modules that can be routed between the chips. */
+static struct _lf_module *const carbon_modules[] = {
+	&_adc, &_button, &_dac, &_fld, &_gpio, &_i2c, &_led, &_pwm, &_rtc,
+	&_spi, &_swd, &_task, &_temp, &_timer, &_uart0, &_usart, &_usb, &_wdt
+};
+
+/* Computes the identifier of a module, which is the checksum of its name. */
+static lf_crc_t carbon_module_identifier(struct _lf_module *module) {
+	if (!module->identifier) module->identifier = lf_crc(module->name, strlen(module->name) + 1);
+	return module->identifier;
+}
+
+/* Finds the route of a module in the routing table, creating it if requested. */
+static struct _carbon_route *carbon_find_route(struct _carbon_context *context, lf_crc_t identifier, bool create) {
+	for (int i = 0; i < context->routec; i ++) {
+		if (context->routes[i].identifier == identifier) return &context->routes[i];
+	}
+	if (!create || context->routec >= CARBON_MAX_ROUTES) return NULL;
+	struct _carbon_route *route = &context->routes[context->routec ++];
+	memset(route, 0, sizeof(struct _carbon_route));
+	route->identifier = identifier;
+	for (int chip = 0; chip < carbon_chip_count; chip ++) route->index[chip] = -1;
+	route->pinned = -1;
+	return route;
+}
+
+/* The number of module tables whose descriptions are kept. */
+#define CARBON_DESCRIPTION_CACHE 4
+
+/* The descriptions obtained from chips, keyed by the checksum of the module table they describe, so that a chip is only
+   described once for each firmware however many devices it belongs to. */
+static struct _carbon_description_cache {
+	lf_crc_t modules;
+	int count;
+	lf_return_t descriptions[CARBON_MAX_ROUTES];
+} carbon_description_cache[CARBON_DESCRIPTION_CACHE];
+/* The entry of the cache that is replaced next. */
+static int carbon_description_next;
+
+/* Finds the descriptions of a module table. Chips that do not report a checksum of their module table are never cached. */
+static struct _carbon_description_cache *carbon_find_descriptions(lf_crc_t modules) {
+	if (!modules) return NULL;
+	for (int i = 0; i < CARBON_DESCRIPTION_CACHE; i ++) {
+		if (carbon_description_cache[i].count && carbon_description_cache[i].modules == modules) return &carbon_description_cache[i];
+	}
+	return NULL;
+}
+
+/* Records the standard modules that a chip describes in the routing table. */
+static int carbon_describe_chip(struct _carbon_context *context, struct _lf_device *device, int chip) {
+	lf_assert(lf_supports(device, fmr_describe_class), failure, E_MODULE, "Carbon chip '%i' does not describe its modules.", chip);
+	/* If a chip with the same module table has been described before, reuse its descriptions. */
+	lf_crc_t modules = device->configuration.capabilities.modules;
+	struct _carbon_description_cache *cache = carbon_find_descriptions(modules);
+	struct _carbon_description_cache described = { modules, 0, { 0 } };
+	for (int index = 0; index < CARBON_MAX_ROUTES; index ++) {
+		lf_return_t description;
+		if (cache) {
+			description = cache->descriptions[index];
+		} else {
+			int _e = lf_describe(device, index, &description);
+			lf_assert(_e == lf_success, failure, E_FMR, "Failed to describe module '%i' of carbon chip '%i'.", index, chip);
+			described.descriptions[described.count ++] = description;
+		}
+		lf_assert(fmr_description_functions(description), failure, E_MODULE, "Carbon chip '%i' described an empty module.", chip);
+		struct _carbon_route *route = carbon_find_route(context, fmr_description_identifier(description), true);
+		lf_assert(route, failure, E_OVERFLOW, "The carbon routing table is full.");
+		route->index[chip] = index;
+		route->functions[chip] = fmr_description_functions(description);
+		route->attributes[chip] = fmr_description_attributes(description);
+		if (route->attributes[chip] & fmr_module_last) {
+			/* Only a complete description of a module table that the chip identified is kept. */
+			if (!cache && modules) {
+				carbon_description_cache[carbon_description_next] = described;
+				carbon_description_next = (carbon_description_next + 1) % CARBON_DESCRIPTION_CACHE;
+			}
+			return lf_success;
+		}
+	}
+failure:
+	return lf_error;
+}
+
+/* Routes a function of a standard module to the cheapest chip that implements it. */
+struct _lf_device *carbon_route(struct _lf_device *device, struct _lf_module *module, lf_function function, int *index) {
+	struct _carbon_context *context = device->_ctx;
+	/* User modules are only ever loaded on the 4s. */
+	if (*index & FMR_USER_INVOCATION_BIT) return device;
+	struct _carbon_route *route = carbon_find_route(context, carbon_module_identifier(module), false);
+	if (!route) return device;
+	struct _lf_device *chips[carbon_chip_count] = { context->_u2, context->_4s };
+	if (route->pinned != -1) {
+		*index = route->index[route->pinned];
+		return chips[route->pinned];
+	}
+	for (int chip = 0; chip < carbon_chip_count; chip ++) {
+		if (route->index[chip] == -1 || route->attributes[chip] & fmr_module_private) continue;
+		if (function >= route->functions[chip]) continue;
+		*index = route->index[chip];
+		return chips[chip];
+	}
+	return device;
+}
+
+/* Reports the errors deferred by either chip, as calls without replies may have been routed to both. */
+int carbon_sync(struct _lf_device *device) {
+	struct _carbon_context *context = device->_ctx;
+	int _e = lf_sync(context->_u2);
+	/* Synchronize with the 4s even if the bridge reported an error, so that its error is not left latched. */
+	if (lf_sync(context->_4s) != lf_success) _e = lf_error;
+	return _e;
+}
+
+/* Builds the routing table of a carbon device from the descriptions of its chips. */
+static int carbon_load_routes(struct _lf_device *device) {
+	struct _carbon_context *context = device->_ctx;
+	/* The bridge must be selected before the 4s can be reached through it. */
+	context->_u2->select(context->_u2);
+	int _e = lf_load_configuration(context->_u2);
+	lf_assert(_e == lf_success, failure, E_CONFIGURATION, "Failed to load the configuration of the carbon bridge.");
+	lf_negotiate(context->_u2);
+	_e = carbon_describe_chip(context, context->_u2, carbon_u2_chip);
+	lf_assert(_e == lf_success, failure, E_MODULE, "Failed to describe the modules of the carbon bridge.");
+	/* Reach the 4s through the uart0 bus at the index the bridge reports. */
+	struct _carbon_route *bridge = carbon_find_route(context, carbon_module_identifier(&_uart0), false);
+	lf_assert(bridge && bridge->index[carbon_u2_chip] != -1, failure, E_MODULE, "The carbon bridge does not implement uart0.");
+	_uart0.index = bridge->index[carbon_u2_chip];
+	_e = lf_load_configuration(context->_4s);
+	lf_assert(_e == lf_success, failure, E_CONFIGURATION, "Failed to load the configuration of the carbon 4s.");
+	lf_negotiate(context->_4s);
+	/* The carbon device shares its endpoint with the 4s, so it shares its configuration too. */
+	device->configuration = context->_4s->configuration;
+	_e = carbon_describe_chip(context, context->_4s, carbon_4s_chip);
+	lf_assert(_e == lf_success, failure, E_MODULE, "Failed to describe the modules of the carbon 4s.");
+	device->route = carbon_route;
+	device->sync = carbon_sync;
+	return lf_success;
+failure:
+	/* Fall back to the static module assignment. */
+	context->routec = 0;
+	return lf_error;
+}
+
+int carbon_pin_module(struct _lf_device *device, struct _lf_module *module, int chip) {
+	lf_assert(device, failure, E_NULL, "NULL pointer provided when pinning module.");
+	lf_assert(chip >= 0 && chip < carbon_chip_count, failure, E_BOUNDARY, "Invalid carbon chip '%i'.", chip);
+	struct _carbon_context *context = device->_ctx;
+	struct _carbon_route *route = carbon_find_route(context, carbon_module_identifier(module), false);
+	lf_assert(route, failure, E_MODULE, "The module '%s' is not routed by this carbon device.", module->name);
+	lf_assert(route->index[chip] != -1, failure, E_MODULE, "The module '%s' is not implemented by carbon chip '%i'.", module->name, chip);
+	route->pinned = chip;
+	module->device = device;
+	return lf_success;
+failure:
+	return lf_error;
+}
+
 /* Selects a carbon device. */
 int carbon_select(struct _lf_device *device) {
 	lf_assert(device, failure, E_NULL, "NULL pointer provided when selecting device.");
@@ -37,6 +194,10 @@ int carbon_select(struct _lf_device *device) {
 	carbon_select_atsam4s(device);
 	/* Select the modules on the bridge next. */
 	if (context->_4s) context->_u2->select(context->_u2);
+	/* If the chips described their modules, route every call through the carbon device instead. */
+	for (size_t i = 0; context->routec && i < sizeof(carbon_modules) / sizeof(*carbon_modules); i ++) {
+		if (carbon_find_route(context, carbon_module_identifier(carbon_modules[i]), false)) carbon_modules[i]->device = device;
+	}
 	return lf_success;
 failure:
 	return lf_error;
@@ -52,6 +213,8 @@ struct _lf_device *carbon_attach_endpoint(struct _lf_endpoint *endpoint, struct
 	/* Set the carbon's u2 and 4s sub-devices. */
 	context->_u2 = _u2;
 	context->_4s = _4s;
+	/* Ask both chips which modules they implement, so that each call can be routed to the cheapest one. */
+	if (_u2 && _4s) carbon_load_routes(carbon);
 	/* Attach to the new carbon device. */
 	lf_attach(carbon);
 	return carbon;
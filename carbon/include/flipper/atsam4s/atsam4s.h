@@ -17,6 +17,7 @@
 #define __use_dac__
 #define __use_fld__
 #define __use_gpio__
+#define __use_heap__
 #define __use_i2c__
 #define __use_led__
 #define __use_pwm__
@@ -26,6 +27,7 @@
 #define __use_task__
 #define __use_temp__
 #define __use_timer__
+#define __use_trace__
 #define __use_uart0__
 #define __use_usart__
 #define __use_usb__
@@ -5,6 +5,7 @@ enum {
 	_dac_id,
 	_fld_id,
 	_gpio_id,
+	_heap_id,
 	_i2c_id,
 	_led_id,
 	_pwm_id,
@@ -14,6 +15,7 @@ enum {
 	_task_id,
 	_temp_id,
 	_timer_id,
+	_trace_id,
 	_uart0_id,
 	_usart_id,
 	_usb_id,
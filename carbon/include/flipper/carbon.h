@@ -66,6 +66,26 @@
 #define DFU_BAUD 0x08
 #define FMR_BAUD 0x00
 
+/* The chips of a carbon device, in order of increasing invocation cost. */
+enum { carbon_u2_chip, carbon_4s_chip, carbon_chip_count };
+
+/* The maximum number of standard modules that can be routed between the chips. */
+#define CARBON_MAX_ROUTES 32
+
+/* Describes where the chips of a carbon device implement a standard module. */
+struct _carbon_route {
+	/* The identifier of the module. */
+	lf_crc_t identifier;
+	/* The module's index on each chip, or -1 if the chip does not implement it. */
+	int index[carbon_chip_count];
+	/* The number of functions each chip implements for the module. */
+	uint8_t functions[carbon_chip_count];
+	/* The attributes of the module on each chip. */
+	uint8_t attributes[carbon_chip_count];
+	/* The chip to which the module is pinned, or -1 if it is routed per function. */
+	int pinned;
+};
+
 /* Miscelaneous context for the HAL. */
 
 struct _carbon_context {
@@ -73,11 +93,17 @@ struct _carbon_context {
 	struct _lf_device *_u2;
 	/* Microprocessor that handles code execution. (ATSAM4S16B) */
 	struct _lf_device *_4s;
+	/* The routing table built from the chips' module descriptions. */
+	struct _carbon_route routes[CARBON_MAX_ROUTES];
+	/* The number of entries in the routing table. */
+	int routec;
 };
 
 /* Attaches to all carbon devices. */
 int carbon_attach(void);
 /* Attaches to a carbon device over the network. */
 struct _lf_device *carbon_attach_hostname(char *hostname);
+/* Pins all calls to a standard module to one chip of a carbon device. */
+int carbon_pin_module(struct _lf_device *device, struct _lf_module *module, int chip);
 
 #endif
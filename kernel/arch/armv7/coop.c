@@ -0,0 +1,250 @@
+/* Osmium stackless tasks. Handlers of any number of stackless tasks are run in turn by a single task, on its stack. */
+
+#include <flipper.h>
+#include <os/coop.h>
+#include <os/scheduler.h>
+#include <os/sync.h>
+
+extern struct _os_task *os_current_task;
+
+/* The flag of the runner's event that marks that a stackless task has become ready. */
+#define OS_COOP_READY (1 << 0)
+
+static struct {
+	/* The stackless tasks that are ready to run, in the order in which they will run. */
+	struct _os_coop *head;
+	struct _os_coop *tail;
+	/* The stackless tasks that have not ended. */
+	struct _os_coop *spawned;
+	/* The stackless task whose handler is running, if any. */
+	struct _os_coop *running;
+	/* The task that runs the stackless tasks. */
+	struct _os_task *task;
+	/* Wakes the runner once a stackless task becomes ready. */
+	struct _os_event wake;
+	/* The tasks waiting for the stackless tasks they spawned to end. */
+	struct _os_queue joiners;
+} os_coops;
+
+const struct _os_coop_interface os_coop = {
+	os_coop_spawn,
+	os_coop_kill,
+	os_coop_event_init,
+	os_coop_event_set,
+	os_coop_event_clear,
+	os_coop_join
+};
+
+/* Removes a stackless task from a list. */
+static void os_coop_remove(struct _os_coop **head, struct _os_coop **tail, struct _os_coop *coop) {
+	if (coop->prev) coop->prev->next = coop->next;
+	else *head = coop->next;
+	if (coop->next) coop->next->prev = coop->prev;
+	else *tail = coop->prev;
+	coop->next = coop->prev = NULL;
+}
+
+/* Appends a stackless task to a list. */
+static void os_coop_append(struct _os_coop **head, struct _os_coop **tail, struct _os_coop *coop) {
+	coop->next = NULL;
+	coop->prev = *tail;
+	if (*tail) (*tail)->next = coop;
+	else *head = coop;
+	*tail = coop;
+}
+
+/* Makes a stackless task ready, waking the runner. Must be called with the schedule locked. */
+static void os_coop_ready(struct _os_coop *coop) {
+	coop->status = os_coop_status_ready;
+	os_coop_append(&os_coops.head, &os_coops.tail, coop);
+	os_event_set(&os_coops.wake, OS_COOP_READY);
+}
+
+/* Ends a stackless task, waking the tasks waiting for the stackless tasks they spawned to end. Must be called with the schedule locked. */
+static void os_coop_finish(struct _os_coop *coop) {
+	if (coop->prev_spawned) coop->prev_spawned->next_spawned = coop->next_spawned;
+	else os_coops.spawned = coop->next_spawned;
+	if (coop->next_spawned) coop->next_spawned->prev_spawned = coop->prev_spawned;
+	coop->next_spawned = coop->prev_spawned = NULL;
+	coop->status = os_coop_status_ended;
+	while (os_task_wake(&os_coops.joiners));
+}
+
+/* Ends the wait of a stackless task whose timer expired. Called by the timer task. */
+static void os_coop_timer_expired(void *ctx) {
+	struct _os_coop *coop = ctx;
+	os_schedule_lock();
+	if (coop->status == os_coop_status_sleeping) os_coop_ready(coop);
+	os_schedule_unlock();
+}
+
+/* Parks a stackless task for the reason its handler gave for returning. Must be called with the schedule locked. */
+static void os_coop_park(struct _os_coop *coop, int reason) {
+	struct _os_coop_event *event = coop->event;
+	switch (reason) {
+		case os_coop_yielded:
+			os_coop_ready(coop);
+		break;
+		case os_coop_waiting:
+			/* The wait ends at once if the flags are already set. */
+			if (event->flags & coop->mask) {
+				coop->flags = event->flags & coop->mask;
+				os_coop_ready(coop);
+			} else {
+				coop->status = os_coop_status_waiting;
+				os_coop_append(&event->head, &event->tail, coop);
+			}
+		break;
+		case os_coop_sleeping:
+			coop->status = os_coop_status_sleeping;
+			if (os_timer_start(&coop->timer, coop->delay, 0) != lf_success) os_coop_ready(coop);
+		break;
+		default:
+			os_coop_finish(coop);
+		break;
+	}
+}
+
+/* Runs the handlers of the stackless tasks that are ready, in turn, and sleeps while none are. */
+static void os_coop_task(void) {
+	while (1) {
+		os_event_wait(&os_coops.wake, OS_COOP_READY, OS_EVENT_CLEAR);
+		while (1) {
+			os_schedule_lock();
+			struct _os_coop *coop = os_coops.head;
+			if (coop) {
+				os_coop_remove(&os_coops.head, &os_coops.tail, coop);
+				coop->status = os_coop_status_running;
+				os_coops.running = coop;
+			}
+			os_schedule_unlock();
+			if (!coop) break;
+
+			int reason = coop->handler(coop);
+
+			os_schedule_relock();
+			os_coops.running = NULL;
+			/* A stackless task killed by its own handler has already ended. */
+			if (coop->status == os_coop_status_running) os_coop_park(coop, reason);
+			os_schedule_unlock();
+		}
+	}
+}
+
+void os_coop_init(void) {
+	memset(&os_coops, 0, sizeof(os_coops));
+	os_event_init(&os_coops.wake);
+	struct _os_task *task = os_task_create(os_coop_task, NULL, NULL, OS_COOP_TASK_STACK_SIZE_WORDS * sizeof(uint32_t));
+	lf_assert(task, failure, E_NULL, "Failed to create the task that runs stackless tasks.");
+	task->priority = task->base = OS_COOP_TASK_PRIORITY;
+	os_task_add(task);
+	os_coops.task = task;
+failure:
+	return;
+}
+
+int os_coop_spawn(struct _os_coop *coop, int (* handler)(struct _os_coop *coop), void *ctx) {
+	lf_assert(coop && handler, failure, E_NULL, "Invalid stackless task provided to '%s'.", __PRETTY_FUNCTION__);
+	lf_assert(os_coops.task, failure, E_INVALID_TASK, "There is no task to run stackless tasks.");
+	lf_assert(!__get_IPSR(), failure, E_INVALID_TASK, "Stackless tasks cannot be spawned by an interrupt.");
+	/* A stackless task that has not ended is still linked into the lists of the kernel, which clearing it would corrupt. */
+	lf_assert(coop->status == os_coop_status_ended, failure, E_INVALID_TASK, "The stackless task has not ended.");
+	memset(coop, 0, sizeof(struct _os_coop));
+	coop->handler = handler;
+	coop->ctx = ctx;
+	os_timer_create(&coop->timer, os_coop_timer_expired, coop);
+	os_schedule_lock();
+	/* A stackless task spawned by another belongs to the task that spawned the other. */
+	coop->owner = (os_coops.running) ? os_coops.running->owner : os_current_task;
+	coop->next_spawned = os_coops.spawned;
+	if (coop->next_spawned) coop->next_spawned->prev_spawned = coop;
+	os_coops.spawned = coop;
+	os_coop_ready(coop);
+	os_schedule_unlock();
+	return lf_success;
+failure:
+	return lf_error;
+}
+
+void os_coop_kill(struct _os_coop *coop) {
+	if (!coop) return;
+	os_schedule_lock();
+	switch (coop->status) {
+		case os_coop_status_ready:
+			os_coop_remove(&os_coops.head, &os_coops.tail, coop);
+		break;
+		case os_coop_status_waiting:
+			os_coop_remove(&coop->event->head, &coop->event->tail, coop);
+		break;
+		case os_coop_status_sleeping:
+			os_timer_stop(&coop->timer);
+		break;
+		default:
+		break;
+	}
+	if (coop->status != os_coop_status_ended) os_coop_finish(coop);
+	os_schedule_unlock();
+}
+
+/* Ends the stackless tasks spawned by a task that is being released, before the memory holding their handlers is freed.
+   Fails if one of their handlers is running, as it is blocked within code that would be freed beneath it. */
+int os_coop_release(struct _os_task *owner) {
+	os_schedule_lock();
+	lf_assert(!os_coops.running || os_coops.running->owner != owner, failure, E_INVALID_TASK, "A stackless task of the task being released is running.");
+	struct _os_coop *coop = os_coops.spawned;
+	while (coop) {
+		struct _os_coop *next = coop->next_spawned;
+		if (coop->owner == owner) os_coop_kill(coop);
+		coop = next;
+	}
+	os_schedule_unlock();
+	return lf_success;
+failure:
+	os_schedule_unlock();
+	return lf_error;
+}
+
+int os_coop_join(void) {
+	struct _os_task *task = os_current_task;
+	os_schedule_lock();
+	lf_assert(task != os_coops.task, failure, E_INVALID_TASK, "Stackless tasks cannot wait for stackless tasks to end.");
+	while (1) {
+		struct _os_coop *coop = os_coops.spawned;
+		while (coop && coop->owner != task) coop = coop->next_spawned;
+		if (!coop) break;
+		if (os_task_block(&os_coops.joiners) != lf_success) goto failure;
+		os_schedule_relock();
+	}
+	os_schedule_unlock();
+	return lf_success;
+failure:
+	os_schedule_unlock();
+	return lf_error;
+}
+
+void os_coop_event_init(struct _os_coop_event *event) {
+	memset(event, 0, sizeof(struct _os_coop_event));
+}
+
+/* Sets flags, ending the wait of every stackless task waiting for any of them. This can be called from an interrupt. */
+void os_coop_event_set(struct _os_coop_event *event, uint32_t flags) {
+	os_schedule_lock();
+	event->flags |= flags;
+	struct _os_coop *coop = event->head;
+	while (coop) {
+		struct _os_coop *next = coop->next;
+		if (event->flags & coop->mask) {
+			os_coop_remove(&event->head, &event->tail, coop);
+			coop->flags = event->flags & coop->mask;
+			os_coop_ready(coop);
+		}
+		coop = next;
+	}
+	os_schedule_unlock();
+}
+
+void os_coop_event_clear(struct _os_coop_event *event, uint32_t flags) {
+	os_schedule_lock();
+	event->flags &= ~flags;
+	os_schedule_unlock();
+}
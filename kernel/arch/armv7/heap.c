@@ -0,0 +1,303 @@
+/* Osmium heap. A two-level segregated fit allocator, which allocates and frees in constant time, with pools of small blocks. */
+
+#include <flipper.h>
+#include <os/heap.h>
+#include <os/scheduler.h>
+#include <os/trace.h>
+
+/* A block of the heap. Its header precedes the storage given out, which holds the free list links while the block is free. */
+struct _os_block {
+	/* The previous block in memory, valid only if that block is free. */
+	struct _os_block *prev;
+	/* The size of the block's storage, with the block's flags in its low bits. */
+	size_t size;
+	/* The neighbouring free blocks of the same size class, valid only if the block is free. */
+	struct _os_block *next_free;
+	struct _os_block *prev_free;
+};
+
+#define OS_HEAP_HEADER offsetof(struct _os_block, next_free)
+
+/* The block is free. */
+#define OS_BLOCK_FREE (1 << 0)
+/* The previous block in memory is free. */
+#define OS_BLOCK_PREV_FREE (1 << 1)
+/* The block belongs to a pool. */
+#define OS_BLOCK_POOLED (1 << 2)
+
+#define os_block_size(block) ((block)->size & ~(size_t)(OS_HEAP_ALIGN - 1))
+#define os_block_next(block) ((struct _os_block *)((uint8_t *)(block) + OS_HEAP_HEADER + os_block_size(block)))
+#define os_block_storage(block) ((void *)((uint8_t *)(block) + OS_HEAP_HEADER))
+#define os_block_from(pointer) ((struct _os_block *)((uint8_t *)(pointer) - OS_HEAP_HEADER))
+
+/* Gives the index of the most significant bit set. */
+#define os_fls(x) ((int)(sizeof(unsigned long) * 8 - 1) - __builtin_clzl(x))
+
+static const size_t os_pool_sizes[OS_HEAP_POOLS] = OS_HEAP_POOL_SIZES;
+
+static struct {
+	/* The bitmap of the powers of two that have free blocks, and for each, the bitmap of its classes that do. */
+	uint32_t fl_map;
+	uint32_t sl_map[OS_HEAP_FL_COUNT];
+	/* The free blocks of each size class. */
+	struct _os_block *blocks[OS_HEAP_FL_COUNT][OS_HEAP_SL_COUNT];
+	/* The free blocks of each pool. */
+	struct _os_block *pools[OS_HEAP_POOLS];
+	/* The part of the pools' region that has yet to be given to a pool. */
+	uint8_t *pool_next;
+	uint8_t *pool_end;
+	struct _heap_stats stats;
+} os_heap;
+
+/* Gives the size class of a block's storage. */
+static void os_heap_mapping(size_t size, int *fl, int *sl) {
+	if (size < (1UL << OS_HEAP_FL_SHIFT)) {
+		*fl = 0;
+		*sl = size >> OS_HEAP_ALIGN_SHIFT;
+	} else {
+		int f = os_fls(size);
+		*sl = (size >> (f - OS_HEAP_SL_BITS)) ^ OS_HEAP_SL_COUNT;
+		*fl = f - (OS_HEAP_FL_SHIFT - 1);
+	}
+}
+
+static void os_heap_insert(struct _os_block *block) {
+	int fl, sl;
+	os_heap_mapping(os_block_size(block), &fl, &sl);
+	struct _os_block *head = os_heap.blocks[fl][sl];
+	block->next_free = head;
+	block->prev_free = NULL;
+	if (head) head->prev_free = block;
+	os_heap.blocks[fl][sl] = block;
+	os_heap.fl_map |= (1UL << fl);
+	os_heap.sl_map[fl] |= (1UL << sl);
+	os_heap.stats.available += OS_HEAP_HEADER + os_block_size(block);
+}
+
+static void os_heap_remove(struct _os_block *block) {
+	int fl, sl;
+	os_heap_mapping(os_block_size(block), &fl, &sl);
+	if (block->prev_free) block->prev_free->next_free = block->next_free;
+	else os_heap.blocks[fl][sl] = block->next_free;
+	if (block->next_free) block->next_free->prev_free = block->prev_free;
+	if (!os_heap.blocks[fl][sl]) {
+		os_heap.sl_map[fl] &= ~(1UL << sl);
+		if (!os_heap.sl_map[fl]) os_heap.fl_map &= ~(1UL << fl);
+	}
+	os_heap.stats.available -= OS_HEAP_HEADER + os_block_size(block);
+}
+
+/* Finds a free block of the first size class whose every block can hold the size given. */
+static struct _os_block *os_heap_find(size_t size) {
+	/* Round the size up to the next class, so that any block of the class found will do. */
+	if (size >= (1UL << OS_HEAP_FL_SHIFT)) size += (1UL << (os_fls(size) - OS_HEAP_SL_BITS)) - 1;
+	if (size >= (1UL << OS_HEAP_FL_MAX)) return NULL;
+	int fl, sl;
+	os_heap_mapping(size, &fl, &sl);
+	uint32_t sl_map = os_heap.sl_map[fl] & (~0UL << sl);
+	if (!sl_map) {
+		uint32_t fl_map = os_heap.fl_map & (~0UL << (fl + 1));
+		if (!fl_map) return NULL;
+		fl = __builtin_ctz(fl_map);
+		sl_map = os_heap.sl_map[fl];
+	}
+	return os_heap.blocks[fl][__builtin_ctz(sl_map)];
+}
+
+/* Takes a block with storage of the given size out of the heap, returning what remains of it to the heap. */
+static struct _os_block *os_heap_take(size_t size) {
+	struct _os_block *block = os_heap_find(size);
+	if (!block) {
+		os_heap.stats.failures ++;
+		return NULL;
+	}
+	os_heap_remove(block);
+	struct _os_block *next = os_block_next(block);
+	if (os_block_size(block) >= size + OS_HEAP_HEADER + OS_HEAP_ALIGN) {
+		struct _os_block *remainder = (struct _os_block *)((uint8_t *)os_block_storage(block) + size);
+		remainder->size = (os_block_size(block) - size - OS_HEAP_HEADER) | OS_BLOCK_FREE;
+		block->size = size | (block->size & OS_BLOCK_PREV_FREE);
+		next->prev = remainder;
+		os_heap_insert(remainder);
+	} else {
+		block->size &= ~(size_t)OS_BLOCK_FREE;
+		next->size &= ~(size_t)OS_BLOCK_PREV_FREE;
+	}
+	os_heap.stats.used += OS_HEAP_HEADER + os_block_size(block);
+	if (os_heap.stats.used > os_heap.stats.peak) os_heap.stats.peak = os_heap.stats.used;
+	os_heap.stats.allocations ++;
+	return block;
+}
+
+/* Returns a block to the heap, merging it with the free blocks on either side. */
+static void os_heap_give(struct _os_block *block) {
+	os_heap.stats.used -= OS_HEAP_HEADER + os_block_size(block);
+	os_heap.stats.allocations --;
+	block->size |= OS_BLOCK_FREE;
+	if (block->size & OS_BLOCK_PREV_FREE) {
+		struct _os_block *prev = block->prev;
+		os_heap_remove(prev);
+		prev->size += OS_HEAP_HEADER + os_block_size(block);
+		block = prev;
+	}
+	struct _os_block *next = os_block_next(block);
+	if (next->size & OS_BLOCK_FREE) {
+		os_heap_remove(next);
+		block->size += OS_HEAP_HEADER + os_block_size(next);
+		next = os_block_next(block);
+	}
+	next->prev = block;
+	next->size |= OS_BLOCK_PREV_FREE;
+	os_heap_insert(block);
+}
+
+/* Gives the pool that serves a size, or -1 if the size is served by the heap. */
+static int os_pool_for(size_t size) {
+	for (int i = 0; i < OS_HEAP_POOLS; i ++) {
+		if (size <= os_pool_sizes[i]) return i;
+	}
+	return -1;
+}
+
+/* Takes a block from a pool, carving a new one out of the pools' region when the pool is empty. */
+static struct _os_block *os_pool_take(int index) {
+	size_t size = os_pool_sizes[index];
+	struct _os_block *block = os_heap.pools[index];
+	if (block) {
+		os_heap.pools[index] = block->next_free;
+	} else {
+		if ((size_t)(os_heap.pool_end - os_heap.pool_next) < OS_HEAP_HEADER + size) return NULL;
+		block = (struct _os_block *)os_heap.pool_next;
+		block->size = size | OS_BLOCK_POOLED;
+		os_heap.pool_next += OS_HEAP_HEADER + size;
+	}
+	os_heap.stats.pooled -= OS_HEAP_HEADER + size;
+	os_heap.stats.allocations ++;
+	return block;
+}
+
+static void os_pool_give(struct _os_block *block) {
+	int index = os_pool_for(os_block_size(block));
+	block->next_free = os_heap.pools[index];
+	os_heap.pools[index] = block;
+	os_heap.stats.pooled += OS_HEAP_HEADER + os_block_size(block);
+	os_heap.stats.allocations --;
+}
+
+int os_heap_init(void *base, size_t size) {
+	memset(&os_heap, 0, sizeof(os_heap));
+	/* Align the start of the heap, and leave room at its end for a header that marks the end. */
+	uintptr_t start = lf_ceiling((uintptr_t)base, OS_HEAP_ALIGN) * OS_HEAP_ALIGN;
+	lf_assert(size > (start - (uintptr_t)base) + 2 * OS_HEAP_HEADER + OS_HEAP_ALIGN, failure, E_MALLOC, "The heap is too small.");
+	size = (size - (start - (uintptr_t)base)) & ~(size_t)(OS_HEAP_ALIGN - 1);
+	if (size > (1UL << OS_HEAP_FL_MAX) - OS_HEAP_ALIGN) size = (1UL << OS_HEAP_FL_MAX) - OS_HEAP_ALIGN;
+	/* Set aside the pools' region, so that small blocks do not pin the heap apart. */
+	size_t reserve = (size / OS_HEAP_POOL_SHARE) & ~(size_t)(OS_HEAP_ALIGN - 1);
+	os_heap.pool_next = (uint8_t *)start;
+	os_heap.pool_end = (uint8_t *)start + reserve;
+	struct _os_block *block = (struct _os_block *)os_heap.pool_end;
+	block->prev = NULL;
+	block->size = (size - reserve - 2 * OS_HEAP_HEADER) | OS_BLOCK_FREE;
+	/* The end is marked by an empty block that is never free. */
+	struct _os_block *end = os_block_next(block);
+	end->prev = block;
+	end->size = OS_BLOCK_PREV_FREE;
+	os_heap_insert(block);
+	os_heap.stats.size = size;
+	os_heap.stats.used = os_heap.stats.peak = reserve + OS_HEAP_HEADER;
+	os_heap.stats.pooled = reserve;
+	return lf_success;
+failure:
+	return lf_error;
+}
+
+void *os_heap_alloc(size_t size) {
+	if (!size) size = 1;
+	size = lf_ceiling(size, OS_HEAP_ALIGN) * OS_HEAP_ALIGN;
+	os_schedule_lock();
+	int pool = os_pool_for(size);
+	struct _os_block *block = (pool < 0) ? NULL : os_pool_take(pool);
+	/* A size served by a pool that cannot be refilled may still be served by the heap. */
+	if (!block) block = os_heap_take(size);
+	os_schedule_unlock();
+	if (!block) return NULL;
+	os_trace(lf_trace_alloc, os_block_size(block));
+	return os_block_storage(block);
+}
+
+void os_heap_free(void *pointer) {
+	if (!pointer) return;
+	struct _os_block *block = os_block_from(pointer);
+	os_trace(lf_trace_free, os_block_size(block));
+	os_schedule_lock();
+	if (block->size & OS_BLOCK_POOLED) os_pool_give(block);
+	else os_heap_give(block);
+	os_schedule_unlock();
+}
+
+void *os_heap_realloc(void *pointer, size_t size) {
+	if (!pointer) return os_heap_alloc(size);
+	if (!size) {
+		os_heap_free(pointer);
+		return NULL;
+	}
+	size_t current = os_block_size(os_block_from(pointer));
+	/* Blocks are not shrunk in place. */
+	if (size <= current) return pointer;
+	void *resized = os_heap_alloc(size);
+	if (!resized) return NULL;
+	memcpy(resized, pointer, current);
+	os_heap_free(pointer);
+	return resized;
+}
+
+int os_heap_stats(struct _heap_stats *stats) {
+	lf_assert(stats, failure, E_NULL, "No storage was given for the usage of the heap.");
+	os_schedule_lock();
+	*stats = os_heap.stats;
+	/* The largest free block is within the highest size class that has free blocks. */
+	stats->largest = 0;
+	if (os_heap.fl_map) {
+		int fl = os_fls(os_heap.fl_map);
+		int sl = os_fls(os_heap.sl_map[fl]);
+		for (struct _os_block *block = os_heap.blocks[fl][sl]; block; block = block->next_free) {
+			if (os_block_size(block) > stats->largest) stats->largest = os_block_size(block);
+		}
+	}
+	os_schedule_unlock();
+	return lf_success;
+failure:
+	return lf_error;
+}
+
+/* ~ The C library's allocator is replaced by the heap, which claims the memory left for it by the linker. ~ */
+
+extern char *_sbrk(int increment);
+extern unsigned char __heap_end__;
+
+static void *os_malloc(size_t size) {
+	if (!os_heap.stats.size) {
+		unsigned char *base = (unsigned char *)_sbrk(0);
+		int length = &__heap_end__ - base;
+		if (_sbrk(length) == (char *)(-1) || os_heap_init(base, length) != lf_success) return NULL;
+	}
+	return os_heap_alloc(size);
+}
+
+static void *os_calloc(size_t count, size_t size) {
+	if (size && count > SIZE_MAX / size) return NULL;
+	void *pointer = os_malloc(count * size);
+	if (pointer) memset(pointer, 0, count * size);
+	return pointer;
+}
+
+struct _reent;
+
+void *malloc(size_t size) { return os_malloc(size); }
+void *calloc(size_t count, size_t size) { return os_calloc(count, size); }
+void *realloc(void *pointer, size_t size) { return (pointer) ? os_heap_realloc(pointer, size) : os_malloc(size); }
+void free(void *pointer) { os_heap_free(pointer); }
+void *_malloc_r(struct _reent *reent, size_t size) { return os_malloc(size); }
+void *_calloc_r(struct _reent *reent, size_t count, size_t size) { return os_calloc(count, size); }
+void *_realloc_r(struct _reent *reent, void *pointer, size_t size) { return realloc(pointer, size); }
+void _free_r(struct _reent *reent, void *pointer) { os_heap_free(pointer); }
@@ -1,6 +1,7 @@
 /* The Osmium loader implementation. */
 
 #include <os/loader.h>
+#include <os/coop.h>
 #include <os/scheduler.h>
 
 /*
@@ -37,8 +38,10 @@
   |            &(.bss)           |               |
   +------------------------------+  0x0024       |
   |          sizeof(.got)        |               |
-  +------------------------------+  0x0028     --+
-  |            &(.got)           |
+  +------------------------------+  0x0028       |
+  |            &(.got)           |               |
+  +------------------------------+  0x002c     --+
+  |         sizeof(stack)        |
   +------------------------------+  [0x000c]
   |           .module            |
   +------------------------------+
@@ -88,7 +91,11 @@ int os_load_application(void *_base) {
 
 	struct _lf_abi_header *header = (struct _lf_abi_header *)_base;
 	struct _os_app *app = get_app(header);
-	if (app) os_task_release(app->task);
+	if (app) {
+		/* The app is not replaced while one of its stackless tasks is running. */
+		int _e = os_task_release(app->task);
+		lf_assert(_e == lf_success, refused, E_INVALID_TASK, "The app '%s' cannot be replaced while one of its stackless tasks is running.", app->name);
+	}
 
 	app = malloc(sizeof(struct _os_app));
 	lf_assert(app, failure, E_NULL, "Failed to allocate memory to create app.");
@@ -96,10 +103,17 @@ int os_load_application(void *_base) {
 	app->base = _base;
 	app->name = _base + header->name_offset;
 
+	/* The stack size is only read from images whose header has room for it. */
+	uint32_t stack_size = APPLICATION_STACK_SIZE_WORDS * sizeof(uint32_t);
+	if (header->module_offset >= sizeof(struct _lf_abi_header) && header->stack_size) stack_size = lf_ceiling(header->stack_size, sizeof(uint32_t)) * sizeof(uint32_t);
+	lf_assert(stack_size <= APPLICATION_MAX_STACK_SIZE_WORDS * sizeof(uint32_t), failure, E_OVERFLOW, "The app '%s' asks for a stack of %i bytes.", app->name, stack_size);
+
 	void *_main = _base + header->entry;
-	task = os_task_create(_main, os_app_exit, app, APPLICATION_STACK_SIZE_WORDS * sizeof(uint32_t));
+	task = os_task_create(_main, os_app_exit, app, stack_size);
 	lf_assert(task, failure, E_NULL, "Failed to allocate memory for task");
 	app->task = task;
+	/* The app's entry point is given the interface of the kernel's stackless tasks, through which it can spawn them. */
+	((struct _stack_ctx *)(task->sp + sizeof(struct _task_ctx)))->r0 = (uintptr_t)&os_coop;
 
 	lf_ll_append(&apps, app, free);
 
@@ -111,6 +125,7 @@ int os_load_application(void *_base) {
 failure:
 	if (app) free(app);
 	if (task) os_task_release(task);
+refused:
 	return lf_error;
 }
 
@@ -212,7 +227,7 @@ failure:
 }
 
 /* Handles the invocation of user functions. */
-int fmr_perform_user_invocation(struct _fmr_invocation *invocation, struct _fmr_result *result) {
+int fmr_perform_user_invocation(struct _fmr_invocation *invocation, lf_size_t length, struct _fmr_result *result) {
 	/* Ensure that the index is within bounds. */
 	if (invocation->index >= user_modules.count) {
 		return lf_error;
@@ -230,7 +245,13 @@ int fmr_perform_user_invocation(struct _fmr_invocation *invocation, struct _fmr_
 		lf_error_raise(E_RESOULTION, NULL);
 		return lf_error;
 	}
+	/* Expand the arguments into the layout expected by the native calling convention. */
+	lf_types argt;
+	uint8_t argv[FMR_MAX_ARGC * sizeof(lf_arg)];
+	if (fmr_unpack(invocation, length, &argt, argv, NULL, 0) != lf_success) {
+		return lf_error;
+	}
 	/* Perform the function call internally. */
-	result->value = fmr_call(address, invocation->ret, invocation->argc, invocation->types, invocation->parameters);
+	result->value = fmr_call(address, invocation->ret, invocation->argc, argt, argv);
 	return result->error = lf_error_get();
 }
@@ -1,22 +1,156 @@
 /* Osmium scheduler implementation. */
 
 #include <flipper.h>
+#include <os/coop.h>
 #include <os/scheduler.h>
+#include <os/trace.h>
 
 /* Pointers to the current and next tasks. */
 struct _os_task *os_current_task;
 struct _os_task *os_next_task;
 
-/* Reserves the system task stack. */
-os_stack_t kernel_task_stack[KERNEL_TASK_STACK_SIZE_WORDS];
-
 /* An empty schedule. */
 struct _os_schedule schedule;
 
+#include <os/sync.h>
+
+#define os_us_to_cycles(us) ((uint64_t)(us) * (F_CPU / 1000000))
+
+/* The clock cycles counted by the SysTick up to the start of its current period. */
+static volatile uint64_t os_cycles;
+
+/* Appends a task to the ready queue of its priority. */
+static void os_ready_append(struct _os_task *task) {
+	struct _os_queue *queue = &schedule.ready[task->priority];
+	task->next = NULL;
+	task->prev = queue->tail;
+	if (queue->tail) queue->tail->next = task;
+	else queue->head = task;
+	queue->tail = task;
+	schedule.ready_map |= (1UL << task->priority);
+}
+
+/* Prepends a task to the ready queue of its priority, so that it is the next of its priority to run. */
+static void os_ready_prepend(struct _os_task *task) {
+	struct _os_queue *queue = &schedule.ready[task->priority];
+	task->prev = NULL;
+	task->next = queue->head;
+	if (queue->head) queue->head->prev = task;
+	else queue->tail = task;
+	queue->head = task;
+	schedule.ready_map |= (1UL << task->priority);
+}
+
+/* Unlinks a task from a queue. */
+static void os_queue_remove(struct _os_queue *queue, struct _os_task *task) {
+	if (task->prev) task->prev->next = task->next;
+	else queue->head = task->next;
+	if (task->next) task->next->prev = task->prev;
+	else queue->tail = task->prev;
+	task->next = task->prev = NULL;
+}
+
+/* Removes a task from the ready queue of its priority. */
+static void os_ready_remove(struct _os_task *task) {
+	struct _os_queue *queue = &schedule.ready[task->priority];
+	os_queue_remove(queue, task);
+	if (!queue->head) schedule.ready_map &= ~(1UL << task->priority);
+}
+
+/* Links a task into a queue behind another task, or at the head of the queue if there is none. */
+static void os_queue_insert(struct _os_queue *queue, struct _os_task *after, struct _os_task *task) {
+	task->prev = after;
+	task->next = (after) ? after->next : queue->head;
+	if (task->next) task->next->prev = task;
+	else queue->tail = task;
+	if (after) after->next = task;
+	else queue->head = task;
+}
+
+/* Inserts a task among the sleeping tasks, behind those that wake no later than it. */
+static void os_sleep_insert(struct _os_task *task) {
+	struct _os_task *after = schedule.sleeping.tail;
+	while (after && after->wake > task->wake) after = after->prev;
+	os_queue_insert(&schedule.sleeping, after, task);
+}
+
+/* Inserts a task into a wait list, behind the waiting tasks of no lower priority. */
+static void os_wait_insert(struct _os_queue *waiters, struct _os_task *task) {
+	struct _os_task *after = waiters->tail;
+	while (after && after->priority < task->priority) after = after->prev;
+	os_queue_insert(waiters, after, task);
+}
+
+/* Takes a task out of its ready queue, or out of the list it is sleeping or blocked in. */
+static void os_task_unready(struct _os_task *task) {
+	if (task->status == os_task_status_sleeping) os_queue_remove(&schedule.sleeping, task);
+	else if (task->status == os_task_status_blocked) {
+		os_queue_remove(task->waiting, task);
+		task->waiting = NULL;
+	}
+	else if (task->status != os_task_status_paused) os_ready_remove(task);
+}
+
+/* Gives the first task of the highest priority that has a task ready to run. */
+static struct _os_task *os_ready_first(void) {
+	/* The system task is never paused, so there is always a task ready to run. */
+	return schedule.ready[31 - __CLZ(schedule.ready_map)].head;
+}
+
+/* Gives the clock cycles elapsed since the scheduler started. Must be called with interrupts masked. */
+static uint64_t os_now(void) {
+	uint32_t value = SysTick->VAL;
+	uint64_t cycles = os_cycles;
+	/* A period that ended while interrupts were masked has not been counted yet. */
+	if (SCB->ICSR & SCB_ICSR_PENDSTSET_Msk) {
+		cycles += SysTick->LOAD + 1;
+		value = SysTick->VAL;
+	}
+	return cycles + SysTick->LOAD - value;
+}
+
+/* Restarts the SysTick so that its period ends after the given number of clock cycles. */
+static void os_tick(uint64_t cycles) {
+	if (cycles > OS_MAX_TICK + 1) cycles = OS_MAX_TICK + 1;
+	if (cycles < os_us_to_cycles(1)) cycles = os_us_to_cycles(1);
+	/* Count the part of the period that is cut short. */
+	os_cycles = os_now();
+	SCB->ICSR = SCB_ICSR_PENDSTCLR_Msk;
+	SysTick->LOAD = cycles - 1;
+	SysTick->VAL = 0;
+}
+
+/* Programs the SysTick to fire when the running task's time slice ends or the first sleeping task wakes, whichever is sooner. */
+static void os_retime(void) {
+	uint64_t cycles = UINT64_MAX;
+	/* Time is only sliced between tasks that share the highest ready priority. */
+	if (os_ready_first()->next) cycles = os_us_to_cycles(OS_SLICE_US);
+	if (schedule.sleeping.head) {
+		uint64_t now = os_now();
+		uint64_t wake = schedule.sleeping.head->wake;
+		uint64_t until = (wake > now) ? (wake - now) : 0;
+		if (until < cycles) cycles = until;
+	}
+	os_tick(cycles);
+}
+
+/* Switches to the first ready task if it is not already running. */
+static void os_schedule(void) {
+	struct _os_task *next = os_ready_first();
+	os_retime();
+	if (next == os_current_task) return;
+	if (os_current_task && os_current_task->status == os_task_status_active) os_current_task->status = os_task_status_idle;
+	os_next_task = next;
+	/* Mark the next task as active. */
+	os_next_task->status = os_task_status_active;
+	/* Queue the PendSV exception to perform the context switch. */
+	SCB->ICSR |= SCB_ICSR_PENDSVSET_Msk;
+}
+
 /* Called when an application finishes execution. */
 void os_task_finished(void) {
-	/* Release the current task. */
-	os_task_release(os_current_task);
+	/* Release the current task, waiting for any of its stackless tasks that is running to return. */
+	while (os_task_release(os_current_task) != lf_success) os_sleep_us(1000);
 	/* Prevent the CPU from wandering off. */
 	while (1);
 }
@@ -30,18 +164,23 @@ void os_scheduler_init(void) {
 
 	/* Clear the schedule. */
 	memset(&schedule, 0, sizeof(struct _os_schedule));
+	/* Every slot of the PID table is free. */
+	schedule.free = (OS_MAX_TASKS == 32) ? UINT32_MAX : ((1UL << OS_MAX_TASKS) - 1);
 
-	/* Create the system task. */
+	/* Create the system task, which takes the first slot and so has PID 0. */
 	struct _os_task *task = os_task_create(os_kernel_task, NULL, NULL, KERNEL_TASK_STACK_SIZE_WORDS * sizeof(uint32_t));
-	/* Add the task. */
-	os_task_add(task);
 	/* Make the current task and the head of the task list the system task. */
 	os_current_task = schedule.head = task;
-	/* Make the system task's next task point back to the system task. */
-	task->next = task;
+	/* The system task only runs when no other task is ready. */
+	task->priority = task->base = OS_IDLE_PRIORITY;
+	/* Add the task. */
+	os_task_add(task);
+	task->status = os_task_status_active;
 
-	/* Configure the SysTick to fire once every millisecond. */
-	SysTick_Config(F_CPU / 1000);
+	/* Start the SysTick. It is reprogrammed whenever the schedule changes, so it only fires when there is a time slice to end or a task to wake. */
+	SysTick->LOAD = OS_MAX_TICK;
+	SysTick->VAL = 0;
+	SysTick->CTRL = SysTick_CTRL_CLKSOURCE_Msk | SysTick_CTRL_TICKINT_Msk | SysTick_CTRL_ENABLE_Msk;
 
 	uint32_t psp = task->sp + sizeof(struct _task_ctx) + sizeof(struct _stack_ctx);
 	/* Set the PSP equal to the top of the system task's stack. */
@@ -59,45 +198,57 @@ void os_scheduler_init(void) {
 }
 
 int os_task_add(struct _os_task *task) {
-
-	if (schedule.count) {
-		/* Walk to the end of the task list. */
-		struct _os_task *_tail = schedule.head;
-		int count = schedule.count;
-		while (-- count) _tail = _tail->next;
-		/* Set the tail of the task list's next task equal to the newly allocated task. */
-		_tail->next = task;
-	}
-
+	lf_assert(task, failure, E_NULL, "Invalid task pointer provided to '%s'.", __PRETTY_FUNCTION__);
+	os_schedule_lock();
+	/* Make the task ready to run after the tasks of its priority that are already waiting. */
+	os_ready_append(task);
 	/* Increment the number of active tasks. */
 	schedule.count ++;
-
+	os_schedule_unlock();
 	return lf_success;
+failure:
+	return lf_error;
 }
 
 struct _os_task *os_task_create(void *_entry, void (* _exit)(void *_ctx), void *_ctx, uint32_t stack_size) {
+	struct _os_task *task = NULL;
+	os_stack_t *stack = NULL;
+	/* Reclaim the memory of the tasks that have ended before allocating more. */
+	os_task_reap();
+	lf_assert(schedule.free, failure, E_INVALID_TASK, "No more than %i tasks can exist at once.", OS_MAX_TASKS);
 	/* Allocate the next available task slot. */
-	struct _os_task *task = malloc(sizeof(struct _os_task));
+	task = malloc(sizeof(struct _os_task));
 	lf_assert(task, failure, E_NULL, "Failed to allocate memory to create task");
-	os_stack_t *stack = malloc(stack_size);
+	stack = malloc(stack_size);
 	lf_assert(stack, failure, E_NULL, "Failed to allocate memory to create stack.");
+	/* Paint the stack, so that the most of it the task ever uses can be measured. */
+	for (uint32_t i = 0; i < stack_size / sizeof(os_stack_t); i ++) stack[i] = OS_STACK_PAINT;
 
 	/* Set the task's stack pointer to the top of the task's stack. */
 	task->sp = (uintptr_t)stack + stack_size;
-	/* Set the PID of the task. */
-	task->pid = schedule.next_pid ++;
+	/* Take the lowest free slot of the PID table, and give the task a PID within it. */
+	os_schedule_lock();
+	int slot = __CLZ(__RBIT(schedule.free));
+	schedule.free &= ~(1UL << slot);
+	schedule.tasks[slot] = task;
+	task->pid = (schedule.generation ++ << OS_PID_SLOT_BITS) | slot;
+	os_schedule_unlock();
 	/* Set the entry point of the task. */
 	task->handler = _entry;
 	/* Mark the task as idle. */
 	task->status = os_task_status_idle;
 	/* Store the address of the task's stack. */
 	task->stack = stack;
+	task->stack_size = stack_size;
 	/* Set the task's exit function. */
 	task->exit = _exit;
 	/* Set the task's exit context. */
 	task->_ctx = _ctx;
-	/* Set the task's next task equal to the head of the task list. */
-	task->next = schedule.head;
+	/* Every task begins with the same priority. */
+	task->priority = task->base = OS_DEFAULT_PRIORITY;
+	task->waiting = NULL;
+	task->held = NULL;
+	task->next = task->prev = NULL;
 
 	/* Push the stack context onto the process' stack. */
 	task->sp -= sizeof(struct _stack_ctx);
@@ -122,83 +273,99 @@ struct _os_task *os_task_create(void *_entry, void (* _exit)(void *_ctx), void *
 	_tsk->r9 = 9;
 	_tsk->r10 = 10;
 	_tsk->r11 = 11;
+#ifdef __ARM_FP
+	/* Return to thread mode using the PSP, with a frame that holds no FPU state. */
+	_tsk->exc_return = 0xFFFFFFFD;
+#endif
 
 	return task;
 failure:
+	free(stack);
+	free(task);
 	return NULL;
 }
 
 int os_task_release(struct _os_task *task) {
 	lf_assert(task, failure, E_NULL, "Invalid task pointer provided to '%s'.", __PRETTY_FUNCTION__);
 	lf_assert(task != schedule.head, failure, E_INVALID_TASK, "Tried to release task head.");
+	/* End the stackless tasks the task spawned, whose handlers may be freed by its exit function. This is refused while one of them is running. */
+	int _e = os_coop_release(task);
+	lf_assert(_e == lf_success, failure, E_INVALID_TASK, "Tried to release a task while one of its stackless tasks is running.");
 	/* Disallow interrupts while freeing memory. */
 	__disable_irq();
+	/* Hand the mutexes the task holds to their waiters, before the exit function frees them or the task record is freed. */
+	os_mutex_release(task);
 	/* Call the task's exit function. */
 	if (task->exit) task->exit(task->_ctx);
-	/* If it was allocated, free the memory associated with the task's stack. */
-	if (task->stack) free(task->stack);
-	/* Allow interrupts again. */
-	__enable_irq();
-	/* Update the parent task's next pointer. */
-	struct _os_task *parent = schedule.head;
-	for (int i = 0; i < schedule.count; i ++) {
-		if (parent->next == task) {
-			parent->next = task->next;
-			break;
-		}
-	}
-	/* If the released task was the actively executing task, move on to the next task. */
+	/* Take the task out of the schedule, and free its slot of the PID table. */
+	os_task_unready(task);
+	int slot = os_pid_slot(task->pid);
+	schedule.tasks[slot] = NULL;
+	schedule.free |= (1UL << slot);
+	/* Decrement the number of active tasks. */
+	schedule.count --;
 	if (task == os_current_task) {
+		/* A task releasing itself is still running on its stack, which the context switch saves to as well. Its stack and record are
+		   freed by 'os_task_reap' once it has been switched away from. */
+		task->status = os_task_status_dead;
+		task->next = schedule.dead;
+		schedule.dead = task;
 		os_current_task = NULL;
-		os_next_task = task->next;
-		os_task_next();
+		os_schedule();
+		__enable_irq();
+		return lf_success;
 	}
-	/* Free the task record. */
+	/* Allow interrupts again. */
+	__enable_irq();
+	/* Free the task's stack and record. */
+	free(task->stack);
 	free(task);
-	/* Decrement the number of active tasks. */
-	schedule.count --;
 	return lf_success;
 failure:
 	return lf_error;
 }
 
+/* Frees the stacks and records of the tasks that released themselves. Must be called by another task, so that none of them is running. */
+void os_task_reap(void) {
+	os_schedule_lock();
+	struct _os_task *dead = schedule.dead;
+	schedule.dead = NULL;
+	os_schedule_unlock();
+	while (dead) {
+		struct _os_task *next = dead->next;
+		free(dead->stack);
+		free(dead);
+		dead = next;
+	}
+}
+
 /* Schedules the next task for exeuction. */
 void os_task_next(void) {
-	if (os_current_task) {
-		/* Mark the current task as idle. */
-		os_current_task->status = os_task_status_idle;
-		/* Prepare to context switch to the active task. */
-		os_next_task = os_current_task->next;
+	os_schedule_lock();
+	/* The running task goes behind the other tasks of its priority. */
+	struct _os_task *current = os_current_task;
+	if (current && current->status == os_task_status_active) {
+		os_ready_remove(current);
+		os_ready_append(current);
 	}
-check:
-	/* If the next task is paused, skip it. */
-	if (os_next_task->status == os_task_status_paused) {
-		os_next_task = os_next_task->next;
-		/* Check if the next next task was paused, so on and so fourth. */
-		goto check;
-	}
-	/* Mark the next task as active. */
-	os_next_task->status = os_task_status_active;
-	/* Queue the PendSV exception to perform the context switch. */
-	SCB->ICSR |= SCB_ICSR_PENDSVSET_Msk;
+	os_schedule();
+	os_schedule_unlock();
 }
 
 /* Called at the end of the PendSV exception to cycle the task pointers. */
 void os_update_task_pointers(void) {
+	os_trace(lf_trace_switch, os_next_task->pid);
 	/* Make the current task the next task. */
 	os_current_task = os_next_task;
+	schedule.switches ++;
 }
 
 /* Gets the task pointer for a given PID. */
 struct _os_task *os_task_from_pid(int pid) {
-	struct _os_task *task = schedule.head;
-	for (int i = 0; i < schedule.count; i ++) {
-		if (pid == task->pid) {
-			return task;
-		}
-		task = task->next;
-	}
-	return NULL;
+	if (pid < 0) return NULL;
+	struct _os_task *task = schedule.tasks[os_pid_slot(pid)];
+	/* The slot may since have been given to another task. */
+	return (task && task->pid == pid) ? task : NULL;
 }
 
 /* Pauses the execution of the current task. */
@@ -214,12 +381,15 @@ int os_task_pause(int pid) {
 		lf_error_raise(E_NO_PID, NULL);
 		return lf_error;
 	}
-	/* If the task is the currently executing task, queue the move to the next task. */
-	if (os_current_task == task) {
-		os_task_next();
+	os_schedule_lock();
+	if (task->status != os_task_status_paused) {
+		/* Mark the task as paused, and take it out of its ready queue. */
+		os_task_unready(task);
+		task->status = os_task_status_paused;
+		/* If the task is the currently executing task, queue the move to the next task. */
+		if (os_current_task == task) os_schedule();
 	}
-	/* Mark the task as paused. */
-	task->status = os_task_status_paused;
+	os_schedule_unlock();
 	return lf_success;
 }
 
@@ -235,13 +405,18 @@ int os_task_resume(int pid) {
 		lf_error_raise(E_NO_PID, NULL);
 		return lf_error;
 	}
-	/* Mark the task as idle so it is executed during the next scheduling event. */
-	task->status = os_task_status_idle;
-	/* Execute the resumed task next. */
-	os_current_task->status = os_task_status_idle;
-	os_current_task = NULL;
-	os_next_task = task;
-	os_task_next();
+	os_schedule_lock();
+	/* Execute the resumed task next among the tasks of its priority, waking it if it is sleeping. */
+	os_task_unready(task);
+	if (task->status != os_task_status_active) task->status = os_task_status_idle;
+	os_ready_prepend(task);
+	/* The current task gives way to the resumed task, unless its priority is higher. */
+	if (os_current_task && os_current_task != task && os_current_task->priority == task->priority) {
+		os_ready_remove(os_current_task);
+		os_ready_append(os_current_task);
+	}
+	os_schedule();
+	os_schedule_unlock();
 	return lf_success;
 }
 
@@ -258,8 +433,132 @@ int os_task_stop(int pid) {
 	return os_task_release(task);
 }
 
-/* This function is called once per millisecond and triggers a context switch. */
+/* Sets the priority of a task, running the highest priority task that is ready. */
+int os_task_priority(int pid, int priority) {
+	/* Circumvent users from interacting with the system task. */
+	lf_assert(pid, failure, E_INVALID_TASK, "The priority of the system task cannot be changed.");
+	lf_assert(priority > OS_IDLE_PRIORITY && priority < OS_PRIORITIES, failure, E_INVALID_TASK, "The priority %i is not between %i and %i.", priority, OS_IDLE_PRIORITY + 1, OS_PRIORITIES - 1);
+	/* Find the task for the given PID. */
+	struct _os_task *task = os_task_from_pid(pid);
+	lf_assert(task, failure, E_NO_PID, "No task has the PID %i.", pid);
+	os_schedule_lock();
+	task->base = priority;
+	/* A task holding a mutex keeps the priority it inherited from the mutex's waiters. */
+	uint8_t inherited = os_mutex_inherited(task);
+	os_task_inherit(task, (inherited > priority) ? inherited : priority);
+	os_schedule_unlock();
+	return lf_success;
+failure:
+	return lf_error;
+}
+
+/* Gives the most bytes of its stack that a task has used, found from the paint it has not overwritten. */
+uint32_t os_task_stack_used(struct _os_task *task) {
+	os_stack_t *stack = task->stack;
+	uint32_t words = task->stack_size / sizeof(os_stack_t);
+	uint32_t unused = 0;
+	/* The stack grows down, so its untouched words are at its base. */
+	while (unused < words && stack[unused] == OS_STACK_PAINT) unused ++;
+	return task->stack_size - unused * sizeof(os_stack_t);
+}
+
+/* Gives the most bytes of its stack that the task with the given PID has used. */
+int os_task_stack(int pid) {
+	struct _os_task *task = os_task_from_pid(pid);
+	lf_assert(task, failure, E_NO_PID, "No task has the PID %i.", pid);
+	return os_task_stack_used(task);
+failure:
+	return lf_error;
+}
+
+/* Gives the time in microseconds since the scheduler started. */
+uint64_t os_time_us(void) {
+	os_schedule_lock();
+	uint64_t now = os_now();
+	os_schedule_unlock();
+	return now / os_us_to_cycles(1);
+}
+
+/* Gives whether the current context is a task that can sleep or block. */
+bool os_can_block(void) {
+	/* Interrupts cannot block, and the system task must always be ready to run. */
+	return (os_current_task && os_current_task != schedule.head && !__get_IPSR());
+}
+
+/* Sleeps the current task for at least the given number of microseconds. */
+void os_sleep_us(uint32_t us) {
+	struct _os_task *task = os_current_task;
+	if (!os_can_block()) return;
+	os_schedule_lock();
+	task->wake = os_now() + os_us_to_cycles(us);
+	os_ready_remove(task);
+	task->status = os_task_status_sleeping;
+	os_sleep_insert(task);
+	/* The switch away from the task happens once interrupts are unmasked. */
+	os_schedule();
+	os_schedule_unlock();
+}
+
+/* Blocks the current task in a wait list. Must be called with the schedule locked; the switch away from the task happens once it is unlocked. */
+int os_task_block(struct _os_queue *waiters) {
+	struct _os_task *task = os_current_task;
+	lf_assert(os_can_block(), failure, E_INVALID_TASK, "Only tasks other than the system task can block.");
+	os_ready_remove(task);
+	task->status = os_task_status_blocked;
+	task->waiting = waiters;
+	os_wait_insert(waiters, task);
+	os_schedule();
+	return lf_success;
+failure:
+	return lf_error;
+}
+
+/* Wakes the first task of a wait list, if there is one. Must be called with the schedule locked. */
+struct _os_task *os_task_wake(struct _os_queue *waiters) {
+	struct _os_task *task = waiters->head;
+	if (!task) return NULL;
+	os_queue_remove(waiters, task);
+	task->waiting = NULL;
+	task->status = os_task_status_idle;
+	os_ready_append(task);
+	os_schedule();
+	return task;
+}
+
+/* Changes the priority a task runs at, wherever it is in the schedule. Must be called with the schedule locked. */
+void os_task_inherit(struct _os_task *task, uint8_t priority) {
+	if (task->priority == priority) return;
+	if (task->status == os_task_status_blocked) {
+		/* Keep the task's wait list in order of priority. */
+		os_queue_remove(task->waiting, task);
+		task->priority = priority;
+		os_wait_insert(task->waiting, task);
+	} else if (task->status == os_task_status_paused || task->status == os_task_status_sleeping) {
+		task->priority = priority;
+	} else {
+		os_ready_remove(task);
+		task->priority = priority;
+		os_ready_append(task);
+		os_schedule();
+	}
+}
+
+/* This function is called when a time slice ends or a sleeping task is due to wake, and triggers a context switch. */
 void systick_exception(void) {
+	os_trace(lf_trace_isr_enter, 0);
+	os_schedule_lock();
+	/* Count the period that just ended. */
+	os_cycles += SysTick->LOAD + 1;
+	/* Wake the tasks whose sleep has ended. */
+	uint64_t now = os_now();
+	while (schedule.sleeping.head && schedule.sleeping.head->wake <= now) {
+		struct _os_task *task = schedule.sleeping.head;
+		os_queue_remove(&schedule.sleeping, task);
+		task->status = os_task_status_idle;
+		os_ready_append(task);
+	}
+	os_schedule_unlock();
 	/* Queue the execution of the next task. */
 	os_task_next();
+	os_trace(lf_trace_isr_exit, 0);
 }
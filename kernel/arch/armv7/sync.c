@@ -0,0 +1,231 @@
+/* Osmium synchronization primitives. Tasks wait upon them in wait lists kept by the scheduler. */
+
+#include <flipper.h>
+#include <os/scheduler.h>
+#include <os/sync.h>
+
+extern struct _os_task *os_current_task;
+
+/* ~ Mutexes. ~ */
+
+void os_mutex_init(struct _os_mutex *mutex) {
+	memset(mutex, 0, sizeof(struct _os_mutex));
+}
+
+/* Gives a free mutex to a task. Must be called with the schedule locked. */
+static void os_mutex_take(struct _os_mutex *mutex, struct _os_task *task) {
+	mutex->owner = task;
+	mutex->depth = 1;
+	mutex->next = task->held;
+	task->held = mutex;
+}
+
+/* Gives the highest priority of the tasks waiting for the mutexes held by a task, or the idle priority if none are waiting. */
+uint8_t os_mutex_inherited(struct _os_task *task) {
+	uint8_t priority = OS_IDLE_PRIORITY;
+	for (struct _os_mutex *mutex = task->held; mutex; mutex = mutex->next) {
+		/* The waiters are in order of priority, so the first is the most urgent. */
+		if (mutex->waiters.head && mutex->waiters.head->priority > priority) priority = mutex->waiters.head->priority;
+	}
+	return priority;
+}
+
+int os_mutex_lock(struct _os_mutex *mutex) {
+	struct _os_task *task = os_current_task;
+	/* Before the scheduler starts there is nothing to exclude. */
+	if (!task) return lf_success;
+	os_schedule_lock();
+	if (mutex->owner == task) {
+		mutex->depth ++;
+		goto done;
+	}
+	/* The mutex is handed directly to its first waiter when it is unlocked. */
+	while (mutex->owner && mutex->owner != task) {
+		/* The owner runs at the priority of its most urgent waiter until it unlocks the mutex. */
+		if (mutex->owner->priority < task->priority) os_task_inherit(mutex->owner, task->priority);
+		if (os_task_block(&mutex->waiters) != lf_success) goto failure;
+		os_schedule_relock();
+	}
+	if (!mutex->owner) os_mutex_take(mutex, task);
+done:
+	os_schedule_unlock();
+	return lf_success;
+failure:
+	os_schedule_unlock();
+	return lf_error;
+}
+
+int os_mutex_trylock(struct _os_mutex *mutex) {
+	struct _os_task *task = os_current_task;
+	if (!task) return lf_success;
+	os_schedule_lock();
+	if (mutex->owner == task) mutex->depth ++;
+	else if (!mutex->owner) os_mutex_take(mutex, task);
+	else goto failure;
+	os_schedule_unlock();
+	return lf_success;
+failure:
+	os_schedule_unlock();
+	return lf_error;
+}
+
+int os_mutex_unlock(struct _os_mutex *mutex) {
+	struct _os_task *task = os_current_task;
+	if (!task) return lf_success;
+	os_schedule_lock();
+	lf_assert(mutex->owner == task, failure, E_INVALID_TASK, "Tried to unlock a mutex held by another task.");
+	if (-- mutex->depth) goto done;
+	/* Take the mutex off the mutexes held by the task. */
+	struct _os_mutex **held = &task->held;
+	while (*held != mutex) held = &(*held)->next;
+	*held = mutex->next;
+	/* Hand the mutex to its most urgent waiter, whose priority is already no lower than the waiters behind it. */
+	mutex->owner = NULL;
+	struct _os_task *next = os_task_wake(&mutex->waiters);
+	if (next) os_mutex_take(mutex, next);
+	/* Give up any priority that was inherited through the mutex. */
+	uint8_t inherited = os_mutex_inherited(task);
+	os_task_inherit(task, (inherited > task->base) ? inherited : task->base);
+done:
+	os_schedule_unlock();
+	return lf_success;
+failure:
+	os_schedule_unlock();
+	return lf_error;
+}
+
+/* Releases the mutexes held by a task that is being released, handing each to its most urgent waiter, so that none is left to a freed owner. */
+void os_mutex_release(struct _os_task *task) {
+	os_schedule_lock();
+	while (task->held) {
+		struct _os_mutex *mutex = task->held;
+		task->held = mutex->next;
+		mutex->owner = NULL;
+		mutex->depth = 0;
+		struct _os_task *next = os_task_wake(&mutex->waiters);
+		if (next) os_mutex_take(mutex, next);
+	}
+	os_schedule_unlock();
+}
+
+/* ~ Semaphores. ~ */
+
+void os_semaphore_init(struct _os_semaphore *semaphore, uint32_t count) {
+	memset(semaphore, 0, sizeof(struct _os_semaphore));
+	semaphore->count = count;
+}
+
+int os_semaphore_wait(struct _os_semaphore *semaphore) {
+	os_schedule_lock();
+	while (!semaphore->count) {
+		if (os_task_block(&semaphore->waiters) != lf_success) goto failure;
+		os_schedule_relock();
+	}
+	semaphore->count --;
+	os_schedule_unlock();
+	return lf_success;
+failure:
+	os_schedule_unlock();
+	return lf_error;
+}
+
+int os_semaphore_trywait(struct _os_semaphore *semaphore) {
+	os_schedule_lock();
+	if (!semaphore->count) goto failure;
+	semaphore->count --;
+	os_schedule_unlock();
+	return lf_success;
+failure:
+	os_schedule_unlock();
+	return lf_error;
+}
+
+/* Gives back a unit, waking the most urgent waiter. This can be called from an interrupt. */
+void os_semaphore_post(struct _os_semaphore *semaphore) {
+	os_schedule_lock();
+	semaphore->count ++;
+	os_task_wake(&semaphore->waiters);
+	os_schedule_unlock();
+}
+
+/* ~ Event groups. ~ */
+
+void os_event_init(struct _os_event *event) {
+	memset(event, 0, sizeof(struct _os_event));
+}
+
+/* Waits until any of the given flags are set, or all of them if OS_EVENT_ALL is given, and gives the flags that were set. */
+uint32_t os_event_wait(struct _os_event *event, uint32_t flags, uint8_t options) {
+	uint32_t set;
+	os_schedule_lock();
+	while (1) {
+		set = event->flags & flags;
+		if ((options & OS_EVENT_ALL) ? (set == flags) : (set != 0)) break;
+		if (os_task_block(&event->waiters) != lf_success) goto failure;
+		os_schedule_relock();
+	}
+	if (options & OS_EVENT_CLEAR) event->flags &= ~set;
+	os_schedule_unlock();
+	return set;
+failure:
+	os_schedule_unlock();
+	return 0;
+}
+
+/* Sets flags, waking every waiter to check whether the flags it waits for are set. This can be called from an interrupt. */
+void os_event_set(struct _os_event *event, uint32_t flags) {
+	os_schedule_lock();
+	event->flags |= flags;
+	while (os_task_wake(&event->waiters));
+	os_schedule_unlock();
+}
+
+void os_event_clear(struct _os_event *event, uint32_t flags) {
+	os_schedule_lock();
+	event->flags &= ~flags;
+	os_schedule_unlock();
+}
+
+/* ~ Message queues. ~ */
+
+void os_mq_init(struct _os_mq *mq, void *buffer, uint16_t size, uint16_t capacity) {
+	memset(mq, 0, sizeof(struct _os_mq));
+	mq->buffer = buffer;
+	mq->size = size;
+	mq->capacity = capacity;
+}
+
+/* Copies a message into the queue. If the queue is full, waits for room unless told not to block, which interrupts must not. */
+int os_mq_send(struct _os_mq *mq, const void *message, bool block) {
+	os_schedule_lock();
+	while (mq->count == mq->capacity) {
+		if (!block || os_task_block(&mq->senders) != lf_success) goto failure;
+		os_schedule_relock();
+	}
+	memcpy(mq->buffer + ((mq->head + mq->count) % mq->capacity) * mq->size, message, mq->size);
+	mq->count ++;
+	os_task_wake(&mq->receivers);
+	os_schedule_unlock();
+	return lf_success;
+failure:
+	os_schedule_unlock();
+	return lf_error;
+}
+
+/* Copies the first message out of the queue. If the queue is empty, waits for a message unless told not to block. */
+int os_mq_receive(struct _os_mq *mq, void *message, bool block) {
+	os_schedule_lock();
+	while (!mq->count) {
+		if (!block || os_task_block(&mq->receivers) != lf_success) goto failure;
+		os_schedule_relock();
+	}
+	memcpy(message, mq->buffer + mq->head * mq->size, mq->size);
+	mq->head = (mq->head + 1) % mq->capacity;
+	mq->count --;
+	os_task_wake(&mq->senders);
+	os_schedule_unlock();
+	return lf_success;
+failure:
+	os_schedule_unlock();
+	return lf_error;
+}
@@ -4,14 +4,21 @@
 #include <flipper/gpio.h>
 
 extern int errno;
-extern int _end;
+/* The bounds of the heap, given by the linker script. */
+extern unsigned char __heap_start__;
+extern unsigned char __heap_end__;
 
 extern caddr_t _sbrk(int increment) {
 	static unsigned char *heap = NULL ;
 	unsigned char *previous;
 
 	if (heap == NULL) {
-		heap = (unsigned char *)&_end;
+		heap = &__heap_start__;
+	}
+
+	/* Refuse to grow the heap into the main stack. */
+	if (increment > &__heap_end__ - heap) {
+		return (caddr_t)(-1);
 	}
 
 	previous = heap;
@@ -0,0 +1,188 @@
+/* Osmium timer wheel. A hierarchical wheel, turned by a single tick, on which timers start and stop in constant time. */
+
+#include <flipper.h>
+#include <os/timer.h>
+#include <os/scheduler.h>
+#include <os/sync.h>
+
+#define OS_TIMER_SLOT_MASK (OS_TIMER_SLOTS - 1)
+/* The furthest ahead of the wheel a timer is placed. Timers due later are placed this far ahead, and placed again once it is reached. */
+#define OS_TIMER_SPAN ((1UL << (OS_TIMER_SLOT_BITS * OS_TIMER_LEVELS)) - 1)
+/* Gives the slot of a level that holds the timers expiring at the given tick. */
+#define os_timer_slot(level, tick) (((tick) >> (OS_TIMER_SLOT_BITS * (level))) & OS_TIMER_SLOT_MASK)
+
+static struct {
+	/* The tick the wheel has turned to. */
+	uint32_t now;
+	/* The timers within each slot of each level of the wheel. */
+	struct _os_timer *slots[OS_TIMER_LEVELS][OS_TIMER_SLOTS];
+	/* The number of timers on the wheel. The tick only runs while there are any. */
+	uint32_t armed;
+	/* The expired timers whose callbacks have yet to be called, in the order in which they expired. */
+	struct _os_timer *expired_head;
+	struct _os_timer *expired_tail;
+	/* Counts the expired timers for the timer task. */
+	struct _os_semaphore expired;
+} os_timers;
+
+/* Places a timer on the wheel, in the lowest level whose turn spans the time left until it expires. */
+static void os_timer_place(struct _os_timer *timer) {
+	uint32_t left = timer->expires - os_timers.now;
+	uint32_t at = timer->expires;
+	if (left > OS_TIMER_SPAN) {
+		left = OS_TIMER_SPAN;
+		at = os_timers.now + OS_TIMER_SPAN;
+	}
+	int level = 0;
+	while (level < OS_TIMER_LEVELS - 1 && left >= (1UL << (OS_TIMER_SLOT_BITS * (level + 1)))) level ++;
+	struct _os_timer **slot = &os_timers.slots[level][os_timer_slot(level, at)];
+	timer->next = *slot;
+	if (timer->next) timer->next->link = &timer->next;
+	timer->link = slot;
+	*slot = timer;
+}
+
+/* Takes a timer off the wheel. */
+static void os_timer_unplace(struct _os_timer *timer) {
+	*timer->link = timer->next;
+	if (timer->next) timer->next->link = timer->link;
+	timer->next = NULL;
+	timer->link = NULL;
+}
+
+/* Queues the callback of an expired timer for the timer task. */
+static void os_timer_expire(struct _os_timer *timer) {
+	if (timer->expired) {
+		timer->overruns ++;
+		return;
+	}
+	timer->expired = true;
+	timer->next_expired = NULL;
+	timer->prev_expired = os_timers.expired_tail;
+	if (os_timers.expired_tail) os_timers.expired_tail->next_expired = timer;
+	else os_timers.expired_head = timer;
+	os_timers.expired_tail = timer;
+	os_semaphore_post(&os_timers.expired);
+}
+
+/* Removes a timer from the expired timers. */
+static void os_timer_unexpire(struct _os_timer *timer) {
+	if (timer->prev_expired) timer->prev_expired->next_expired = timer->next_expired;
+	else os_timers.expired_head = timer->next_expired;
+	if (timer->next_expired) timer->next_expired->prev_expired = timer->prev_expired;
+	else os_timers.expired_tail = timer->prev_expired;
+	timer->next_expired = timer->prev_expired = NULL;
+	timer->expired = false;
+}
+
+/* Takes a timer off the wheel and out of the expired timers. Must be called with the schedule locked. */
+static void os_timer_disarm(struct _os_timer *timer) {
+	if (timer->armed) {
+		os_timer_unplace(timer);
+		timer->armed = false;
+		if (!-- os_timers.armed) os_timer_clock(false);
+	}
+	if (timer->expired) os_timer_unexpire(timer);
+}
+
+/* Calls the callbacks of expired timers, so that they run with interrupts and preemption enabled. */
+static void os_timer_task(void) {
+	while (1) {
+		os_semaphore_wait(&os_timers.expired);
+		os_schedule_lock();
+		/* A timer stopped after it expired leaves a unit of the semaphore behind, for which there is no callback. */
+		struct _os_timer *timer = os_timers.expired_head;
+		void (* callback)(void *ctx) = NULL;
+		void *ctx = NULL;
+		if (timer) {
+			os_timer_unexpire(timer);
+			callback = timer->callback;
+			ctx = timer->ctx;
+		}
+		os_schedule_unlock();
+		if (callback) callback(ctx);
+	}
+}
+
+void os_timer_init(void) {
+	memset(&os_timers, 0, sizeof(os_timers));
+	os_semaphore_init(&os_timers.expired, 0);
+	struct _os_task *task = os_task_create(os_timer_task, NULL, NULL, OS_TIMER_TASK_STACK_SIZE_WORDS * sizeof(uint32_t));
+	lf_assert(task, failure, E_NULL, "Failed to create the timer task.");
+	task->priority = task->base = OS_TIMER_TASK_PRIORITY;
+	os_task_add(task);
+failure:
+	return;
+}
+
+void os_timer_create(struct _os_timer *timer, void (* callback)(void *ctx), void *ctx) {
+	memset(timer, 0, sizeof(struct _os_timer));
+	timer->callback = callback;
+	timer->ctx = ctx;
+}
+
+/* Starts a timer that expires after a delay, and then every period if the period is not zero. A timer that is running is restarted. */
+int os_timer_start(struct _os_timer *timer, uint32_t delay_us, uint32_t period_us) {
+	lf_assert(timer && timer->callback, failure, E_NULL, "No callback was given for the timer.");
+	/* Times are rounded up to whole ticks, so that the shortest timer expires on the next tick. */
+	uint32_t delay = lf_ceiling((uint64_t)delay_us, OS_TIMER_TICK_US);
+	if (!delay) delay = 1;
+	os_schedule_lock();
+	os_timer_disarm(timer);
+	timer->period = lf_ceiling((uint64_t)period_us, OS_TIMER_TICK_US);
+	timer->expires = os_timers.now + delay;
+	timer->overruns = 0;
+	os_timer_place(timer);
+	timer->armed = true;
+	if (!os_timers.armed ++) os_timer_clock(true);
+	os_schedule_unlock();
+	return lf_success;
+failure:
+	return lf_error;
+}
+
+/* Stops a timer. Its callback is not called again, even if it expired before it was stopped. */
+void os_timer_stop(struct _os_timer *timer) {
+	os_schedule_lock();
+	os_timer_disarm(timer);
+	os_schedule_unlock();
+}
+
+void os_timer_tick(void) {
+	os_schedule_lock();
+	uint32_t now = ++ os_timers.now;
+	/* Each level whose slot has come around is emptied onto the levels below it, highest first. */
+	for (int level = OS_TIMER_LEVELS - 1; level > 0; level --) {
+		if (now & ((1UL << (OS_TIMER_SLOT_BITS * level)) - 1)) continue;
+		struct _os_timer *timer = os_timers.slots[level][os_timer_slot(level, now)];
+		os_timers.slots[level][os_timer_slot(level, now)] = NULL;
+		while (timer) {
+			struct _os_timer *next = timer->next;
+			os_timer_place(timer);
+			timer = next;
+		}
+	}
+	/* The timers of the current slot of the lowest level expire. */
+	struct _os_timer *timer = os_timers.slots[0][os_timer_slot(0, now)];
+	os_timers.slots[0][os_timer_slot(0, now)] = NULL;
+	while (timer) {
+		struct _os_timer *next = timer->next;
+		if (timer->expires != now) {
+			/* Timers are only held by a slot of the lowest level for the tick at which they expire, so this is not reached. */
+			os_timer_place(timer);
+		} else if (timer->period) {
+			timer->expires += timer->period;
+			os_timer_place(timer);
+			os_timer_expire(timer);
+		} else {
+			timer->next = NULL;
+			timer->link = NULL;
+			timer->armed = false;
+			os_timers.armed --;
+			os_timer_expire(timer);
+		}
+		timer = next;
+	}
+	if (!os_timers.armed) os_timer_clock(false);
+	os_schedule_unlock();
+}
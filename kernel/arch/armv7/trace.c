@@ -0,0 +1,77 @@
+/* Osmium trace. A ring of events timed by the DWT's cycle counter, into which any task or interrupt records without masking interrupts. */
+
+#include <flipper.h>
+#include <os/trace.h>
+#include <os/scheduler.h>
+
+extern struct _os_task *os_current_task;
+
+volatile uint32_t os_trace_mask;
+
+static struct _trace_event os_trace_ring[OS_TRACE_EVENTS];
+/* The sequence of the next event to be recorded. It starts a lap ahead, so that no slot of the empty ring appears to hold it. */
+static volatile uint32_t os_trace_head = OS_TRACE_EVENTS;
+/* The sequence of the next event to be read. */
+static uint32_t os_trace_tail = OS_TRACE_EVENTS;
+
+void os_trace_record(uint8_t kind, uint32_t arg) {
+	uint32_t cycles = DWT->CYCCNT;
+	/* Claim the next slot of the ring. An interrupt that claims a slot in between fails the store, and the claim is retried. */
+	uint32_t sequence;
+	do sequence = __LDREXW(&os_trace_head); while (__STREXW(sequence + 1, &os_trace_head));
+	struct _trace_event *event = &os_trace_ring[sequence & (OS_TRACE_EVENTS - 1)];
+	/* Until the event is complete, the slot holds a sequence that neither it nor the event it replaces has, so it is not read. */
+	event->sequence = sequence - 1;
+	__DMB();
+	event->cycles = cycles;
+	event->arg = arg;
+	event->task = (os_current_task) ? os_current_task->pid : UINT16_MAX;
+	event->kind = kind;
+	event->exception = __get_IPSR();
+	__DMB();
+	event->sequence = sequence;
+}
+
+int os_trace_enable(uint32_t mask) {
+	/* Start the cycle counter. */
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+	/* Events left over from an earlier trace are discarded when a new one starts, and kept when a trace stops so that they can still be read. */
+	if (!os_trace_mask) os_trace_tail = os_trace_head;
+	os_trace_mask = mask;
+	return lf_success;
+}
+
+int os_trace_read(void *destination, lf_size_t length) {
+	struct _trace_event *events = destination;
+	lf_size_t max = length / sizeof(struct _trace_event);
+	lf_size_t count = 0;
+	uint32_t tail = os_trace_tail;
+	while (count < max) {
+		uint32_t head = os_trace_head;
+		/* Skip the events that have been overwritten. The gap in their sequence tells the host that they were lost. */
+		if (head - tail > OS_TRACE_EVENTS) tail = head - OS_TRACE_EVENTS;
+		if (tail == head) break;
+		struct _trace_event *event = &os_trace_ring[tail & (OS_TRACE_EVENTS - 1)];
+		uint32_t sequence = event->sequence;
+		__DMB();
+		events[count] = *event;
+		__DMB();
+		/* The event is only taken if it was neither being recorded nor overwritten while it was copied. */
+		if (sequence == tail && event->sequence == tail) {
+			count ++;
+			tail ++;
+		} else if (os_trace_head - tail <= OS_TRACE_EVENTS) {
+			/* The event is still being recorded, so it is read next time. */
+			break;
+		}
+	}
+	os_trace_tail = tail;
+	/* The slots of the buffer left over hold no event. */
+	memset(&events[count], 0, length - count * sizeof(struct _trace_event));
+	return count;
+}
+
+uint32_t os_trace_frequency(void) {
+	return F_CPU;
+}
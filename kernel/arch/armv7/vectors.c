@@ -103,6 +103,13 @@ void reset_exception(void) {
 	// 	SCB->VTOR |= 1 << SCB_VTOR_TBLBASE_Pos ;
 	// }
 
+#ifdef __ARM_FP
+	/* Grant full access to the FPU (CP10 and CP11). Lazy stacking of its state is enabled by FPCCR at reset. */
+	SCB->CPACR |= (0xF << 20);
+	__DSB();
+	__ISB();
+#endif
+
 	/* Initialize the C library */
 	//__libc_init_array() ;
 
@@ -0,0 +1,125 @@
+/* coop.h - Primitive type definitions for Osmium's stackless tasks. */
+
+#ifndef __os_coop_h__
+#define __os_coop_h__
+
+#include <flipper.h>
+#include <os/timer.h>
+
+/*
+ * A stackless task is a handler that returns whenever it waits, and is resumed where it left off the next time it runs.
+ * Every stackless task runs on the stack of a single kernel task, so each costs only its own structure. Because the
+ * stack is shared, the locals of a handler are lost whenever it waits; state kept across a wait belongs in the context.
+ *
+ *	int blink(struct _os_coop *coop) {
+ *		os_coop_begin(coop);
+ *		while (1) {
+ *			led_toggle();
+ *			os_coop_await_timer(coop, 500000);
+ *		}
+ *		os_coop_end(coop);
+ *	}
+ *
+ * A handler waits at most once per line, since the line is where it resumes.
+ */
+
+/* The priority of the task that runs the stackless tasks, above that of the task performing packets so that packets wait for a handler that is running.
+   A handler that blocks lets lower priority tasks run, so an app whose handler is running is refused release until the handler returns. */
+#define OS_COOP_TASK_PRIORITY 26
+#define OS_COOP_TASK_STACK_SIZE_WORDS 512
+
+/* What a handler returns, telling the kernel why it stopped running. */
+enum {
+	/* The handler ended, or was never begun. */
+	os_coop_ended,
+	/* The handler gave way to the other stackless tasks that are ready. */
+	os_coop_yielded,
+	/* The handler waits for flags of an event to be set. */
+	os_coop_waiting,
+	/* The handler waits for a delay to pass. */
+	os_coop_sleeping
+};
+
+/* The states of a stackless task. */
+typedef enum {
+	os_coop_status_ended,
+	os_coop_status_ready,
+	os_coop_status_running,
+	os_coop_status_waiting,
+	os_coop_status_sleeping
+} os_coop_status;
+
+struct _os_task;
+struct _os_coop_event;
+
+/* A stackless task. Its storage belongs to the caller, so any number of stackless tasks can exist at once. */
+struct _os_coop {
+	/* The handler of the task, and its context. */
+	int (* handler)(struct _os_coop *coop);
+	void *ctx;
+	/* The line of the handler at which it resumes, or zero if it starts from the beginning. */
+	uint16_t line;
+	volatile os_coop_status status;
+	/* The task that spawned the stackless task. A stackless task ends once the task that spawned it is released. */
+	struct _os_task *owner;
+	/* The neighbouring stackless tasks within the ready tasks, or within the waiters of an event. */
+	struct _os_coop *next;
+	struct _os_coop *prev;
+	/* The neighbouring stackless tasks among those that have not ended. */
+	struct _os_coop *next_spawned;
+	struct _os_coop *prev_spawned;
+	/* The event waited for, the flags of it that are waited for, and the flags that were set once the wait ended. */
+	struct _os_coop_event *event;
+	uint32_t mask;
+	uint32_t flags;
+	/* The delay waited for in microseconds, and the timer that ends the wait. */
+	uint32_t delay;
+	struct _os_timer timer;
+};
+
+/* A set of flags, set by tasks, stackless tasks, or interrupts, that stackless tasks can wait upon. */
+struct _os_coop_event {
+	/* The flags that are set. */
+	volatile uint32_t flags;
+	/* The stackless tasks waiting for flags to be set, in the order in which they began to wait. */
+	struct _os_coop *head;
+	struct _os_coop *tail;
+};
+
+/* Begins and ends the body of a handler. The body is resumed at the line at which it last waited. */
+#define os_coop_begin(coop) switch ((coop)->line) { case 0:
+#define os_coop_end(coop) } (coop)->line = 0; return os_coop_ended
+/* Returns from the handler, which resumes after this line once the reason it stopped has passed. */
+#define os_coop_suspend(coop, reason) do { (coop)->line = __LINE__; return (reason); case __LINE__:; } while (0)
+/* Lets the other stackless tasks that are ready run first. */
+#define os_coop_yield(coop) os_coop_suspend(coop, os_coop_yielded)
+/* Waits until any of the flags of the event are set. The flags that were set are left in coop->flags. */
+#define os_coop_await_event(coop, _event, _flags) do { (coop)->event = (_event); (coop)->mask = (_flags); os_coop_suspend(coop, os_coop_waiting); } while (0)
+/* Waits for at least the given number of microseconds. */
+#define os_coop_await_timer(coop, us) do { (coop)->delay = (us); os_coop_suspend(coop, os_coop_sleeping); } while (0)
+
+/* The interface through which apps, which are not linked against the kernel, use stackless tasks. An app's entry point is given its address. */
+extern const struct _os_coop_interface {
+	/* Starts a stackless task, which runs its handler from the beginning. The task must have ended; one never spawned must be zeroed, as static storage is. */
+	int (* spawn)(struct _os_coop *coop, int (* handler)(struct _os_coop *coop), void *ctx);
+	/* Ends a stackless task wherever it is waiting. */
+	void (* kill)(struct _os_coop *coop);
+	/* Initializes an event with none of its flags set. */
+	void (* event_init)(struct _os_coop_event *event);
+	/* Sets or clears flags of an event. Flags can be set from an interrupt. */
+	void (* event_set)(struct _os_coop_event *event, uint32_t flags);
+	void (* event_clear)(struct _os_coop_event *event, uint32_t flags);
+	/* Blocks the calling task until the stackless tasks it spawned have ended. */
+	int (* join)(void);
+} os_coop;
+
+void os_coop_init(void);
+int os_coop_spawn(struct _os_coop *coop, int (* handler)(struct _os_coop *coop), void *ctx);
+void os_coop_kill(struct _os_coop *coop);
+int os_coop_release(struct _os_task *owner);
+int os_coop_join(void);
+void os_coop_event_init(struct _os_coop_event *event);
+void os_coop_event_set(struct _os_coop_event *event, uint32_t flags);
+void os_coop_event_clear(struct _os_coop_event *event, uint32_t flags);
+
+#endif
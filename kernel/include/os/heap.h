@@ -0,0 +1,31 @@
+/* heap.h - Primitive type definitions for the Osmium heap. */
+
+#ifndef __os_heap_h__
+#define __os_heap_h__
+
+#include <flipper.h>
+
+/* Allocations are aligned to, and rounded up to a multiple of, the size of a block's header. */
+#define OS_HEAP_ALIGN (2 * sizeof(void *))
+#define OS_HEAP_ALIGN_SHIFT ((sizeof(void *) == 8) ? 4 : 3)
+/* Each power of two is divided into this many size classes. */
+#define OS_HEAP_SL_BITS 4
+#define OS_HEAP_SL_COUNT (1 << OS_HEAP_SL_BITS)
+/* Sizes below 2^OS_HEAP_FL_SHIFT share the first class of powers of two, divided linearly. */
+#define OS_HEAP_FL_SHIFT (OS_HEAP_SL_BITS + OS_HEAP_ALIGN_SHIFT)
+/* Blocks are smaller than 2^OS_HEAP_FL_MAX bytes. */
+#define OS_HEAP_FL_MAX 24
+#define OS_HEAP_FL_COUNT (OS_HEAP_FL_MAX - OS_HEAP_FL_SHIFT + 1)
+
+/* The sizes of the pools of small blocks. */
+#define OS_HEAP_POOL_SIZES { 2 * OS_HEAP_ALIGN, 4 * OS_HEAP_ALIGN, 8 * OS_HEAP_ALIGN }
+#define OS_HEAP_POOLS 3
+/* The pools share a region at the start of the heap, of this fraction of the heap. Small blocks come from the heap once it is used up. */
+#define OS_HEAP_POOL_SHARE 8
+
+int os_heap_init(void *base, size_t size);
+void *os_heap_alloc(size_t size);
+void *os_heap_realloc(void *pointer, size_t size);
+void os_heap_free(void *pointer);
+
+#endif
@@ -7,6 +7,8 @@
 
 /* The default stack size for applications. */
 #define APPLICATION_STACK_SIZE_WORDS 256
+/* The largest stack an application can ask for. */
+#define APPLICATION_MAX_STACK_SIZE_WORDS 4096
 
 #define MAX_USER_MODULES 4
 
@@ -23,6 +25,8 @@ struct _lf_abi_header {
 	uint32_t bss_offset;
 	uint32_t got_size;
 	uint32_t got_offset;
+	/* The stack size the application asks for in bytes, or zero for the default. Images built before the field was added end their header before it. */
+	uint32_t stack_size;
 };
 
 /* A data structure used to describe the parameters of a loaded module. */
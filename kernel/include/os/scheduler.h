@@ -10,11 +10,46 @@ typedef enum {
 	os_task_status_unallocated,
 	os_task_status_idle,
 	os_task_status_active,
-	os_task_status_paused
+	os_task_status_paused,
+	os_task_status_sleeping,
+	os_task_status_blocked,
+	os_task_status_dead
 } os_task_status;
 
 typedef uint32_t os_stack_t;
 
+/* The number of task priorities. Each has a ready queue, and a bit in the ready bitmap. */
+#define OS_PRIORITIES 32
+/* The priority given to new tasks. Higher priorities run first, and tasks of equal priority share the CPU in turn. */
+#define OS_DEFAULT_PRIORITY 16
+/* The priority of the system task, which sleeps the CPU whenever no other task is ready to run. */
+#define OS_IDLE_PRIORITY 0
+/* The time slice in microseconds given to each of the tasks that share the highest ready priority. */
+#define OS_SLICE_US 1000
+/* The longest the SysTick can be programmed to wait, in clock cycles. */
+#define OS_MAX_TICK SysTick_LOAD_RELOAD_Msk
+/* The most tasks that can exist at once. Each occupies a slot of the PID table. */
+#define OS_MAX_TASKS 32
+/* A PID is the task's slot in the PID table, above which a generation count distinguishes the tasks that have used the slot. */
+#define OS_PID_SLOT_BITS 5
+#define os_pid_slot(pid) ((pid) & (OS_MAX_TASKS - 1))
+/* The pattern painted over a new task's stack. The words still holding it at the bottom of the stack have never been used. */
+#define OS_STACK_PAINT 0xCCCCCCCC
+
+/* Masks interrupts while the schedule is modified, restoring the previous mask afterwards. */
+#define os_schedule_lock() uint32_t _primask = __get_PRIMASK(); __disable_irq()
+#define os_schedule_unlock() __set_PRIMASK(_primask)
+/* Unmasks interrupts for long enough to let a pending context switch happen, then masks them again. */
+#define os_schedule_relock() __set_PRIMASK(_primask); __disable_irq()
+
+struct _os_mutex;
+
+/* A list of tasks, such as the tasks of a priority that are ready to run, in the order in which they will run. */
+struct _os_queue {
+	struct _os_task *head;
+	struct _os_task *tail;
+};
+
 struct _os_task {
 	/* The task's stack pointer. Points to the last item pushed onto the task's stack. */
 	volatile uint32_t sp;
@@ -26,23 +61,48 @@ struct _os_task {
 	volatile os_task_status status;
 	/* The base address of the task's stack, stored for task deallocation. */
 	void *stack;
+	/* The size of the task's stack in bytes. */
+	uint32_t stack_size;
 	/* The task's exit function. */
 	void (* exit)(void *_ctx);
 	/* The task's exit context. */
 	void *_ctx;
-	/* The next task to be executed. */
+	/* The priority of the task, raised above its base priority while it holds a mutex wanted by a task of higher priority. */
+	uint8_t priority;
+	/* The priority given to the task. */
+	uint8_t base;
+	/* The wait list of the task, if it is blocked. */
+	struct _os_queue *waiting;
+	/* The mutexes held by the task. */
+	struct _os_mutex *held;
+	/* The clock cycle at which the task wakes, if it is sleeping. */
+	uint64_t wake;
+	/* The neighbouring tasks within the task's ready queue, or within the sleeping tasks if it is sleeping. */
 	struct _os_task *next;
+	struct _os_task *prev;
 };
 
 struct _os_schedule {
-	/* PID counter. */
-	int next_pid;
+	/* The generation of PIDs that will be given to new tasks. */
+	int generation;
 	/* The system task's pointer. */
 	struct _os_task *head;
-	/* The active task PID. */
-	volatile uint8_t active;
+	/* The tasks, indexed by the slot of their PID. */
+	struct _os_task *tasks[OS_MAX_TASKS];
+	/* The bitmap of the free slots of the PID table. */
+	uint32_t free;
+	/* The ready queue of each priority. */
+	struct _os_queue ready[OS_PRIORITIES];
+	/* The bitmap of the priorities whose ready queue has a task. */
+	volatile uint32_t ready_map;
+	/* The sleeping tasks, in the order in which they wake. */
+	struct _os_queue sleeping;
+	/* The tasks that released themselves, linked through their next task, whose memory has yet to be freed. */
+	struct _os_task *dead;
 	/* The number of active tasks. */
 	uint8_t count;
+	/* The number of context switches performed. */
+	uint32_t switches;
 };
 
 /* The PID of the system task. */
@@ -72,6 +132,10 @@ struct _task_ctx {
 	uint32_t r9;
 	uint32_t r10;
 	uint32_t r11;
+#ifdef __ARM_FP
+	/* The EXC_RETURN of the task, which records whether the task's frame holds the state of the FPU. */
+	uint32_t exc_return;
+#endif
 };
 
 void os_kernel_task(void);
@@ -80,6 +144,17 @@ void os_scheduler_init(void);
 struct _os_task *os_task_create(void *_entry, void (* _exit)(void *_ctx), void *_ctx, uint32_t stack_size);
 int os_task_add(struct _os_task *task);
 int os_task_release(struct _os_task *task);
+void os_task_reap(void);
 void os_task_next(void);
+struct _os_task *os_task_from_pid(int pid);
+int os_task_priority(int pid, int priority);
+uint32_t os_task_stack_used(struct _os_task *task);
+int os_task_stack(int pid);
+uint64_t os_time_us(void);
+void os_sleep_us(uint32_t us);
+bool os_can_block(void);
+int os_task_block(struct _os_queue *waiters);
+struct _os_task *os_task_wake(struct _os_queue *waiters);
+void os_task_inherit(struct _os_task *task, uint8_t priority);
 
 #endif
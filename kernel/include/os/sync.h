@@ -0,0 +1,79 @@
+/* sync.h - Primitive type definitions for the Osmium synchronization primitives. */
+
+#ifndef __sync_h__
+#define __sync_h__
+
+#include <flipper.h>
+#include <os/scheduler.h>
+
+/* A lock held by one task at a time. The task holding it runs at no lower a priority than the tasks waiting for it. */
+struct _os_mutex {
+	/* The task holding the mutex, if any. */
+	struct _os_task *owner;
+	/* The number of times the owner has locked the mutex. */
+	uint16_t depth;
+	/* The next mutex held by the owner. */
+	struct _os_mutex *next;
+	/* The tasks waiting for the mutex, in order of priority. */
+	struct _os_queue waiters;
+};
+
+/* A count of available units, taken by tasks and given back by tasks or interrupts. */
+struct _os_semaphore {
+	/* The number of units available. */
+	volatile uint32_t count;
+	/* The tasks waiting for a unit, in order of priority. */
+	struct _os_queue waiters;
+};
+
+/* A set of flags, set by tasks or interrupts, that tasks can wait upon. */
+struct _os_event {
+	/* The flags that are set. */
+	volatile uint32_t flags;
+	/* The tasks waiting for flags to be set. */
+	struct _os_queue waiters;
+};
+
+/* A ring of fixed-size messages, sent and received by tasks or interrupts. */
+struct _os_mq {
+	/* The storage of the messages, which holds capacity messages of size bytes. */
+	uint8_t *buffer;
+	/* The size of a message. */
+	uint16_t size;
+	/* The number of messages the queue can hold. */
+	uint16_t capacity;
+	/* The index of the first message, and the number of messages in the queue. */
+	uint16_t head;
+	volatile uint16_t count;
+	/* The tasks waiting for room to send a message, and for a message to receive. */
+	struct _os_queue senders;
+	struct _os_queue receivers;
+};
+
+/* Wait for all of the flags, rather than any of them. */
+#define OS_EVENT_ALL (1 << 0)
+/* Clear the flags that were waited for. */
+#define OS_EVENT_CLEAR (1 << 1)
+
+void os_mutex_init(struct _os_mutex *mutex);
+int os_mutex_lock(struct _os_mutex *mutex);
+int os_mutex_trylock(struct _os_mutex *mutex);
+int os_mutex_unlock(struct _os_mutex *mutex);
+uint8_t os_mutex_inherited(struct _os_task *task);
+void os_mutex_release(struct _os_task *task);
+
+void os_semaphore_init(struct _os_semaphore *semaphore, uint32_t count);
+int os_semaphore_wait(struct _os_semaphore *semaphore);
+int os_semaphore_trywait(struct _os_semaphore *semaphore);
+void os_semaphore_post(struct _os_semaphore *semaphore);
+
+void os_event_init(struct _os_event *event);
+uint32_t os_event_wait(struct _os_event *event, uint32_t flags, uint8_t options);
+void os_event_set(struct _os_event *event, uint32_t flags);
+void os_event_clear(struct _os_event *event, uint32_t flags);
+
+void os_mq_init(struct _os_mq *mq, void *buffer, uint16_t size, uint16_t capacity);
+int os_mq_send(struct _os_mq *mq, const void *message, bool block);
+int os_mq_receive(struct _os_mq *mq, void *message, bool block);
+
+#endif
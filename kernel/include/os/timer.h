@@ -0,0 +1,49 @@
+/* timer.h - Primitive type definitions for the Osmium timer wheel. */
+
+#ifndef __os_timer_h__
+#define __os_timer_h__
+
+#include <flipper.h>
+
+/* The period of the tick that turns the wheel, in microseconds. Timers expire on a tick. */
+#define OS_TIMER_TICK_US 1000
+/* The wheel has levels of 2^OS_TIMER_SLOT_BITS slots. Each slot of a level spans a turn of the level below it. */
+#define OS_TIMER_SLOT_BITS 6
+#define OS_TIMER_SLOTS (1 << OS_TIMER_SLOT_BITS)
+#define OS_TIMER_LEVELS 4
+/* The priority of the task that calls the callbacks of expired timers, above that of the task performing packets. */
+#define OS_TIMER_TASK_PRIORITY 28
+#define OS_TIMER_TASK_STACK_SIZE_WORDS 256
+
+/* A timer. Its storage belongs to the caller, so any number of timers can exist at once. */
+struct _os_timer {
+	/* The next timer within the slot of the wheel holding the timer, and the link that points to the timer. */
+	struct _os_timer *next;
+	struct _os_timer **link;
+	/* The neighbouring timers among those whose callbacks are waiting to be called. */
+	struct _os_timer *next_expired;
+	struct _os_timer *prev_expired;
+	/* The tick at which the timer expires. */
+	uint32_t expires;
+	/* The ticks between expiries of a periodic timer, or zero if the timer expires once. */
+	uint32_t period;
+	/* Called by the timer task once the timer expires. */
+	void (* callback)(void *ctx);
+	void *ctx;
+	/* Whether the timer is on the wheel, and whether its callback is waiting to be called. */
+	bool armed;
+	bool expired;
+	/* The number of times the timer expired while its callback was still waiting to be called. */
+	uint32_t overruns;
+};
+
+void os_timer_init(void);
+void os_timer_create(struct _os_timer *timer, void (* callback)(void *ctx), void *ctx);
+int os_timer_start(struct _os_timer *timer, uint32_t delay_us, uint32_t period_us);
+void os_timer_stop(struct _os_timer *timer);
+/* Turns the wheel by a tick. Called by the platform's tick interrupt. */
+void os_timer_tick(void);
+/* Starts or stops the platform's tick. The tick runs only while timers are armed. */
+void os_timer_clock(bool run);
+
+#endif
@@ -0,0 +1,20 @@
+/* trace.h - Primitive type definitions for the Osmium trace. */
+
+#ifndef __os_trace_h__
+#define __os_trace_h__
+
+#include <flipper.h>
+
+/* The number of events the trace holds before the oldest are overwritten. Must be a power of two. */
+#define OS_TRACE_EVENTS 128
+
+/* The kinds of events being recorded. */
+extern volatile uint32_t os_trace_mask;
+
+/* Records an event if its kind is enabled. Costs a load and a branch when it is not. */
+#define os_trace(kind, arg) do { if (os_trace_mask & (1UL << (kind))) os_trace_record((kind), (arg)); } while (0)
+
+/* Records an event. Safe to call from any task or interrupt. */
+void os_trace_record(uint8_t kind, uint32_t arg);
+
+#endif
@@ -58,6 +58,8 @@ mod libflipper {
         pub(crate) fn lf_invoke(module: *const _lf_module, function: _lf_index, ret: u8, args: *const _lf_ll) -> _lf_value;
         pub(crate) fn lf_push(module: *const _lf_module, function: _lf_index, source: *const c_void, length: u32, args: *const _lf_ll) -> _lf_value;
         pub(crate) fn lf_pull(module: *const _lf_module, function: _lf_index, dest: *mut c_void, length: u32, args: *const _lf_ll) -> _lf_value;
+        pub(crate) fn lf_push_segments(module: *const _lf_module, function: _lf_index, source: *const c_void, length: u32, args: *const _lf_ll) -> _lf_value;
+        pub(crate) fn lf_pull_segments(module: *const _lf_module, function: _lf_index, dest: *mut c_void, length: u32, args: *const _lf_ll) -> _lf_value;
     }
 }
 
@@ -287,6 +289,35 @@ pub fn lf_pull<'a, T: LfReturnable>(module: &'a ModuleFFI, index: u8, buffer: &m
     }
 }
 
+/// Pushes a buffer of data to a Flipper device a segment at a time, invoking
+/// the function once for each segment.
+///
+/// Control calls made from other threads are performed between segments, so
+/// this suits functions that consume a stream, such as those of uart0.
+pub fn lf_push_segments<'a, T: LfReturnable>(module: &'a ModuleFFI, index: u8, data: &[u8], args: Args) -> T {
+    unsafe {
+        let mut arglist: *mut _lf_ll = ptr::null_mut();
+        for arg in args.iter() {
+            libflipper::lf_ll_append(&mut arglist, &arg.0 as *const _lf_arg as *const c_void, ptr::null());
+        }
+        let ret = libflipper::lf_push_segments(module.as_ptr(), index, data.as_ptr() as *const c_void, data.len() as u32, arglist);
+        T::from(LfReturn(ret))
+    }
+}
+
+/// Pulls a buffer of data from a Flipper device a segment at a time, like
+/// `lf_push_segments`.
+pub fn lf_pull_segments<'a, T: LfReturnable>(module: &'a ModuleFFI, index: u8, buffer: &mut [u8], args: Args) -> T {
+    unsafe {
+        let mut arglist: *mut _lf_ll = ptr::null_mut();
+        for arg in args.iter() {
+            libflipper::lf_ll_append(&mut arglist, &arg.0 as *const _lf_arg as *const c_void, ptr::null());
+        }
+        let ret = libflipper::lf_pull_segments(module.as_ptr(), index, buffer.as_mut_ptr() as *mut c_void, buffer.len() as u32, arglist);
+        T::from(LfReturn(ret))
+    }
+}
+
 mod test {
     #[allow(unused_imports)]
     use super::*;
@@ -17,8 +17,8 @@ use ::{
 use fmr::{
     Args,
     lf_invoke,
-    lf_push,
-    lf_pull,
+    lf_push_segments,
+    lf_pull_segments,
 };
 
 #[link(name = "flipper")]
@@ -84,7 +84,7 @@ impl Uart0 {
 
 impl Write for Uart0 {
     fn write(&mut self, buf: &[u8]) -> Result<usize> {
-        lf_push::<()>(&self.ffi, 2, buf, Args::new());
+        lf_push_segments::<()>(&self.ffi, 2, buf, Args::new());
         Ok(buf.len())
     }
     fn flush(&mut self) -> Result<()> {
@@ -95,7 +95,7 @@ impl Write for Uart0 {
 impl Read for Uart0 {
     fn read(&mut self, buf: &mut [u8]) -> Result<usize> {
         if buf.len() == 0 { return Ok(0) }
-        lf_pull::<()>(&self.ffi, 3, buf, Args::new());
+        lf_pull_segments::<()>(&self.ffi, 3, buf, Args::new());
         Ok(buf.len())
     }
 }
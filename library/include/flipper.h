@@ -13,6 +13,7 @@
 #include <flipper/dac.h>
 #include <flipper/fld.h>
 #include <flipper/gpio.h>
+#include <flipper/heap.h>
 #include <flipper/i2c.h>
 #include <flipper/is25lp.h>
 #include <flipper/led.h>
@@ -23,6 +24,7 @@
 #include <flipper/task.h>
 #include <flipper/temp.h>
 #include <flipper/timer.h>
+#include <flipper/trace.h>
 #include <flipper/uart0.h>
 #include <flipper/usart.h>
 #include <flipper/usb.h>
@@ -0,0 +1,36 @@
+#ifndef __lf_lanes_h__
+#define __lf_lanes_h__
+
+#include <flipper.h>
+#include <stdio.h>
+
+/* The weight of a client that has not been configured. */
+#define LF_DEFAULT_WEIGHT 1
+
+/* A thread sharing devices with others. Each client is given a share of every device in proportion to its weight. */
+struct _lf_client {
+	char name[32];
+	uint32_t weight;
+	/* The deadline given to each transaction of the client in microseconds, or zero if it has none. */
+	uint32_t deadline;
+	/* Identifies the client to the endpoints it shares, and is never reused once the client's thread exits. */
+	uint64_t id;
+	/* The transactions of the client, and the time they spent queued in microseconds. */
+	uint64_t transactions;
+	uint64_t waited;
+	uint64_t longest;
+	/* The number of transactions that were still queued at their deadline. */
+	uint64_t missed;
+	struct _lf_client *next;
+};
+
+/* Names the calling thread as a client and sets its weight. */
+int lf_client_configure(const char *name, uint32_t weight);
+/* Sets the deadline, in microseconds after they are made, by which the transactions of the calling thread should begin. Zero clears the deadline. */
+void lf_client_deadline(uint32_t deadline);
+/* Gives the client of the calling thread. */
+struct _lf_client *lf_client_current(void);
+/* Writes the queueing delay of every client to the given stream. A client is freed once its thread exits. */
+void lf_client_report(FILE *stream);
+
+#endif
@@ -10,6 +10,8 @@
 
 /* The default port over which FMR can be accessed. */
 #define LF_UDP_PORT 3258
+/* The largest packet sent in a single datagram, leaving room for headers within a typical ethernet MTU. */
+#define LF_UDP_PACKET_SIZE 1400
 
 struct _lf_network_context {
 	int fd;
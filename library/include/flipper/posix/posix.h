@@ -5,6 +5,7 @@
 #include <unistd.h>
 #include <flipper/posix/network.h>
 #include <flipper/posix/usb.h>
+#include <flipper/posix/lanes.h>
 
 /* Define the modules that this platform uses. */
 #define __use_adc__
@@ -15,6 +16,7 @@
 #define __use_fld__
 #define __use_fmr__
 #define __use_gpio__
+#define __use_heap__
 #define __use_i2c__
 #define __use_led__
 #define __use_pwm__
@@ -24,6 +26,7 @@
 #define __use_task__
 #define __use_temp__
 #define __use_timer__
+#define __use_trace__
 #define __use_uart0__
 #define __use_usart__
 #define __use_usb__
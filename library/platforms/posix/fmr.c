@@ -7,6 +7,7 @@ const void *const lf_modules[] = {
 	&dac,
 	&fld,
 	&gpio,
+	&heap,
 	&i2c,
 	&led,
 	&pwm,
@@ -16,13 +17,42 @@ const void *const lf_modules[] = {
 	&task,
 	&temp,
 	&timer,
+	&trace,
 	&uart0,
 	&usart,
 	&usb,
 	&wdt
 };
 
-LF_WEAK lf_return_t fmr_call(lf_return_t (* function)(void), lf_type ret, uint8_t argc, uint16_t argt, void *argv) {
+/* Identify this device to the host. Its capabilities are filled in by the message runtime. */
+const struct _lf_configuration lf_configuration = { "fvm", 0, LF_VERSION, lf_device_32bit | lf_device_little_endian, { 0 } };
+
+/* Describe the standard modules to the host. The order must match the 'lf_modules' array. */
+const struct _fmr_module_descriptor lf_module_descriptors[] = {
+	{ "adc", lf_function_count(adc), 0 },
+	{ "button", lf_function_count(button), 0 },
+	{ "dac", lf_function_count(dac), 0 },
+	{ "fld", lf_function_count(fld), 0 },
+	{ "gpio", lf_function_count(gpio), 0 },
+	{ "heap", lf_function_count(heap), 0 },
+	{ "i2c", lf_function_count(i2c), 0 },
+	{ "led", lf_function_count(led), 0 },
+	{ "pwm", lf_function_count(pwm), 0 },
+	{ "rtc", lf_function_count(rtc), 0 },
+	{ "spi", lf_function_count(spi), 0 },
+	{ "swd", lf_function_count(swd), 0 },
+	{ "task", lf_function_count(task), 0 },
+	{ "temp", lf_function_count(temp), 0 },
+	{ "timer", lf_function_count(timer), 0 },
+	{ "trace", lf_function_count(trace), 0 },
+	{ "uart0", lf_function_count(uart0), 0 },
+	{ "usart", lf_function_count(usart), 0 },
+	{ "usb", lf_function_count(usb), 0 },
+	{ "wdt", lf_function_count(wdt), 0 },
+	{ NULL, 0, 0 }
+};
+
+LF_WEAK lf_arg fmr_call(lf_return_t (* function)(void), lf_type ret, uint8_t argc, lf_types argt, void *argv) {
 	return -1;
 }
 
@@ -33,3 +63,14 @@ LF_WEAK lf_return_t fmr_push(struct _fmr_push_pull_packet *packet) {
 LF_WEAK lf_return_t fmr_pull(struct _fmr_push_pull_packet *packet) {
 	return -1;
 }
+
+LF_WEAK int fmr_reply(void *source, lf_size_t length) {
+	return lf_error;
+}
+
+LF_WEAK int fmr_job_timer(uint32_t period) {
+	return lf_error;
+}
+
+LF_WEAK void fmr_job_signal(void) {
+}
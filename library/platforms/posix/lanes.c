@@ -0,0 +1,282 @@
+/* lanes.c - Schedules the transactions of threads sharing an endpoint using pthreads. */
+
+#include <flipper.h>
+#include <pthread.h>
+#include <time.h>
+
+/*
+ * Transactions waiting upon an endpoint are ordered as follows:
+ *
+ *   1. Control transactions go before bulk transactions.
+ *   2. Transactions whose deadline would pass if they waited for one more transaction go first,
+ *      earliest deadline first.
+ *   3. All other transactions are fairly queued by the weight of their client. Each transaction is
+ *      tagged with the virtual time at which it would finish if every client were served at the rate
+ *      given by its weight, and the transaction with the earliest tag goes first.
+ */
+
+/* The cost of a transaction in each lane, in packets, so that bulk segments use up more of a client's share. */
+#define LF_CONTROL_COST 1
+#define LF_BULK_COST (LF_SEGMENT_SIZE / FMR_PACKET_SIZE)
+/* The scale of the virtual clock, which keeps the share of heavy clients precise. */
+#define LF_VIRTUAL_SCALE 1024
+
+/* A transaction waiting upon an endpoint. */
+struct _lf_waiter {
+	pthread_t thread;
+	struct _lf_client *client;
+	int lane;
+	/* The absolute deadline of the transaction in microseconds, or zero if it has none. */
+	uint64_t deadline;
+	/* The virtual time at which the transaction finishes. */
+	uint64_t finish;
+	/* Set once the endpoint has been handed to the transaction. */
+	bool granted;
+	struct _lf_waiter *next;
+};
+
+/* The virtual time at which a client's last transaction upon an endpoint finishes. */
+struct _lf_share {
+	uint64_t client;
+	uint64_t finish;
+	struct _lf_share *next;
+};
+
+/* The state of an endpoint's lanes. */
+struct _lf_lanes {
+	pthread_mutex_t lock;
+	/* Signalled whenever the endpoint is handed to a waiting transaction. */
+	pthread_cond_t granted;
+	/* The thread holding the endpoint, and how many transactions it has nested upon it. */
+	pthread_t holder;
+	int depth;
+	/* The virtual time of the scheduler, which is the start of the transaction last given the endpoint. */
+	uint64_t now;
+	/* The time at which the endpoint was last given to a transaction, and the average length of a transaction, in microseconds. */
+	uint64_t started;
+	uint64_t service;
+	/* The transactions waiting upon the endpoint. */
+	struct _lf_waiter *waiting;
+	/* The shares of the clients whose last transaction finishes ahead of the virtual time. */
+	struct _lf_share *shares;
+};
+
+/* Every client that has used a device, for reporting. The lock also guards the statistics of each client, which are kept
+   across every endpoint the client uses and so cannot be guarded by the lock of any one of them. */
+static struct _lf_client *lf_clients;
+static pthread_mutex_t lf_clients_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t lf_client_ids;
+static __thread struct _lf_client *lf_client;
+/* Frees the client of a thread once the thread exits. */
+static pthread_key_t lf_client_key;
+static pthread_once_t lf_client_once = PTHREAD_ONCE_INIT;
+
+static uint64_t lf_lanes_time(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Takes the client of an exiting thread off the clients, and frees it. */
+static void lf_client_exit(void *_client) {
+	struct _lf_client *client = _client;
+	pthread_mutex_lock(&lf_clients_lock);
+	for (struct _lf_client **other = &lf_clients; *other; other = &(*other)->next) {
+		if (*other == client) {
+			*other = client->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&lf_clients_lock);
+	lf_client = NULL;
+	free(client);
+}
+
+static void lf_client_key_create(void) {
+	pthread_key_create(&lf_client_key, lf_client_exit);
+}
+
+struct _lf_client *lf_client_current(void) {
+	if (lf_client) return lf_client;
+	pthread_once(&lf_client_once, lf_client_key_create);
+	struct _lf_client *client = calloc(1, sizeof(struct _lf_client));
+	lf_assert(client, failure, E_MALLOC, "Failed to allocate a client.");
+	snprintf(client->name, sizeof(client->name), "thread %lu", (unsigned long)pthread_self());
+	client->weight = LF_DEFAULT_WEIGHT;
+	pthread_mutex_lock(&lf_clients_lock);
+	client->id = ++ lf_client_ids;
+	client->next = lf_clients;
+	lf_clients = client;
+	pthread_mutex_unlock(&lf_clients_lock);
+	pthread_setspecific(lf_client_key, client);
+	lf_client = client;
+	return client;
+failure:
+	return NULL;
+}
+
+int lf_client_configure(const char *name, uint32_t weight) {
+	lf_assert(weight, failure, E_NULL, "A client cannot have a weight of zero.");
+	struct _lf_client *client = lf_client_current();
+	lf_assert(client, failure, E_MALLOC, "Failed to configure a client.");
+	pthread_mutex_lock(&lf_clients_lock);
+	if (name) snprintf(client->name, sizeof(client->name), "%s", name);
+	client->weight = weight;
+	pthread_mutex_unlock(&lf_clients_lock);
+	return lf_success;
+failure:
+	return lf_error;
+}
+
+void lf_client_deadline(uint32_t deadline) {
+	struct _lf_client *client = lf_client_current();
+	if (client) client->deadline = deadline;
+}
+
+/* Counts a transaction of a client that spent 'waited' microseconds queued. */
+static void lf_client_record(struct _lf_client *client, uint64_t waited, bool missed) {
+	pthread_mutex_lock(&lf_clients_lock);
+	client->transactions ++;
+	client->waited += waited;
+	if (waited > client->longest) client->longest = waited;
+	if (missed) client->missed ++;
+	pthread_mutex_unlock(&lf_clients_lock);
+}
+
+void lf_client_report(FILE *stream) {
+	fprintf(stream, "%-24s %8s %12s %12s %12s %8s\n", "client", "weight", "transactions", "mean (us)", "max (us)", "missed");
+	pthread_mutex_lock(&lf_clients_lock);
+	for (struct _lf_client *client = lf_clients; client; client = client->next) {
+		uint64_t mean = (client->transactions) ? client->waited / client->transactions : 0;
+		fprintf(stream, "%-24s %8u %12llu %12llu %12llu %8llu\n", client->name, client->weight, (unsigned long long)client->transactions, (unsigned long long)mean, (unsigned long long)client->longest, (unsigned long long)client->missed);
+	}
+	pthread_mutex_unlock(&lf_clients_lock);
+}
+
+void *lf_lanes_create(void) {
+	struct _lf_lanes *lanes = calloc(1, sizeof(struct _lf_lanes));
+	lf_assert(lanes, failure, E_MALLOC, "Failed to allocate the lanes of an endpoint.");
+	pthread_mutex_init(&lanes->lock, NULL);
+	pthread_cond_init(&lanes->granted, NULL);
+	return lanes;
+failure:
+	return NULL;
+}
+
+void lf_lanes_release(void *_lanes) {
+	struct _lf_lanes *lanes = _lanes;
+	if (!lanes) return;
+	while (lanes->shares) {
+		struct _lf_share *share = lanes->shares;
+		lanes->shares = share->next;
+		free(share);
+	}
+	pthread_cond_destroy(&lanes->granted);
+	pthread_mutex_destroy(&lanes->lock);
+	free(lanes);
+}
+
+/* Gives whether a transaction's deadline would pass if it waited for another transaction. */
+#define lf_lanes_urgent(waiter, lanes, time) ((waiter)->deadline && (waiter)->deadline <= (time) + (lanes)->service)
+
+/* Gives whether transaction 'a' should go before transaction 'b' at the given time. */
+static bool lf_lanes_before(struct _lf_lanes *lanes, struct _lf_waiter *a, struct _lf_waiter *b, uint64_t time) {
+	if (a->lane != b->lane) return a->lane == lf_control_lane;
+	bool urgent = lf_lanes_urgent(a, lanes, time);
+	if (urgent != lf_lanes_urgent(b, lanes, time)) return urgent;
+	if (urgent) return a->deadline < b->deadline;
+	return a->finish < b->finish;
+}
+
+/* Gives the share of the endpoint of a client. The shares of other clients that have fallen behind the virtual time are forgotten,
+   as their next transactions start at the virtual time regardless. Called with the lock held. */
+static struct _lf_share *lf_lanes_share(struct _lf_lanes *lanes, uint64_t client) {
+	struct _lf_share *found = NULL;
+	struct _lf_share **share = &lanes->shares;
+	while (*share) {
+		if ((*share)->client == client) {
+			found = *share;
+		} else if ((*share)->finish <= lanes->now) {
+			struct _lf_share *stale = *share;
+			*share = stale->next;
+			free(stale);
+			continue;
+		}
+		share = &(*share)->next;
+	}
+	if (found) return found;
+	found = calloc(1, sizeof(struct _lf_share));
+	if (!found) return NULL;
+	found->client = client;
+	found->next = lanes->shares;
+	lanes->shares = found;
+	return found;
+}
+
+/* Hands the endpoint to the first of the waiting transactions, if any. Called with the lock held. */
+static void lf_lanes_grant(struct _lf_lanes *lanes) {
+	uint64_t time = lf_lanes_time();
+	struct _lf_waiter **first = NULL;
+	for (struct _lf_waiter **waiter = &lanes->waiting; *waiter; waiter = &(*waiter)->next) {
+		if (!first || lf_lanes_before(lanes, *waiter, *first, time)) first = waiter;
+	}
+	if (!first) return;
+	struct _lf_waiter *next = *first;
+	*first = next->next;
+	/* Virtual time advances to the start of the transaction given the endpoint. */
+	uint64_t cost = ((next->lane == lf_control_lane) ? LF_CONTROL_COST : LF_BULK_COST) * LF_VIRTUAL_SCALE / next->client->weight;
+	if (next->finish - cost > lanes->now) lanes->now = next->finish - cost;
+	next->granted = true;
+	lanes->started = time;
+	lanes->holder = next->thread;
+	lanes->depth = 1;
+	pthread_cond_broadcast(&lanes->granted);
+}
+
+int lf_lane_acquire(struct _lf_endpoint *endpoint, int lane) {
+	struct _lf_lanes *lanes = endpoint->lanes;
+	if (!lanes) return lf_success;
+	struct _lf_client *client = lf_client_current();
+	lf_assert(client, failure, E_MALLOC, "Failed to queue a transaction for the calling thread.");
+	pthread_mutex_lock(&lanes->lock);
+	/* A transaction performed within another, such as the binding of a module, is part of the one holding the endpoint. */
+	if (lanes->depth && pthread_equal(lanes->holder, pthread_self())) {
+		lanes->depth ++;
+		pthread_mutex_unlock(&lanes->lock);
+		return lf_success;
+	}
+	/* Each endpoint is shared by its own clients, so a client's place in one queue does not depend upon its use of another. */
+	struct _lf_share *share = lf_lanes_share(lanes, client->id);
+	if (!share) pthread_mutex_unlock(&lanes->lock);
+	lf_assert(share, failure, E_MALLOC, "Failed to allocate the share of an endpoint for client '%s'.", client->name);
+	uint64_t queued = lf_lanes_time();
+	struct _lf_waiter waiter = { pthread_self(), client, lane, 0, 0, false, NULL };
+	if (client->deadline) waiter.deadline = queued + client->deadline;
+	/* The transaction starts once the client's previous transaction has finished, or now if the client has been idle. */
+	uint64_t start = (share->finish > lanes->now) ? share->finish : lanes->now;
+	waiter.finish = start + ((lane == lf_control_lane) ? LF_CONTROL_COST : LF_BULK_COST) * LF_VIRTUAL_SCALE / client->weight;
+	share->finish = waiter.finish;
+	waiter.next = lanes->waiting;
+	lanes->waiting = &waiter;
+	if (!lanes->depth) lf_lanes_grant(lanes);
+	while (!waiter.granted) pthread_cond_wait(&lanes->granted, &lanes->lock);
+	uint64_t waited = lf_lanes_time() - queued;
+	pthread_mutex_unlock(&lanes->lock);
+	lf_client_record(client, waited, waiter.deadline && queued + waited > waiter.deadline);
+	return lf_success;
+failure:
+	return lf_error;
+}
+
+void lf_lane_release(struct _lf_endpoint *endpoint) {
+	struct _lf_lanes *lanes = endpoint->lanes;
+	if (!lanes) return;
+	pthread_mutex_lock(&lanes->lock);
+	if (lanes->depth && !(-- lanes->depth)) {
+		/* The average length of a transaction decides when a deadline is at risk. */
+		uint64_t length = lf_lanes_time() - lanes->started;
+		lanes->service = (lanes->service * 7 + length) / 8;
+		lf_lanes_grant(lanes);
+	}
+	pthread_mutex_unlock(&lanes->lock);
+}
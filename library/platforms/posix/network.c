@@ -26,6 +26,8 @@ int lf_network_pull(struct _lf_endpoint *endpoint, void *destination, lf_size_t
 	socklen_t _length = sizeof(context->device);
 	ssize_t _e = recvfrom(context->fd, destination, length, 0, (struct sockaddr *)&context->device, &_length);
 	lf_assert(_e > 0, failure, E_COMMUNICATION, "Failed to receive data from networked device '%s' at '%s'.", context->host, inet_ntoa(context->device.sin_addr));
+	/* Each reply is a datagram of its own, so a shorter one is a different reply from the one expected. */
+	lf_assert(_e == length, failure, E_COMMUNICATION, "Received %zi of %i bytes from networked device '%s'.", _e, length, context->host);
 	return lf_success;
 failure:
 	return lf_error;
@@ -48,6 +50,7 @@ struct _lf_endpoint *lf_network_endpoint_for_hostname(char *hostname) {
 													   lf_network_destroy,
 													   sizeof(struct _lf_network_context));
 	lf_assert(endpoint, failure, E_ENDPOINT, "Failed to create endpoint for networked device.");
+	endpoint->packet_size = LF_UDP_PACKET_SIZE;
 	context = (struct _lf_network_context *)endpoint->_ctx;
 	context->fd = socket(AF_INET, SOCK_DGRAM, 0);
 	lf_assert(context->fd > 0, failure, E_SOCKET, "Failed to create socket for network device.");
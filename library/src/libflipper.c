@@ -40,6 +40,10 @@ int lf_device_release(struct _lf_device *device) {
 int lf_attach(struct _lf_device *device) {
 	lf_assert(device, failure, E_NULL, "Attempt to attach an invalid device.");
 	lf_ll_append(&lf_attached_devices, device, lf_device_release);
+	/* Ask the device for its configuration, unless it has already been cached. */
+	if (!device->configuration.capabilities.classes) lf_load_configuration(device);
+	/* Agree upon the largest packet that can be exchanged with the device. */
+	lf_negotiate(device);
 	lf_select(device);
 	return lf_success;
 failure:
@@ -96,25 +100,28 @@ failure:
 
 /* Debugging functions for displaying the contents of various FMR related data structures. */
 
-void lf_debug_call(struct _fmr_invocation *call) {
+void lf_debug_call(struct _fmr_invocation *call, lf_size_t length) {
 	printf("call\n");
 	printf("\t└─ module:\t\t0x%x\n", call->index);
 	printf("\t└─ function:\t0x%x\n", call->function);
 	char *typestrs[] = { "int8", "int16", "void", "int32", "int", "", "ptr", "int64" };
 	printf("\t└─ return:\t\t%s\n", typestrs[call->ret & 0x7]);
-	printf("\t└─ types:\t\t0x%x\n", call->types);
 	printf("\t└─ argc:\t\t0x%x (%d arguments)\n", call->argc, call->argc);
 	printf("arguments\n");
-	/* Calculate the offset into the packet at which the arguments will be loaded. */
-	uint8_t *offset = call->parameters;
-	lf_types types = call->types;
-	for (lf_argc i = 0; i < call->argc; i ++) {
-		lf_type type = types & lf_max_t;
+	/* Calculate the offset into the packet at which the arguments were loaded. */
+	uint8_t *offset = fmr_arguments(call);
+	uint8_t *end = (uint8_t *)call + length;
+	for (lf_argc i = 0; i < call->argc && offset < end; i ++) {
+		lf_type type = (call->parameters[i / 2] >> ((i % 2) * 4)) & lf_max_t;
 		lf_arg arg = 0;
-		memcpy(&arg, offset, lf_sizeof(type));
+		uint8_t consumed = fmr_decode_arg(type, offset, end - offset, &arg);
+		if (!consumed) break;
+		offset += consumed;
+		if (lf_is_buffer(type)) {
+			printf("\t└─ %s:\t\t%llu bytes\n", (type == lf_in_t) ? "in" : (type == lf_out_t) ? "out" : "inout", (unsigned long long)arg);
+			continue;
+		}
 		printf("\t└─ %c%s:\t\t0x%llx\n", ((type & (1 << 3)) ? '\0' : 'u'), typestrs[type & 0x7], arg);
-		offset += lf_sizeof(type);
-		types >>= 4;
 	}
 	printf("\n");
 }
@@ -132,23 +139,35 @@ void lf_debug_packet(struct _fmr_packet *packet, size_t length) {
 		printf("header\n");
 		printf("\t└─ magic:\t\t0x%x\n", packet->header.magic);
 		printf("\t└─ checksum:\t0x%x\n", packet->header.checksum);
-		printf("\t└─ length:\t\t%d bytes (%.02f%%)\n", packet->header.length, (float) packet->header.length/sizeof(struct _fmr_packet)*100);
-		char *classstrs[] = { "standard", "user", "push", "pull", "send", "receive", "load", "event" };
-		printf("\t└─ class\t\t%s\n", classstrs[packet->header.type]);
+		printf("\t└─ length:\t\t%d bytes (%.02f%%)\n", packet->header.length, (float) packet->header.length/length*100);
+		char *classstrs[] = { "standard", "user", "push", "pull", "send", "receive", "load", "event", "describe", "negotiate", "configuration", "sync", "malloc", "free", "script", "job", "drain" };
+		printf("\t└─ class\t\t%s%s%s\n", classstrs[fmr_packet_class(packet->header.type)], (packet->header.type & fmr_inline_flag) ? " (inline)" : "", (packet->header.type & fmr_no_reply_flag) ? " (no reply)" : "");
 		struct _fmr_invocation_packet *invocation = (struct _fmr_invocation_packet *)(packet);
 		struct _fmr_push_pull_packet *pushpull = (struct _fmr_push_pull_packet *)(packet);
-		switch (packet->header.type) {
+		switch (fmr_packet_class(packet->header.type)) {
 			case fmr_standard_invocation_class:
-				lf_debug_call(&invocation->call);
+				lf_debug_call(&invocation->call, fmr_length_from(packet, &invocation->call));
 			break;
 			case fmr_user_invocation_class:
-				lf_debug_call(&invocation->call);
+				lf_debug_call(&invocation->call, fmr_length_from(packet, &invocation->call));
 			break;
 			case fmr_push_class:
 			case fmr_pull_class:
+			case fmr_send_class:
+			case fmr_receive_class:
 				printf("length:\n");
 				printf("\t└─ length:\t\t0x%x\n", pushpull->length);
-				lf_debug_call(&pushpull->call);
+				lf_debug_call(&pushpull->call, fmr_length_from(packet, &pushpull->call));
+			break;
+			case fmr_job_class:
+				printf("job:\n");
+				printf("\t└─ job:\t\t%i\n", ((struct _fmr_job_packet *)(packet))->job);
+				printf("\t└─ period:\t\t%ius\n", ((struct _fmr_job_packet *)(packet))->period);
+				lf_debug_call(&((struct _fmr_job_packet *)(packet))->call, fmr_length_from(packet, &((struct _fmr_job_packet *)(packet))->call));
+			break;
+			case fmr_describe_class:
+				printf("describe:\n");
+				printf("\t└─ module:\t\t0x%x\n", invocation->call.index);
 			break;
 			default:
 				printf("Invalid packet class.\n");
@@ -19,10 +19,17 @@ struct _lf_endpoint {
 	int (* pull)(struct _lf_endpoint *endpoint, void *destination, lf_size_t length);
 	/* Destroys any state associated with the endpoint. */
 	int (* destroy)(struct _lf_endpoint *endpoint);
+	/* The largest packet the endpoint can carry in a single transfer. */
+	lf_size_t packet_size;
 	/* Tracks endpoint specific context. */
 	void *_ctx;
+	/* Arbitrates between the lanes of the endpoint, on platforms with threads. */
+	void *lanes;
 };
 
+/* The lanes through which transactions reach an endpoint. Control transactions are served before bulk transactions. */
+enum { lf_control_lane, lf_bulk_lane };
+
 enum { _endpoint_configure, _endpoint_ready, _endpoint_push, _endpoint_pull, _endpoint_destroy };
 
 struct _lf_endpoint *lf_endpoint_create(int (* configure)(struct _lf_endpoint *endpoint, void *ctx),
@@ -37,4 +44,13 @@ struct _lf_msg *lf_endpoint_dequeue(struct _lf_endpoint *endpoint);
 void lf_endpoint_poll(struct _lf_endpoint *endpoint);
 int lf_endpoint_release(struct _lf_endpoint *endpoint);
 
+/* Creates and releases the state of an endpoint's lanes. */
+void *lf_lanes_create(void);
+void lf_lanes_release(void *lanes);
+/* Holds the endpoint for a transaction in the given lane, waiting for any transaction of another thread to complete first.
+   A thread may nest transactions within those it holds. The endpoint must only be released if it was acquired. */
+int lf_lane_acquire(struct _lf_endpoint *endpoint, int lane);
+/* Releases the endpoint once a transaction is complete. */
+void lf_lane_release(struct _lf_endpoint *endpoint);
+
 #endif
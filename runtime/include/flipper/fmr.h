@@ -7,8 +7,14 @@
 #include <flipper/error.h>
 #include <flipper/ll.h>
 
-/* The size of a single FMR packet expressed in bytes. */
+/* The size of a single FMR packet expressed in bytes. Every device and endpoint supports packets of this size. */
 #define FMR_PACKET_SIZE 64
+/* The largest packet that the runtime can receive. Packets larger than FMR_PACKET_SIZE are negotiated per device. */
+#if defined(POSIX)
+#define FMR_MAX_PACKET_SIZE 1400
+#else
+#define FMR_MAX_PACKET_SIZE FMR_PACKET_SIZE
+#endif
 /* The magic number that indicates the start of a packet. */
 #define FMR_MAGIC_NUMBER 0xFE
 
@@ -27,23 +33,30 @@ typedef uint8_t lf_argc;
 
 /* The maximum number of arguments that can be encoded into a packet. */
 #define FMR_MAX_ARGC 16
-/* Used to hold encoded prameter types within invocation metadata.
+/* Used to hold the types of a call's parameters, four bits per parameter.
    NOTE: This type must be capable of encoding the exact number of bits
-		 given by (FMR_MAX_ARGC * 2).
+		 given by (FMR_MAX_ARGC * 4).
 */
-typedef uint32_t lf_types;
+typedef uint64_t lf_types;
+/* The most bytes an argument can occupy once encoded. */
+#define FMR_MAX_ARG_SIZE 10
 
 /* Converts a C type into an unsigned lf_type. */
 #define lf_utype(type) (sizeof(type) - 1)
 /* Converts a C type into a signed lf_type. */
 #define lf_stype(type) ((1 << 3) | lf_utype(type))
 /* Calculates the length of an FMR type. */
-#define lf_sizeof(type) ((type != lf_void_t && type != lf_int_t && type != lf_ptr_t) ? ((type & 0x7) + 1) : 8)
+#define lf_sizeof(type) ((type != lf_void_t && type != lf_int_t && type != lf_ptr_t && !lf_is_buffer(type)) ? ((type & 0x7) + 1) : 8)
+/* Gives whether an argument type describes a buffer, which the device passes to the callee as a pointer to its own copy. */
+#define lf_is_buffer(type) ((type) == lf_out_t || (type) == lf_in_t || (type) == lf_inout_t)
+/* Gives whether a return type is wider than 'lf_return_t', and so is only returned in full alongside the result. */
+#define lf_wide(type) (((type) & 0x7) == lf_uint64_t)
 
 /* Enumerates the basic type signatures an argument can be classified as. */
 enum {
 	lf_void_t = 2,                    // 2
 	lf_int_t = 4,                     // 4
+	lf_out_t = 5,                     // 5
 	lf_ptr_t = 6,                     // 6
 
 	/* Unsigned types. */
@@ -58,6 +71,10 @@ enum {
 	lf_int32_t = lf_stype(int32_t),   // 11
 	lf_int64_t = lf_stype(int64_t),   // 15
 
+	/* Buffer types. Their value is the length of the buffer. */
+	lf_in_t = (1 << 3) | lf_out_t,    // 13
+	lf_inout_t = (1 << 3) | lf_ptr_t, // 14
+
 	/* Max type is 15. */
 	lf_max_t = 15
 };
@@ -68,8 +85,8 @@ typedef uint8_t lf_type;
 /* ~ Parameter list building macros. */
 
 /* Counts the number of arguments within a variadic argument macro. */
-#define __fmr_count_implicit(_0, _1, _2, _3, _4, _5, _6, _7, _8, _9, _a, _b, _c, _d, _e, _f, _10, n, ...) n
-#define __fmr_count(...) __fmr_count_implicit(_, ##__VA_ARGS__, 16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define __fmr_count_implicit(_0, _1, _2, _3, _4, _5, _6, _7, _8, _9, _a, _b, _c, _d, _e, _f, _10, _11, _12, _13, _14, _15, _16, _17, _18, _19, _1a, _1b, _1c, _1d, _1e, _1f, _20, n, ...) n
+#define __fmr_count(...) __fmr_count_implicit(_, ##__VA_ARGS__, 32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17, 16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0)
 
 /* Generates and returns a pointer to an 'fmr_parameters' given a list of variadic arguments. */
 #define lf_args(...) fmr_build((__fmr_count(__VA_ARGS__)/2), ##__VA_ARGS__)
@@ -94,6 +111,12 @@ typedef uint8_t lf_type;
 #define lf_uint32(arg) lf_intx(lf_uint32_t, (uint32_t)arg)
 /* Gives the 'lf_va' for a pointer. */
 #define lf_ptr(arg) lf_intx(lf_ptr_t, (uintptr_t)arg)
+/* Gives the 'lf_va' for a buffer that is copied to the device before the call. */
+#define lf_in(pointer, length) lf_intx(lf_in_t, (uintptr_t)&((struct _lf_buffer){ (void *)(pointer), (length) }))
+/* Gives the 'lf_va' for a buffer that is filled by the device and copied back to the host with the result. */
+#define lf_out(pointer, length) lf_intx(lf_out_t, (uintptr_t)&((struct _lf_buffer){ (void *)(pointer), (length) }))
+/* Gives the 'lf_va' for a buffer that is copied to the device before the call and back to the host with the result. */
+#define lf_inout(pointer, length) lf_intx(lf_inout_t, (uintptr_t)&((struct _lf_buffer){ (void *)(pointer), (length) }))
 /* Creates an 'lf_va' from a C variable. */
 #define lf_infer(variable) lf_intx(lf_utype(variable), variable)
 
@@ -110,16 +133,75 @@ enum {
 	fmr_push_class,
 	/* Causes a pull operation to begin. */
 	fmr_pull_class,
-	/* Sends data to device. */
+	/* Sends data to an address on the device. */
 	fmr_send_class,
-	/* Receives data from the device. */
+	/* Receives data from an address on the device. */
 	fmr_receive_class,
 	/* Experimental: Caused a RAM load and launch. */
 	fmr_ram_load_class,
 	/* Signals the occurance an event. */
-	fmr_event_class
+	fmr_event_class,
+	/* Describes a standard module available on the device. */
+	fmr_describe_class,
+	/* Agrees upon the largest packet that can be exchanged with the device. */
+	fmr_negotiate_class,
+	/* Obtains the device's configuration and capabilities. */
+	fmr_configuration_class,
+	/* Reports any error latched by invocations that were performed without a reply. */
+	fmr_sync_class,
+	/* Allocates a buffer on the device. */
+	fmr_malloc_class,
+	/* Frees a buffer previously allocated on the device. */
+	fmr_free_class,
+	/* Performs a script of calls on the device. */
+	fmr_script_class,
+	/* Starts or stops a job that performs a call periodically. */
+	fmr_job_class,
+	/* Drains the values sampled by jobs. */
+	fmr_drain_class
+};
+
+/* Flags carried in the upper bits of a packet's type, alongside its class. */
+enum {
+	/* The data of a push follows the call within the packet, or the data of a pull follows the result of the reply.
+	   For an invocation, the full return value and the contents of its out and in-out buffers follow the result of the reply. */
+	fmr_inline_flag = (1 << 7),
+	/* The invocation is performed without a reply. Any error it raises is latched until the next synchronous packet. */
+	fmr_no_reply_flag = (1 << 6)
 };
 
+/* The bits of a packet's type that are reserved for flags. */
+#define FMR_FLAGS_MASK (fmr_inline_flag | fmr_no_reply_flag)
+/* Gives the class of a packet, without its flags. */
+#define fmr_packet_class(type) ((type) & ~FMR_FLAGS_MASK)
+
+/* Returned by 'fmr_perform' when the result has already been sent as part of the reply, or is not to be sent at all. */
+#define FMR_REPLIED 1
+
+/* Set among the classes of a device that returns wide values and buffers within the reply to an invocation, above every class. */
+#define FMR_INLINE_CAPABILITY (1UL << 31)
+/* Set among the classes of a device whose calls take 64-bit arguments, which only the x64 'fmr_call' passes. */
+#define FMR_WIDE_CAPABILITY (1UL << 30)
+/* 8-bit devices pass every argument of a call within registers r8 through r25, each taking an even number of them. */
+#define FMR_8BIT_MAX_ARGC 8
+#define FMR_8BIT_ARG_REGISTERS 18
+/* The packet classes assumed of firmware that predates configurations, and so cannot report its own: all of those below configurations. */
+#define FMR_LEGACY_CLASSES ((1UL << fmr_configuration_class) - 1)
+/* The packet classes performed by every runtime: all of those below scripts. */
+#define FMR_COMMON_CLASSES ((1UL << fmr_script_class) - 1)
+/* A bitmap of the packet classes performed by this runtime, which it reports in its configuration and refuses to perform otherwise. */
+#if defined(ATMEGAU2)
+/* The U2 has no timer to spare for jobs, nor the memory to interpret scripts, so both are left to the 4S. */
+#define FMR_SUPPORTED_CLASSES (FMR_COMMON_CLASSES | FMR_INLINE_CAPABILITY)
+#elif defined(POSIX)
+#define FMR_SUPPORTED_CLASSES (FMR_COMMON_CLASSES | (1UL << fmr_script_class) | (1UL << fmr_job_class) | (1UL << fmr_drain_class) | FMR_INLINE_CAPABILITY | FMR_WIDE_CAPABILITY)
+#else
+#define FMR_SUPPORTED_CLASSES (FMR_COMMON_CLASSES | (1UL << fmr_script_class) | (1UL << fmr_job_class) | (1UL << fmr_drain_class) | FMR_INLINE_CAPABILITY)
+#endif
+
+/* Enumerates the compression schemes a device can decode. None are defined yet. */
+enum { fmr_compression_none = 0 };
+
 /* A type used to reference the values in the enum above. */
 typedef uint8_t fmr_class;
 
@@ -135,12 +217,22 @@ struct LF_PACKED _fmr_header {
 	fmr_class type;
 };
 
+/* Describes a buffer on the host that is marshalled to and from the device as an argument. */
+struct _lf_buffer {
+	/* The buffer's address on the host. */
+	void *data;
+	/* The length of the buffer in bytes. */
+	lf_size_t length;
+};
+
 /* Standardizes the notion of an argument. */
 struct _lf_arg {
 	/* The type of the argument. */
 	lf_type type;
 	/* The value of the argument. */
 	lf_arg value;
+	/* The host's copy of a buffer argument, whose length is the argument's value. */
+	void *buffer;
 };
 
 /* Generic packet data type that can be passed around by packet parsing equipment. */
@@ -159,14 +251,23 @@ struct LF_PACKED _fmr_invocation {
 	uint8_t function;
 	/* The return type. */
 	lf_type ret;
-	/* The types of the encoded parameters. */
-	lf_types types;
 	/* The number of encoded parameters. */
 	lf_argc argc;
-	/* The encoded values of the parameters to be passed to the callee. */
+	/* The types of the parameters, two to a byte with the first in the low bits, followed by their encoded values. */
 	uint8_t parameters[];
 };
 
+/* Gives the number of bytes holding the types of a call's parameters. */
+#define fmr_types_size(argc) (((argc) + 1) / 2)
+/* Gives the address of the encoded values of a call's parameters, which follow their types. */
+#define fmr_arguments(call) (&(call)->parameters[fmr_types_size((call)->argc)])
+/* Gives the number of bytes of a packet from the given part of it to its end, or zero if the packet ends before the part. */
+#define fmr_length_from(packet, part) ((lf_size_t)((packet)->header.length > ((uint8_t *)(part) - (uint8_t *)(packet)) ? (packet)->header.length - ((uint8_t *)(part) - (uint8_t *)(packet)) : 0))
+
+/* Values are encoded seven bits to a byte, least significant first, with the high bit set on all bytes but the last.
+   Signed values and 'lf_int_t' are zigzag encoded beforehand, so that small negative values stay short. Pointers are
+   always encoded as 8 bytes, so that a device can substitute its own buffers for them in place. */
+
 /* Contains metadata needed to perform a remote procedure call on a device. */
 struct LF_PACKED _fmr_invocation_packet {
 	/* The packet header programmed with 'fmr_standard_invocation_class' or 'fmr_user_invocation_class'. */
@@ -185,6 +286,89 @@ struct LF_PACKED _fmr_push_pull_packet {
 	struct _fmr_invocation call;
 };
 
+/* Contains a script of calls to be performed by the device. */
+struct LF_PACKED _fmr_script_packet {
+	/* The packet header programmed with 'fmr_script_class'. */
+	struct _fmr_header header;
+	/* The code of the script, which extends to the end of the packet. */
+	uint8_t code[];
+};
+
+/* The number of registers available to a script. */
+#define FMR_SCRIPT_REGISTERS 8
+/* The largest number of instructions a script may perform, which bounds its loops and how long it holds the device from other packets. */
+#if defined(POSIX)
+#define FMR_SCRIPT_MAX_STEPS 0xFFFF
+#else
+#define FMR_SCRIPT_MAX_STEPS 0x2000
+#endif
+
+/* Enumerates the instructions of a script. Each begins with its opcode and the register it operates upon. */
+enum {
+	/* Ends the script, giving the value of the register as its result. [op, reg] */
+	fmr_op_return,
+	/* Loads a value into the register. [op, reg, value:4] */
+	fmr_op_load,
+	/* Masks the register with a value. [op, reg, value:4] */
+	fmr_op_and,
+	/* Adds a value to the register. [op, reg, value:4] */
+	fmr_op_add,
+	/* Performs a call, storing its return value in the register. Each argument whose bit is set in the
+	   sources is replaced by the register its value names. [op, reg, sources:2, invocation] */
+	fmr_op_invoke,
+	/* Jumps to the target if the register compares with the value as given by the condition. [op, reg, condition, value:4, target:2] */
+	fmr_op_branch,
+	/* Decrements the register, jumping to the target until it reaches zero. [op, reg, target:2] */
+	fmr_op_loop
+};
+
+/* Enumerates the conditions upon which a script can branch. Comparisons are unsigned. */
+enum {
+	fmr_condition_always,
+	fmr_condition_equal,
+	fmr_condition_not_equal,
+	fmr_condition_less,
+	fmr_condition_greater_equal
+};
+
+/* The number of jobs, and of samples awaiting a drain, that the device can hold. The sample count must be a power of two. */
+#if defined(ATMEGAU2)
+#define FMR_MAX_JOBS 1
+#define FMR_JOB_SAMPLES 8
+#else
+#define FMR_MAX_JOBS 4
+#define FMR_JOB_SAMPLES 256
+#endif
+/* The shortest period, in microseconds, at which a job can be performed. */
+#define FMR_JOB_MIN_PERIOD 100
+/* The longest interval, in microseconds, between ticks of the job timer. Longer periods are counted out in ticks. */
+#define FMR_JOB_MAX_TICK 50000
+
+/* Starts a job that performs a call every period, or stops a job if the period is zero. */
+struct LF_PACKED _fmr_job_packet {
+	/* The packet header programmed with 'fmr_job_class'. */
+	struct _fmr_header header;
+	/* The job to stop, if the period is zero. */
+	uint8_t job;
+	/* The period of the job in microseconds. */
+	uint32_t period;
+	/* The call performed by the job. */
+	struct _fmr_invocation call;
+};
+
+/* A value returned by the call of a job, held by the device until it is drained. */
+struct LF_PACKED _fmr_sample {
+	/* The job that took the sample. */
+	uint8_t job;
+	/* The error raised by the job's call. */
+	lf_error_t error;
+	/* The value returned by the job's call. */
+	lf_return_t value;
+};
+
+/* Set in the job of the first sample taken after samples were lost to a full ring. */
+#define FMR_SAMPLE_OVERRUN (1 << 7)
+
 /* A generic datastructure that is sent back following any message runtime transaction. */
 struct LF_PACKED _fmr_result {
 	/* The return value of the function called (if any). */
@@ -194,33 +378,110 @@ struct LF_PACKED _fmr_result {
 	/* NOTE: Add bitfield indicating the need to poll for updates. */
 };
 
+/* Calculates the number of functions exposed by a module's virtual interface. */
+#define lf_function_count(interface) (sizeof(interface) / sizeof(void *))
+
+/* Enumerates the attributes a device can give to the modules it describes. */
+enum {
+	/* The module drives hardware internal to the device, and is only used when explicitly requested. */
+	fmr_module_private = (1 << 0),
+	/* The module is the last module described by the device. */
+	fmr_module_last = (1 << 7)
+};
+
+/* Describes a standard module to the host so that calls to its functions can be routed. */
+struct _fmr_module_descriptor {
+	/* The name of the module. Its checksum is the module's identifier. */
+	const char *name;
+	/* The number of functions the module implements. */
+	uint8_t functions;
+	/* The attributes of the module. */
+	uint8_t attributes;
+};
+
+/* Packs a module description into the value returned by a describe request. */
+#define fmr_description(identifier, functions, attributes) (((lf_return_t)(attributes) << 24) | ((lf_return_t)(functions) << 16) | (lf_return_t)(identifier))
+/* Unpacks the fields of a module description. */
+#define fmr_description_identifier(description) ((lf_crc_t)(description))
+#define fmr_description_functions(description) ((uint8_t)((description) >> 16))
+#define fmr_description_attributes(description) ((uint8_t)((description) >> 24))
+
 /* A reference to the lf_modules array. */
 extern const void *const lf_modules[];
+/* A reference to the descriptors of the modules in the lf_modules array, terminated by a descriptor without a name. */
+extern const struct _fmr_module_descriptor lf_module_descriptors[];
 
 /* ~ Declare the prototypes for all functions exposed by this driver. ~ */
 
 /* Appends an argument to an fmr_parameters. */
 int lf_append(struct _lf_ll *list, lf_type type, lf_arg value);
-/* Generates the appropriate data structure needed for the remote procedure call of 'funtion' in 'module'. */
-int lf_create_call(lf_module module, lf_function function, lf_type ret, struct _lf_ll *args, struct _fmr_header *header, struct _fmr_invocation *call);
+struct _lf_configuration;
+/* Generates the appropriate data structure needed for the remote procedure call of 'funtion' in 'module'. The packet must be no larger than 'size' bytes.
+   The arguments are refused unless the device described by 'configuration' can pass them, unless it is NULL. */
+int lf_create_call(lf_module module, lf_function function, lf_type ret, struct _lf_ll *args, struct _fmr_header *header, struct _fmr_invocation *call, lf_size_t size, const struct _lf_configuration *configuration);
+/* Raises E_TYPE or E_OVERFLOW unless a device with the given attributes and classes can pass arguments of the types 'argt' to a function. */
+int fmr_callable(uint8_t attributes, uint32_t classes, lf_argc argc, lf_types argt);
 /* Creates a struct _lf_arg * type. */
 struct _lf_arg *lf_arg_create(lf_type type, lf_arg value);
 
 /* Builds an fmr_parameters from a set of variadic arguments provided by the fmr_parameters macro. */
 struct _lf_ll *fmr_build(int argc, ...);
-/* Executes a standard module. */
-lf_return_t fmr_execute(lf_module module, lf_function function, lf_type ret, lf_argc argc, lf_types argt, void *arguments);
-/* Executes an fmr_packet and stores the result of the operation in the result buffer provided. */
+/* Encodes an argument, returning the number of bytes it occupies. */
+uint8_t fmr_encode_arg(lf_type type, lf_arg value, uint8_t *data);
+/* Decodes an argument from the 'length' bytes of data available, returning the number of bytes it occupied, or zero if it runs past them. */
+uint8_t fmr_decode_arg(lf_type type, const uint8_t *data, lf_size_t length, lf_arg *value);
+/* Unpacks the parameters of a call 'length' bytes long into their types and the native width of each, as expected by 'fmr_call'.
+   Buffers are given 8 byte aligned storage within the 'scratch' arena of 'size' bytes, which may be NULL if the call has none.
+   The contents of in and in-out buffers, which follow the arguments of the call, are copied into their storage. */
+int fmr_unpack(struct _fmr_invocation *call, lf_size_t length, lf_types *argt, void *argv, void *scratch, lf_size_t size);
+/* Executes a call to a standard module, 'length' bytes long. Calls performed without an inline reply, including those of jobs,
+   scripts, and pushes, are given no scratch arena, so the host refuses to build them with buffers. */
+lf_return_t fmr_execute(struct _fmr_invocation *call, lf_size_t length);
+/* Describes the standard module at the given index of the lf_modules array. */
+lf_return_t fmr_describe(uint8_t index);
+/* Returns the largest packet, no larger than the size proposed, that the device can receive. */
+lf_return_t fmr_negotiate(lf_size_t size);
+/* Computes a checksum of the standard module table, which changes whenever the table does. */
+lf_crc_t fmr_module_hash(void);
+/* Replies to the host with the device's configuration. */
+lf_return_t fmr_configuration(void);
+/* Allocates a buffer for the host, replying with its address. */
+lf_return_t fmr_malloc(lf_size_t size);
+/* Frees a buffer that was allocated for the host. */
+lf_return_t fmr_free(uint64_t address);
+/* Performs a script of calls, returning the value given by its return instruction. */
+lf_return_t fmr_script(const uint8_t *code, lf_size_t length);
+/* Starts or stops a job, returning the index of a job that was started. */
+lf_return_t fmr_job(struct _fmr_job_packet *packet);
+/* Takes up to 'max' samples from the ring, returning their number and where they were placed. */
+lf_size_t fmr_drain(lf_size_t max, struct _fmr_sample **samples);
+/* Counts a tick of the job timer, waking whatever performs packets to perform the jobs. Called from the platform's timer. */
+void fmr_job_tick(void);
+/* Performs the jobs that fell due over the ticks counted so far. Called by whatever performs packets, so that jobs never run alongside a packet. */
+void fmr_job_perform(void);
+/* Performs an invocation, replying with the result followed by the full return value and the contents of its out and in-out buffers. */
+lf_return_t fmr_execute_inline(struct _fmr_invocation *call, lf_size_t length);
+/* Performs a push whose data was carried inline within the packet. */
+lf_return_t fmr_push_inline(struct _fmr_push_pull_packet *packet);
+/* Performs a pull, replying with the result followed by the data pulled. */
+lf_return_t fmr_pull_inline(struct _fmr_push_pull_packet *packet);
+/* Executes an fmr_packet and stores the result of the operation in the result buffer provided. Returns 'FMR_REPLIED' if the result should not be sent separately. */
 int fmr_perform(struct _fmr_packet *packet, struct _fmr_result *result);
 
 /* Helper function for lf_push. */
 extern lf_return_t fmr_push(struct _fmr_push_pull_packet *packet);
 /* Helper function for lf_pull. */
 extern lf_return_t fmr_pull(struct _fmr_push_pull_packet *packet);
+/* Sends data back to the host ahead of the result of the current packet. */
+extern int fmr_reply(void *source, lf_size_t length);
 
 /* ~ Functions with platform specific implementation. ~ */
 
-/* Unpacks the argument buffer into the CPU following the native architecture's calling convention and jumps to the given function pointer. */
-extern lf_return_t fmr_call(lf_return_t (* function)(void), lf_type ret, uint8_t argc, uint16_t argt, void *argv);
+/* Ticks the jobs every period given in microseconds, or stops ticking them if the period is zero. */
+extern int fmr_job_timer(uint32_t period);
+/* Wakes the task or thread that performs packets, which then calls 'fmr_job_perform'. This can be called from an interrupt. */
+extern void fmr_job_signal(void);
+/* Unpacks the argument buffer into the CPU following the native architecture's calling convention and jumps to the given function pointer. The value returned is extended to 64 bits. */
+extern lf_arg fmr_call(lf_return_t (* function)(void), lf_type ret, uint8_t argc, lf_types argt, void *argv);
 
 #endif
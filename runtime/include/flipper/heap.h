@@ -0,0 +1,41 @@
+#ifndef __heap_h__
+#define __heap_h__
+
+/* Include all types and macros exposed by the Flipper Toolbox. */
+#include <flipper.h>
+
+/* The usage of a device's heap. Its fragmentation is one less the ratio of the largest free block to the bytes available. */
+struct _heap_stats {
+	/* The number of bytes managed by the heap. */
+	uint32_t size;
+	/* The number of bytes in use, including the headers of blocks. */
+	uint32_t used;
+	/* The most bytes that have been in use at once. */
+	uint32_t peak;
+	/* The number of bytes that are free. */
+	uint32_t available;
+	/* The size of the largest free block. */
+	uint32_t largest;
+	/* The number of free bytes held by the pools of small blocks, which are counted as in use. */
+	uint32_t pooled;
+	/* The number of allocations that have yet to be freed. */
+	uint32_t allocations;
+	/* The number of allocations that could not be satisfied. */
+	uint32_t failures;
+};
+
+/* Declare the virtual interface for this module. */
+extern const struct _heap_interface {
+	/* Reads the usage of the heap. */
+	int (* stats)(struct _heap_stats *stats);
+} heap;
+
+/* Declare the _lf_module structure for this module. */
+extern struct _lf_module _heap;
+
+/* Declare the FMR overlay for this module. */
+enum { _heap_stats };
+
+int os_heap_stats(struct _heap_stats *stats);
+
+#endif
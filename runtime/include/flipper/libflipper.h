@@ -24,6 +24,9 @@
 
 #define LF_UART_TIMEOUT_MS 100
 
+/* The largest segment of 'lf_push_segments' and 'lf_pull_segments', and of remote buffer transfers. Control transactions waiting upon the device are performed between segments. */
+#define LF_SEGMENT_SIZE 2048
+
 /* NOTE: Summing the size parameters of each endpoints below should be less than or equal to 160. */
 #define USB_IN_MASK            0x80
 
@@ -77,6 +80,7 @@ void lf_set_debug_level(int level);
 #define little32(x) ((((uint32_t)(x)) << 16 ) | (((uint32_t)(x)) >> 16))
 
 #include <flipper/error.h>
+#include <flipper/fmr.h>
 
 /* Macros that quantify device attributes. */
 #define lf_device_8bit (1 << 1)
@@ -85,6 +89,20 @@ void lf_set_debug_level(int level);
 #define lf_device_big_endian    1
 #define lf_device_little_endian 0
 
+/* Describes the message runtime features supported by a Flipper device. */
+struct LF_PACKED _lf_capabilities {
+	/* The largest packet the device can receive. */
+	uint16_t packet_size;
+	/* A bitmap of the packet classes the device can perform. */
+	uint32_t classes;
+	/* The number of packets the device can accept before it must reply. */
+	uint8_t window;
+	/* A bitmap of the compression schemes the device can decode. */
+	uint8_t compression;
+	/* A checksum of the device's standard module table. */
+	lf_crc_t modules;
+};
+
 /* Standardizes a way to obtain the name, version, and attributes of a Flipper device. */
 struct LF_PACKED _lf_configuration {
 	/* The human readable name of the device. */
@@ -95,8 +113,18 @@ struct LF_PACKED _lf_configuration {
 	lf_version_t version;
 	/* The attributes of the device. 3 (attach by default), 2:1 (word length), 0 (endianness) */
 	uint8_t attributes;
+	/* The message runtime features supported by the device. Zero if the device could not be asked. */
+	struct _lf_capabilities capabilities;
 };
 
+/* Returns whether a device's configuration reports support for a packet class. */
+#define lf_supports(device, class) ((device)->configuration.capabilities.classes & (1UL << (class)))
+
+/* The configuration that a device reports to the host. Defined by each platform. */
+extern const struct _lf_configuration lf_configuration;
+
+struct _lf_module;
+
 /* Describes a device capible of responding to FMR packets. */
 struct _lf_device {
 	struct _lf_configuration configuration;
@@ -104,10 +132,16 @@ struct _lf_device {
 	struct _lf_endpoint *endpoint;
 	/* The device's selector function. Mutates modules state as appropriate for the device. */
 	int (* select)(struct _lf_device *device);
+	/* The device's router, if any. Resolves the device and module index that service a function of a module. */
+	struct _lf_device *(* route)(struct _lf_device *device, struct _lf_module *module, lf_function function, int *index);
+	/* The device's synchronizer, if any. Reports the errors latched by each of the chips that compose the device. */
+	int (* sync)(struct _lf_device *device);
 	/* The device's destructor. */
 	int (* destroy)(struct _lf_device *device);
 	/* The device's context. */
 	void *_ctx;
+	/* The largest packet that the device and its endpoint have agreed to exchange. */
+	lf_size_t packet_size;
 	/* The current error state of the device. */
 	lf_error_t error;
 };
@@ -158,6 +192,39 @@ struct _lf_module {
 
 #define LF_MODULE_SET_DEVICE_AND_ID(module, _device, _id) do { module.device = _device; module.index = _id; } while (0);
 
+/* A handle to a buffer that resides in the address space of a device, and persists across calls. */
+struct _lf_remote {
+	/* The device on which the buffer was allocated. */
+	struct _lf_device *device;
+	/* The address of the buffer on the device. */
+	uint64_t address;
+	/* The size of the buffer in bytes. */
+	lf_size_t size;
+};
+
+/* Gives the 'lf_arg' for an offset into a remote buffer, to be passed as a pointer argument of an invocation. */
+#define lf_remote_ptr(remote, offset) lf_intx(lf_ptr_t, (remote)->address + (offset))
+
+/* A script of calls, assembled on the host and performed by a device without a round trip per call. */
+struct _lf_script {
+	/* The device that performs the script. */
+	struct _lf_device *device;
+	/* The number of calls made by the script. */
+	int calls;
+	/* The number of bytes of code assembled. */
+	lf_size_t length;
+	/* The code of the script. */
+	uint8_t code[FMR_MAX_PACKET_SIZE - sizeof(struct _fmr_header)];
+};
+
+/* A handle to a job that a device performs periodically on behalf of the host. */
+struct _lf_job {
+	/* The device performing the job. */
+	struct _lf_device *device;
+	/* The index of the job on the device. */
+	uint8_t id;
+};
+
 struct _lf_device *lf_device_create(struct _lf_endpoint *endpoint, int (* select)(struct _lf_device *device), int (* destroy)(struct _lf_device *device), size_t context_size);
 int lf_device_release(struct _lf_device *device);
 
@@ -166,21 +233,75 @@ int lf_attach(struct _lf_device *device);
 int lf_detach(struct _lf_device *device);
 int lf_select(struct _lf_device *device);
 
-#include <flipper/fmr.h>
 #include <flipper/endpoint.h>
 #include <flipper/ll.h>
 
-/* Performs a remote procedure call to a module's function. */
+/* Returns the size of the packets exchanged with the device. */
+lf_size_t lf_packet_size(struct _lf_device *device);
+/* Resolves the device and module index that will service a call to a module's function. */
+struct _lf_device *lf_route(struct _lf_module *module, lf_function function, int *index);
+/* Performs a remote procedure call to a module's function. Any buffers passed to it are marshalled within the same transaction. */
 lf_return_t lf_invoke(struct _lf_module *module, lf_function function, lf_type ret, struct _lf_ll *args);
-/* Moves data from the address space of the host to that of the device. */
+/* Performs a remote procedure call in a single transaction, marshalling its buffers to and from the device.
+   The full return value is written to 'value', which may be NULL, so that 64 bit values are returned without truncation.
+   The call and its in buffers must fit within one packet of the device, as must the reply and its out buffers; larger
+   buffers are moved with 'lf_push' and 'lf_pull'. The device must report 'FMR_INLINE_CAPABILITY' among its classes. */
+lf_return_t lf_invoke_into(struct _lf_module *module, lf_function function, lf_type ret, struct _lf_ll *args, lf_arg *value);
+/* Reports any error raised by the invocations that were sent to the device without waiting for a reply. */
+int lf_sync(struct _lf_device *device);
+/* Allocates a buffer of the given size on the device. */
+struct _lf_remote *lf_remote_alloc(struct _lf_device *device, lf_size_t size);
+/* Writes data into a remote buffer at the given offset. */
+int lf_remote_write(struct _lf_remote *remote, lf_size_t offset, void *source, lf_size_t length);
+/* Reads data out of a remote buffer from the given offset. */
+int lf_remote_read(struct _lf_remote *remote, lf_size_t offset, void *destination, lf_size_t length);
+/* Frees a remote buffer and releases its handle. */
+int lf_remote_free(struct _lf_remote *remote);
+/* Creates an empty script to be performed by the device. */
+struct _lf_script *lf_script_create(struct _lf_device *device);
+/* Releases a script. */
+void lf_script_release(struct _lf_script *script);
+/* Appends a call to the script, storing its return value in a register. Each argument whose bit is set in the sources gives the register to pass instead. */
+int lf_script_invoke(struct _lf_script *script, uint8_t reg, struct _lf_module *module, lf_function function, lf_type ret, uint16_t sources, struct _lf_ll *args);
+/* Appends instructions that load, mask, and add to a register. */
+int lf_script_load(struct _lf_script *script, uint8_t reg, lf_return_t value);
+int lf_script_and(struct _lf_script *script, uint8_t reg, lf_return_t value);
+int lf_script_add(struct _lf_script *script, uint8_t reg, lf_return_t value);
+/* Gives the offset of the next instruction, to be used as the target of a branch or loop. */
+lf_size_t lf_script_label(struct _lf_script *script);
+/* Appends a conditional branch to the target, returning its offset so that a forward target can be resolved later. */
+int lf_script_branch(struct _lf_script *script, uint8_t reg, uint8_t condition, lf_return_t value, lf_size_t target);
+/* Sets the target of a branch to the next instruction. */
+int lf_script_resolve(struct _lf_script *script, int branch);
+/* Appends a loop that decrements a register and jumps to the target until it reaches zero. */
+int lf_script_loop(struct _lf_script *script, uint8_t reg, lf_size_t target);
+/* Appends an instruction that ends the script with the value of a register. */
+int lf_script_return(struct _lf_script *script, uint8_t reg);
+/* Performs the script on its device, returning its result. */
+lf_return_t lf_script_run(struct _lf_script *script);
+/* Starts a job that performs a call every period given in microseconds, keeping its return values on the device. */
+struct _lf_job *lf_job_start(struct _lf_module *module, lf_function function, lf_type ret, struct _lf_ll *args, uint32_t period);
+/* Stops a job and releases its handle. Samples already taken remain to be drained. */
+int lf_job_stop(struct _lf_job *job);
+/* Drains up to 'max' samples taken by the jobs of a device, returning their number. */
+int lf_job_drain(struct _lf_device *device, struct _fmr_sample *samples, lf_size_t max);
+/* Moves data from the address space of the host to that of the device, calling the function once with all of it.
+   Transfers larger than LF_SEGMENT_SIZE hold the device through the bulk lane for their whole length, so control transactions
+   wait behind them. Only functions that must see the whole buffer at once should be called this way. */
 lf_return_t lf_push(struct _lf_module *module, lf_function function, void *source, lf_size_t length, struct _lf_ll *args);
-/* Moves data from the address space of the device to that of the host. */
+/* Moves data from the address space of the device to that of the host, calling the function once like 'lf_push'. */
 lf_return_t lf_pull(struct _lf_module *module, lf_function function, void *destination, lf_size_t length, struct _lf_ll *args);
+/* Pushes data a segment of at most LF_SEGMENT_SIZE bytes at a time, calling the function once for each segment so that control
+   transactions are performed between them. Suited to functions that consume a stream, such as those of a serial port.
+   Stops at the first segment that fails, and otherwise returns the value of the last. An empty push calls the function once. */
+lf_return_t lf_push_segments(struct _lf_module *module, lf_function function, void *source, lf_size_t length, struct _lf_ll *args);
+/* Pulls data a segment at a time, like 'lf_push_segments'. */
+lf_return_t lf_pull_segments(struct _lf_module *module, lf_function function, void *destination, lf_size_t length, struct _lf_ll *args);
 
 /* Closes the library. */
 int lf_exit(void);
 
-/* Load the device's configuration information. */
+/* Loads and caches the configuration of a device. Firmware that cannot report its configuration is given the capabilities of firmware that predates it. */
 int lf_load_configuration(struct _lf_device *device);
 /* Provides a checksum for a given block of data. */
 lf_crc_t lf_crc(const void *source, size_t length);
@@ -191,6 +312,9 @@ int lf_get_result(struct _lf_device *device, struct _fmr_result *result);
 int lf_transfer(struct _lf_device *device, struct _fmr_packet *packet);
 /* Retrieves a packet from the specified device. */
 int lf_retrieve(struct _lf_device *device, struct _fmr_result *response);
+/* Obtains the description of the standard module at the given index of the device's module table. */
+int lf_describe(struct _lf_device *device, uint8_t index, lf_return_t *description);
+int lf_negotiate(struct _lf_device *device);
 /* Binds a module structure to its device counterpart. */
 int lf_bind(struct _lf_module *module, struct _lf_device *device);
 
@@ -0,0 +1,64 @@
+#ifndef __lf_ring_h__
+#define __lf_ring_h__
+
+/* Include all types exposed by libflipper. */
+#include <flipper/types.h>
+
+/*
+ * A single producer, single consumer byte ring. The producer only ever writes
+ * the head and the consumer only ever writes the tail, and both indices are a
+ * single byte wide, so an interrupt handler and the main loop can share a ring
+ * without disabling interrupts. One slot is always left empty to distinguish a
+ * full ring from an empty one, so a ring of size N holds N - 1 bytes.
+ */
+struct _lf_ring {
+	/* The storage for the ring. Its size must be a power of two, no larger than 256. */
+	volatile uint8_t *buffer;
+	/* The size of the storage minus one. */
+	uint8_t mask;
+	/* The index at which the producer writes the next byte. */
+	volatile uint8_t head;
+	/* The index from which the consumer reads the next byte. */
+	volatile uint8_t tail;
+};
+
+/* Defines a ring named 'symbol' along with its storage. */
+#define LF_RING(symbol, size) \
+	static volatile uint8_t symbol##_storage[size]; \
+	struct _lf_ring symbol = { symbol##_storage, (uint8_t)((size) - 1), 0, 0 };
+
+/* Returns the number of bytes held in the ring. */
+static inline uint8_t lf_ring_count(const struct _lf_ring *ring) {
+	return (uint8_t)(ring->head - ring->tail) & ring->mask;
+}
+
+/* Returns whether the ring holds no bytes. */
+static inline bool lf_ring_empty(const struct _lf_ring *ring) {
+	return ring->head == ring->tail;
+}
+
+/* Returns whether the ring can accept no more bytes. */
+static inline bool lf_ring_full(const struct _lf_ring *ring) {
+	return (uint8_t)((ring->head + 1) & ring->mask) == ring->tail;
+}
+
+/* Appends a byte to the ring. Must only be called by the producer. Returns false if the ring is full. */
+static inline bool lf_ring_put(struct _lf_ring *ring, uint8_t byte) {
+	uint8_t head = ring->head;
+	uint8_t next = (head + 1) & ring->mask;
+	if (next == ring->tail) return false;
+	ring->buffer[head] = byte;
+	ring->head = next;
+	return true;
+}
+
+/* Removes a byte from the ring. Must only be called by the consumer. Returns false if the ring is empty. */
+static inline bool lf_ring_get(struct _lf_ring *ring, uint8_t *byte) {
+	uint8_t tail = ring->tail;
+	if (tail == ring->head) return false;
+	*byte = ring->buffer[tail];
+	ring->tail = (tail + 1) & ring->mask;
+	return true;
+}
+
+#endif
@@ -12,16 +12,22 @@ extern const struct _task_interface {
 	int (* resume)(int pid);
 	/* Stops the running task. */
 	int (* stop)(int pid);
+	/* Sets the priority of a task. Higher priorities run first. */
+	int (* priority)(int pid, int priority);
+	/* Gives the most bytes of its stack that a task has used. */
+	int (* stack)(int pid);
 } task;
 
 /* Declare the _lf_module structure for this module. */
 extern struct _lf_module _task;
 
 /* Declare the FMR overlay for this module. */
-enum { _task_pause, _task_resume, _task_stop };
+enum { _task_pause, _task_resume, _task_stop, _task_priority, _task_stack };
 
 int os_task_pause(int pid);
 int os_task_resume(int pid);
 int os_task_stop(int pid);
+int os_task_priority(int pid, int priority);
+int os_task_stack(int pid);
 
 #endif
@@ -7,15 +7,22 @@
 /* Declare the virtual interface for this module. */
 extern const struct _timer_interface {
 	int (* configure)(void);
+	/* Calls a function of the device with the given parameter after a delay, and then every period if the period is not zero. Times are in microseconds.
+	   Gives an identifier for the timer, with which it is stopped. */
+	int (* start)(void *callback, void *ctx, uint32_t delay, uint32_t period);
+	/* Stops a timer. Timers that expire once are stopped once they have expired. */
+	int (* stop)(int id);
 } timer;
 
 /* Declare the _lf_module structure for this module. */
 extern struct _lf_module _timer;
 
 /* Declare the FMR overlay for this module. */
-enum { _timer_configure };
+enum { _timer_configure, _timer_start, _timer_stop };
 
 /* Declare the prototypes for all of the functions within this module. */
 int timer_configure(void);
+int timer_start(void *callback, void *ctx, uint32_t delay, uint32_t period);
+int timer_stop(int id);
 
 #endif
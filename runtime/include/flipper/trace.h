@@ -0,0 +1,66 @@
+#ifndef __trace_h__
+#define __trace_h__
+
+/* Include all types and macros exposed by the Flipper Toolbox. */
+#include <flipper.h>
+
+/* The kinds of events recorded by a device's trace. Each is enabled by its bit in the mask given to 'trace.enable'. */
+enum {
+	/* A slot of the trace that holds no event. */
+	lf_trace_none,
+	/* The running task switched to the task whose PID is the argument. */
+	lf_trace_switch,
+	/* An interrupt began or finished being serviced. */
+	lf_trace_isr_enter,
+	lf_trace_isr_exit,
+	/* A packet of the class given by the argument was received. */
+	lf_trace_receive,
+	/* A packet of the class given by the argument began being performed. */
+	lf_trace_execute,
+	/* The result of the packet being performed was sent. */
+	lf_trace_respond,
+	/* A block of the size given by the argument was allocated or freed. */
+	lf_trace_alloc,
+	lf_trace_free
+};
+
+/* Enables every kind of event. */
+#define LF_TRACE_ALL UINT32_MAX
+
+/* An event recorded by a device's trace. */
+struct _trace_event {
+	/* The clock cycle at which the event was recorded. The count wraps, so it only orders events that are close in time. */
+	uint32_t cycles;
+	/* The position of the event in the trace. A gap marks events that were overwritten before they were read. */
+	uint32_t sequence;
+	/* The argument of the event, which depends on its kind. */
+	uint32_t arg;
+	/* The PID of the task that was running when the event was recorded, or UINT16_MAX if none was. */
+	uint16_t task;
+	/* The kind of the event. */
+	uint8_t kind;
+	/* The exception being serviced when the event was recorded, or zero if a task was running. */
+	uint8_t exception;
+};
+
+/* Declare the virtual interface for this module. */
+extern const struct _trace_interface {
+	/* Records the kinds of events whose bits are set in the mask. Starting a trace discards the events left from the last one. */
+	int (* enable)(uint32_t mask);
+	/* Moves the oldest events into the buffer, giving the number moved. Slots of the buffer left over hold no event. */
+	int (* read)(void *destination, lf_size_t length);
+	/* Gives the frequency in hertz of the clock that times the events. */
+	uint32_t (* frequency)(void);
+} trace;
+
+/* Declare the _lf_module structure for this module. */
+extern struct _lf_module _trace;
+
+/* Declare the FMR overlay for this module. */
+enum { _trace_enable, _trace_read, _trace_frequency };
+
+int os_trace_enable(uint32_t mask);
+int os_trace_read(void *destination, lf_size_t length);
+uint32_t os_trace_frequency(void);
+
+#endif
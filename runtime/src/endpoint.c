@@ -15,8 +15,10 @@ struct _lf_endpoint *lf_endpoint_create(int (* configure)(struct _lf_endpoint *e
 	endpoint->push = push;
 	endpoint->pull = pull;
 	endpoint->destroy = destroy;
+	endpoint->packet_size = FMR_PACKET_SIZE;
 	endpoint->_ctx = calloc(1, ctx_size);
 	lf_assert(endpoint->_ctx, failure, E_MALLOC, "Failed to allocate the memory needed to create an endpoint context.");
+	endpoint->lanes = lf_lanes_create();
 	return endpoint;
 failure:
 	return NULL;
@@ -45,8 +47,25 @@ void lf_endpoint_poll(struct _lf_endpoint *endpoint) {
 int lf_endpoint_release(struct _lf_endpoint *endpoint) {
 	if (endpoint) {
 		if (endpoint->destroy) endpoint->destroy(endpoint);
+		lf_lanes_release(endpoint->lanes);
 		free(endpoint->_ctx);
 		free(endpoint);
 	}
 	return lf_success;
 }
+
+/* Platforms without threads have only one transaction in flight, so their lanes need no arbitration. */
+
+LF_WEAK void *lf_lanes_create(void) {
+	return NULL;
+}
+
+LF_WEAK void lf_lanes_release(void *lanes) {
+}
+
+LF_WEAK int lf_lane_acquire(struct _lf_endpoint *endpoint, int lane) {
+	return lf_success;
+}
+
+LF_WEAK void lf_lane_release(struct _lf_endpoint *endpoint) {
+}
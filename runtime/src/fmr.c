@@ -5,6 +5,7 @@ struct _lf_arg *lf_arg_create(lf_type type, lf_arg value) {
 	lf_assert(arg, failure, E_MALLOC, "Failed to allocate new lf_arg.");
 	arg->type = type;
 	arg->value = value;
+	arg->buffer = NULL;
 	return arg;
 failure:
 	return NULL;
@@ -15,7 +16,7 @@ void lf_arg_release(struct _lf_arg *arg) {
 }
 
 struct _lf_ll *fmr_build(int argc, ...) {
-	lf_assert(argc < FMR_MAX_ARGC, failure, E_OVERFLOW, "Too many arguments were provided when building (%i) call.", argc);
+	lf_assert(argc <= FMR_MAX_ARGC, failure, E_OVERFLOW, "Too many arguments were provided when building (%i) call.", argc);
 	struct _lf_ll *list = NULL;
 	/* Construct a va_list to access variadic arguments. */
 	va_list argv;
@@ -27,8 +28,17 @@ struct _lf_ll *fmr_build(int argc, ...) {
 		int type = va_arg(argv, int);
 		lf_arg value = va_arg(argv, lf_arg);
 		lf_assert(type <= lf_max_t, failure, E_TYPE, "An invalid type was provided while appending the parameter '%llx' with type '%x' to the argument list.", value, type);
-		struct _lf_arg *arg = lf_arg_create(type, value);
-		lf_assert(arg, failure, E_MALLOC, "Failed to append new lf_arg.");
+		struct _lf_arg *arg;
+		if (lf_is_buffer(type)) {
+			/* Buffers are described by their address and length, and are passed by the length alone. */
+			struct _lf_buffer *buffer = (struct _lf_buffer *)(uintptr_t)value;
+			arg = lf_arg_create(type, buffer->length);
+			lf_assert(arg, failure, E_MALLOC, "Failed to append new lf_arg.");
+			arg->buffer = buffer->data;
+		} else {
+			arg = lf_arg_create(type, value);
+			lf_assert(arg, failure, E_MALLOC, "Failed to append new lf_arg.");
+		}
 		lf_ll_append(&list, arg, lf_arg_release);
 	}
 	va_end(argv);
@@ -39,32 +49,120 @@ failure:
 	return NULL;
 }
 
-int lf_create_call(lf_module module, lf_function function, lf_type ret, struct _lf_ll *args, struct _fmr_header *header, struct _fmr_invocation *call) {
+/* Gives whether values of a type are zigzag encoded. */
+#define fmr_zigzag(type) (!lf_is_buffer(type) && ((type) == lf_int_t || ((type) & (1 << 3))))
+
+uint8_t fmr_encode_arg(lf_type type, lf_arg value, uint8_t *data) {
+	if (type == lf_ptr_t) {
+		memcpy(data, &value, sizeof(lf_arg));
+		return sizeof(lf_arg);
+	}
+	/* Extend the sign of the value to 64 bits, then interleave negative and positive values. */
+	if (fmr_zigzag(type)) {
+		uint8_t shift = 64 - lf_sizeof(type) * 8;
+		int64_t signed_value = (int64_t)(value << shift) >> shift;
+		value = ((uint64_t)signed_value << 1) ^ (uint64_t)(signed_value >> 63);
+	} else if (lf_sizeof(type) < (int)sizeof(lf_arg)) {
+		value &= ((lf_arg)1 << (lf_sizeof(type) * 8)) - 1;
+	}
+	uint8_t size = 0;
+	do {
+		uint8_t byte = value & 0x7F;
+		value >>= 7;
+		data[size ++] = (value) ? (byte | 0x80) : byte;
+	} while (value);
+	return size;
+}
+
+uint8_t fmr_decode_arg(lf_type type, const uint8_t *data, lf_size_t length, lf_arg *value) {
+	if (type == lf_ptr_t) {
+		if (length < sizeof(lf_arg)) return 0;
+		memcpy(value, data, sizeof(lf_arg));
+		return sizeof(lf_arg);
+	}
+	lf_arg decoded = 0;
+	uint8_t size = 0;
+	do {
+		if (size >= length) return 0;
+		decoded |= (lf_arg)(data[size] & 0x7F) << (size * 7);
+	} while (data[size ++] & 0x80 && size < FMR_MAX_ARG_SIZE);
+	if (fmr_zigzag(type)) decoded = (decoded >> 1) ^ -(decoded & 1);
+	*value = decoded;
+	return size;
+}
+
+int fmr_callable(uint8_t attributes, uint32_t classes, lf_argc argc, lf_types argt) {
+	/* The U2's 'fmr_call' passes its arguments only within registers, which run out before FMR_MAX_ARGC. */
+	uint8_t registers = FMR_8BIT_ARG_REGISTERS;
+	lf_assert(!(attributes & lf_device_8bit) || argc <= FMR_8BIT_MAX_ARGC, failure, E_OVERFLOW, "An 8-bit device cannot pass %i arguments, only %i.", argc, FMR_8BIT_MAX_ARGC);
+	for (lf_argc i = 0; i < argc; i ++) {
+		lf_type type = (argt >> (i * 4)) & lf_max_t;
+		/* Buffers are passed as pointers to them. */
+		if (lf_is_buffer(type)) type = lf_ptr_t;
+		lf_assert((type & 0x7) != 7 || (classes & FMR_WIDE_CAPABILITY), failure, E_TYPE, "The device cannot pass argument %i, which is 64 bits wide.", i);
+		if (attributes & lf_device_8bit) {
+			/* Ints and pointers are 16 bits wide on 8-bit devices. */
+			uint8_t bytes = (type == lf_int_t || type == lf_ptr_t) ? 2 : lf_ceiling(lf_sizeof(type), 2) * 2;
+			lf_assert(bytes <= registers, failure, E_OVERFLOW, "The arguments of the call do not fit within the %i bytes of registers an 8-bit device passes them in.", FMR_8BIT_ARG_REGISTERS);
+			registers -= bytes;
+		}
+	}
+	return lf_success;
+failure:
+	return lf_error;
+}
+
+int lf_create_call(lf_module module, lf_function function, lf_type ret, struct _lf_ll *args, struct _fmr_header *header, struct _fmr_invocation *call, lf_size_t size, const struct _lf_configuration *configuration) {
 	lf_assert(header, failure, E_NULL, "NULL header passed to '%s'.", __PRETTY_FUNCTION__);
 	lf_assert(call, failure, E_NULL, "NULL call passed to '%s'.", __PRETTY_FUNCTION__);
 	/* Store the target module, function, and argument count in the packet. */
 	size_t argc = lf_ll_count(args);
+	lf_assert(argc <= FMR_MAX_ARGC, failure, E_OVERFLOW, "Too many arguments (%i) were provided to the call.", (int)argc);
 	call->index = module;
 	call->function = function;
 	call->ret = ret;
 	call->argc = argc;
+	/* The types of the arguments precede their values. */
+	lf_assert(header->length + fmr_types_size(argc) <= size, failure, E_FMR_OVERFLOW, "The arguments of the call do not fit within a %i byte packet.", size);
+	memset(call->parameters, 0, fmr_types_size(argc));
+	header->length += fmr_types_size(argc);
 	/* Calculate the offset into the packet at which the arguments will be loaded. */
-	uint8_t *offset = (uint8_t *)&(call->parameters);
+	uint8_t *offset = fmr_arguments(call);
 	/* Load arguments into the packet, encoding the type of each. */
 	for (size_t i = 0; i < argc; i ++) {
 		/* Pop the argument from the argument list. */
 		struct _lf_arg *arg = lf_ll_item(args, i);
 		lf_assert(arg, failure, E_NULL, "Invalid argument supplied to '%s'.", __PRETTY_FUNCTION__);
 		/* Encode the argument's type. */
-		call->types |= (arg->type & lf_max_t) << (i * 4);
-		/* Calculate the size of the argument. */
-		uint8_t size = lf_sizeof(arg->type);
+		call->parameters[i / 2] |= (arg->type & lf_max_t) << ((i % 2) * 4);
+		/* Encode the argument aside, so that nothing is written beyond the packet. */
+		uint8_t encoded[FMR_MAX_ARG_SIZE];
+		uint8_t arg_size = fmr_encode_arg(arg->type, arg->value, encoded);
+		/* Ensure that the argument fits within the packet. */
+		lf_assert(header->length + arg_size <= size, failure, E_FMR_OVERFLOW, "The arguments of the call do not fit within a %i byte packet.", size);
 		/* Copy the argument into the parameter segment. */
-		memcpy(offset, &(arg->value), size);
+		memcpy(offset, encoded, arg_size);
 		/* Increment the offset appropriately. */
-		offset += size;
+		offset += arg_size;
 		/* Increment the size of the packet. */
-		header->length += size;
+		header->length += arg_size;
+	}
+	/* The contents of in and in-out buffers follow the arguments. */
+	for (size_t i = 0; i < argc; i ++) {
+		struct _lf_arg *arg = lf_ll_item(args, i);
+		if (arg->type != lf_in_t && arg->type != lf_inout_t) continue;
+		lf_assert(arg->buffer || !arg->value, failure, E_NULL, "No data was given for a buffer of %i bytes.", (int)arg->value);
+		lf_assert(header->length + arg->value <= size, failure, E_FMR_OVERFLOW, "The buffers of the call do not fit within a %i byte packet.", size);
+		memcpy(offset, arg->buffer, arg->value);
+		offset += arg->value;
+		header->length += arg->value;
+	}
+	/* Calls the device cannot pass are refused here, rather than by the device after they are sent. */
+	if (configuration) {
+		lf_types argt = 0;
+		for (lf_argc i = 0; i < fmr_types_size(argc); i ++) argt |= (lf_types)call->parameters[i] << (i * 8);
+		int _e = fmr_callable(configuration->attributes, configuration->capabilities.classes, argc, argt);
+		lf_assert(_e == lf_success, failure, lf_error_get(), "Device '%s' cannot pass the arguments of the call.", configuration->name);
 	}
 	lf_ll_release(&args);
 	return lf_success;
@@ -73,22 +171,246 @@ failure:
 	return lf_error;
 }
 
-lf_return_t fmr_execute(lf_module module, lf_function function, lf_type ret, lf_argc argc, lf_types argt, void *arguments) {
+int fmr_unpack(struct _fmr_invocation *call, lf_size_t length, lf_types *argt, void *argv, void *scratch, lf_size_t size) {
+	lf_assert(length >= sizeof(struct _fmr_invocation), failure, E_FMR_OVERFLOW, "The call is shorter than its header.");
+	lf_assert(call->argc <= FMR_MAX_ARGC, failure, E_OVERFLOW, "Too many arguments (%i) were passed to the call.", call->argc);
+	lf_assert(length >= sizeof(struct _fmr_invocation) + fmr_types_size(call->argc), failure, E_FMR_OVERFLOW, "The types of the call run past its end.");
+	/* Nothing is read from beyond the end of the call. */
+	const uint8_t *end = (const uint8_t *)call + length;
+	lf_types types = 0;
+	for (lf_argc i = 0; i < fmr_types_size(call->argc); i ++) {
+		types |= (lf_types)call->parameters[i] << (i * 8);
+	}
+	*argt = types;
+	const uint8_t *offset = fmr_arguments(call);
+	uint8_t *native = argv;
+	/* The buffers of the call are allocated from the scratch arena, and patched into their arguments once their data is found. */
+	uint8_t *buffers[FMR_MAX_ARGC];
+	lf_size_t used = 0;
+	for (lf_argc i = 0; i < call->argc; i ++) {
+		lf_type type = (types >> (i * 4)) & lf_max_t;
+		lf_arg value;
+		uint8_t consumed = fmr_decode_arg(type, offset, end - offset, &value);
+		lf_assert(consumed, failure, E_FMR_OVERFLOW, "The arguments of the call run past its end.");
+		offset += consumed;
+		if (lf_is_buffer(type)) {
+			lf_assert(scratch && value <= size - used, failure, E_OVERFLOW, "The buffers of the call do not fit within the scratch arena.");
+			lf_size_t bytes = value;
+			buffers[i] = (uint8_t *)scratch + used;
+			value = (uintptr_t)buffers[i];
+			/* Each buffer is aligned for any type it may hold. */
+			used += lf_ceiling(bytes, sizeof(lf_arg)) * sizeof(lf_arg);
+			if (used > size) used = size;
+			/* The callee is passed a pointer to the buffer. */
+			*argt = (*argt & ~((lf_types)lf_max_t << (i * 4))) | ((lf_types)lf_ptr_t << (i * 4));
+		}
+		/* Every platform is little endian, so the low bytes of the value are its native width. */
+		memcpy(native, &value, lf_sizeof(type));
+		native += lf_sizeof(type);
+	}
+	/* Copy the contents of the in and in-out buffers, which follow the arguments, into their storage. */
+	const uint8_t *data = fmr_arguments(call);
+	for (lf_argc i = 0; i < call->argc; i ++) {
+		lf_type type = (types >> (i * 4)) & lf_max_t;
+		lf_arg bytes;
+		data += fmr_decode_arg(type, data, end - data, &bytes);
+		if (type == lf_in_t || type == lf_inout_t) {
+			lf_assert(bytes <= (lf_arg)(end - offset), failure, E_FMR_OVERFLOW, "The buffers of the call run past its end.");
+			memcpy(buffers[i], offset, bytes);
+			offset += bytes;
+		}
+	}
+	return lf_success;
+failure:
+	return lf_error;
+}
+
+/* Performs a call to a standard module, giving its return value in full. */
+static lf_arg fmr_execute_call(struct _fmr_invocation *call, lf_size_t length, void *outs, lf_size_t size) {
 	/* Dereference the pointer to the target module. */
-	void *const *object = lf_modules[module];
+	void *const *object = lf_modules[call->index];
 	/* Dereference and return a pointer to the target function. */
-	void *address = object[function];
+	void *address = object[call->function];
 	/* Ensure that the function address is valid. */
 	lf_assert(address, failure, E_NULL, "NULL address supplied to '%s'.", __PRETTY_FUNCTION__);
+	/* Expand the arguments into the layout expected by the native calling convention. */
+	lf_types argt;
+	/* Packets are performed one at a time, and the arguments are consumed before the function is called, so their
+	   storage is kept off the stack, which on the U2 has little of its 1 KB of SRAM to spare. */
+	static uint8_t argv[FMR_MAX_ARGC * sizeof(lf_arg)];
+	int _e = fmr_unpack(call, length, &argt, argv, outs, size);
+	lf_assert(_e == lf_success, failure, E_OVERFLOW, "Failed to unpack the arguments of a call.");
+	/* Arguments this device's 'fmr_call' cannot pass raise an error, rather than making the call with whatever they leave behind. */
+	_e = fmr_callable(lf_configuration.attributes, FMR_SUPPORTED_CLASSES, call->argc, argt);
+	lf_assert(_e == lf_success, failure, lf_error_get(), "The device cannot pass the arguments of a call.");
 	/* Perform the function call internally. */
-	return fmr_call(address, ret, argc, argt, arguments);
+	return fmr_call(address, call->ret, call->argc, argt, argv);
+failure:
+	return (lf_return_t)lf_error;
+}
+
+lf_return_t fmr_execute(struct _fmr_invocation *call, lf_size_t length) {
+	return fmr_execute_call(call, length, NULL, 0);
+}
+
+lf_return_t fmr_describe(uint8_t index) {
+	/* Walk the descriptor table, ensuring that the index is within bounds. */
+	for (uint8_t i = 0; i < index; i ++) {
+		lf_assert(lf_module_descriptors[i].name, failure, E_BOUNDARY, "No module exists at index '%i'.", index);
+	}
+	const struct _fmr_module_descriptor *descriptor = &lf_module_descriptors[index];
+	lf_assert(descriptor->name, failure, E_BOUNDARY, "No module exists at index '%i'.", index);
+	/* The module's identifier is the checksum of its name, including the terminator. */
+	lf_crc_t identifier = lf_crc(descriptor->name, strlen(descriptor->name) + 1);
+	uint8_t attributes = descriptor->attributes;
+	if (!lf_module_descriptors[index + 1].name) attributes |= fmr_module_last;
+	return fmr_description(identifier, descriptor->functions, attributes);
 failure:
 	return lf_error;
 }
 
+lf_return_t fmr_negotiate(lf_size_t size) {
+	if (size > FMR_MAX_PACKET_SIZE) size = FMR_MAX_PACKET_SIZE;
+	if (size < FMR_PACKET_SIZE) size = FMR_PACKET_SIZE;
+	return size;
+}
+
+lf_crc_t fmr_module_hash(void) {
+	struct LF_PACKED { lf_crc_t hash; lf_crc_t identifier; uint8_t functions; uint8_t attributes; } link = { 0 };
+	/* Chain the checksum of each descriptor into the next, so that the order of the table matters. */
+	for (const struct _fmr_module_descriptor *descriptor = lf_module_descriptors; descriptor->name; descriptor ++) {
+		link.identifier = lf_crc(descriptor->name, strlen(descriptor->name) + 1);
+		link.functions = descriptor->functions;
+		link.attributes = descriptor->attributes;
+		link.hash = lf_crc(&link, sizeof(link));
+	}
+	return link.hash;
+}
+
+lf_return_t fmr_configuration(void) {
+	struct _lf_configuration configuration = lf_configuration;
+	configuration.identifier = lf_crc(configuration.name, strlen(configuration.name) + 1);
+	configuration.capabilities.packet_size = FMR_MAX_PACKET_SIZE;
+	configuration.capabilities.classes = FMR_SUPPORTED_CLASSES;
+	/* Packets are performed one at a time. */
+	configuration.capabilities.window = 1;
+	configuration.capabilities.compression = fmr_compression_none;
+	configuration.capabilities.modules = fmr_module_hash();
+	return fmr_reply(&configuration, sizeof(struct _lf_configuration));
+}
+
+lf_return_t fmr_malloc(lf_size_t size) {
+	/* The address is replied ahead of the result, as it may be wider than a return value. */
+	uint64_t address = (uintptr_t)malloc(size);
+	fmr_reply(&address, sizeof(uint64_t));
+	lf_assert(address, failure, E_MALLOC, "Failed to allocate a %i byte buffer for the host.", size);
+	return lf_success;
+failure:
+	return lf_error;
+}
+
+lf_return_t fmr_free(uint64_t address) {
+	free((void *)(uintptr_t)address);
+	return lf_success;
+}
+
+/* The first error raised by an invocation performed without a reply, reported by the next synchronous packet. */
+static lf_error_t fmr_deferred_error = E_OK;
+
+/* Gives the error to report for a synchronous packet, falling back to any error that was deferred. */
+static lf_error_t fmr_report(lf_error_t error) {
+	if (error == E_OK) {
+		error = fmr_deferred_error;
+		fmr_deferred_error = E_OK;
+	}
+	return error;
+}
+
+/* Latches the error raised by a packet performed without a reply. */
+static void fmr_defer(lf_error_t error) {
+	if (fmr_deferred_error == E_OK) fmr_deferred_error = error;
+}
+
+lf_return_t fmr_push_inline(struct _fmr_push_pull_packet *packet) {
+	/* The data occupies the end of the packet, following the parameters of the call. */
+	lf_assert(packet->header.length >= sizeof(struct _fmr_push_pull_packet), failure, E_FMR_OVERFLOW, "The inline push is shorter than its header.");
+	lf_assert(packet->length <= packet->header.length - sizeof(struct _fmr_push_pull_packet), failure, E_FMR_OVERFLOW, "The inline push is larger than its packet.");
+	lf_size_t length = fmr_length_from(packet, &packet->call);
+	lf_assert(packet->length <= length, failure, E_FMR_OVERFLOW, "The inline push overlaps the call.");
+	void *data = (uint8_t *)packet + packet->header.length - packet->length;
+	*(uint64_t *)fmr_arguments(&packet->call) = (uintptr_t)data;
+	return fmr_execute(&packet->call, length - packet->length);
+failure:
+	return lf_error;
+}
+
+lf_return_t fmr_pull_inline(struct _fmr_push_pull_packet *packet) {
+	/* The reply is the result, extended with the data that was pulled. */
+	uint8_t reply[FMR_MAX_PACKET_SIZE];
+	struct _fmr_result *result = (struct _fmr_result *)reply;
+	lf_size_t length = 0;
+	result->value = lf_error;
+	lf_assert(sizeof(struct _fmr_result) + packet->length <= sizeof(reply), failure, E_FMR_OVERFLOW, "The inline pull is larger than the reply can carry.");
+	length = packet->length;
+	*(uint64_t *)fmr_arguments(&packet->call) = (uintptr_t)(reply + sizeof(struct _fmr_result));
+	result->value = fmr_execute(&packet->call, fmr_length_from(packet, &packet->call));
+failure:
+	result->error = fmr_report(lf_error_get());
+	fmr_reply(reply, sizeof(struct _fmr_result) + length);
+	return result->value;
+}
+
+/* The arena from which the buffers of an invocation are allocated. */
+static lf_arg fmr_scratch[FMR_MAX_PACKET_SIZE / sizeof(lf_arg)];
+
+lf_return_t fmr_execute_inline(struct _fmr_invocation *call, lf_size_t length) {
+	/* The reply is the result, extended with the full return value and then the out and in-out buffers. */
+	uint8_t reply[sizeof(struct _fmr_result) + sizeof(lf_arg) + FMR_MAX_PACKET_SIZE];
+	struct _fmr_result *result = (struct _fmr_result *)reply;
+	lf_size_t replied = sizeof(struct _fmr_result);
+	memset(fmr_scratch, 0, sizeof(fmr_scratch));
+	lf_arg value = fmr_execute_call(call, length, fmr_scratch, sizeof(fmr_scratch));
+	result->value = value;
+	if (lf_wide(call->ret)) {
+		memcpy(&reply[replied], &value, sizeof(lf_arg));
+		replied += sizeof(lf_arg);
+	}
+	/* Pack the buffers that are returned into the reply, in the order of their arguments. */
+	const uint8_t *encoded = fmr_arguments(call);
+	const uint8_t *end = (const uint8_t *)call + length;
+	lf_size_t offset = 0;
+	for (lf_argc i = 0; i < call->argc && i < FMR_MAX_ARGC && encoded < end; i ++) {
+		lf_type type = (call->parameters[i / 2] >> ((i % 2) * 4)) & lf_max_t;
+		lf_arg size;
+		uint8_t consumed = fmr_decode_arg(type, encoded, end - encoded, &size);
+		/* Arguments that could not be decoded have already raised an error. */
+		if (!consumed) break;
+		encoded += consumed;
+		if (!lf_is_buffer(type)) continue;
+		/* Storage that could not be given to the call has already raised an error. */
+		if (size > sizeof(fmr_scratch) - offset) break;
+		if (type != lf_in_t) {
+			memcpy(&reply[replied], (uint8_t *)fmr_scratch + offset, size);
+			replied += size;
+		}
+		offset += lf_ceiling(size, sizeof(lf_arg)) * sizeof(lf_arg);
+		if (offset > sizeof(fmr_scratch)) offset = sizeof(fmr_scratch);
+	}
+	result->error = fmr_report(lf_error_get());
+	fmr_reply(reply, replied);
+	return result->value;
+}
+
 /* ~ Message runtime subclass handlers. ~ */
 
-LF_WEAK lf_return_t fmr_perform_user_invocation(struct _fmr_invocation *invocation, struct _fmr_result *result) {
+/* Decodes the only parameter of a call 'length' bytes long, giving zero if it runs past the end of the call. */
+static uint8_t fmr_decode_parameter(struct _fmr_invocation *call, lf_size_t length, lf_type type, lf_arg *value) {
+	lf_size_t offset = fmr_arguments(call) - (uint8_t *)call;
+	if (length <= offset) return 0;
+	return fmr_decode_arg(type, fmr_arguments(call), length - offset, value);
+}
+
+LF_WEAK lf_return_t fmr_perform_user_invocation(struct _fmr_invocation *invocation, lf_size_t length, struct _fmr_result *result) {
 	printf("User invocation requested.\n");
 	return lf_error;
 }
@@ -97,6 +419,9 @@ int fmr_perform(struct _fmr_packet *packet, struct _fmr_result *result) {
 	/* Check that the magic number matches. */
 	lf_assert(packet->header.magic == FMR_MAGIC_NUMBER, failure, E_CHECKSUM, "Invalid magic number.");
 
+	/* Ensure the packet fits within the largest packet the device can receive. */
+	lf_assert(packet->header.length <= FMR_MAX_PACKET_SIZE, failure, E_FMR_OVERFLOW, "The packet is larger than the device can receive.");
+
 	/* Ensure the packet's checksums match. */
 	lf_crc_t _crc = packet->header.checksum;
 	packet->header.checksum = 0x00;
@@ -105,34 +430,107 @@ int fmr_perform(struct _fmr_packet *packet, struct _fmr_result *result) {
 
 	/* Cast the incoming packet to the different packet structures for subclass handling. */
 	struct _fmr_invocation *call = &((struct _fmr_invocation_packet *)packet)->call;
+	/* The number of bytes of the packet from the call to its end, beyond which nothing is decoded. */
+	lf_size_t length = fmr_length_from(packet, call);
+	lf_arg parameter;
+
+	/* Refuse the classes this runtime does not report, so that the host's view of the device holds. */
+	uint8_t class = fmr_packet_class(packet->header.type);
+	lf_assert(class < 31 && (FMR_SUPPORTED_CLASSES & (1UL << class)), failure, E_SUBCLASS, "The packet class '%i' is not performed by this device.", class);
 
 	/* Switch through the packet subclasses and invoke the appropriate handler for each. */
-	switch (packet->header.type) {
+	switch (class) {
 		case fmr_standard_invocation_class:
-			result->value = fmr_execute(call->index, call->function, call->ret, call->argc, call->types, call->parameters);
+			if (packet->header.type == (fmr_standard_invocation_class | fmr_inline_flag)) {
+				/* Wide return values and buffers are returned within the reply, which carries the result. */
+				result->value = fmr_execute_inline(call, length);
+				return FMR_REPLIED;
+			}
+			result->value = fmr_execute(call, length);
 		break;
 		case fmr_user_invocation_class:
-			result->value = fmr_perform_user_invocation(call, result);
+			result->value = fmr_perform_user_invocation(call, length, result);
 		break;
 		case fmr_ram_load_class:
 		case fmr_send_class:
 		case fmr_push_class:
-			result->value = fmr_push((struct _fmr_push_pull_packet *)(packet));
+			if (packet->header.type == (fmr_push_class | fmr_inline_flag)) {
+				/* Small pushes carry their data within the packet. */
+				result->value = fmr_push_inline((struct _fmr_push_pull_packet *)(packet));
+			} else {
+				result->value = fmr_push((struct _fmr_push_pull_packet *)(packet));
+			}
 		break;
 		case fmr_receive_class:
 		case fmr_pull_class:
+			if (packet->header.type == (fmr_pull_class | fmr_inline_flag)) {
+				/* Small pulls return their data within the reply, which carries the result. */
+				result->value = fmr_pull_inline((struct _fmr_push_pull_packet *)(packet));
+				return FMR_REPLIED;
+			}
 			result->value = fmr_pull((struct _fmr_push_pull_packet *)(packet));
 		break;
 		case fmr_event_class:
 		break;
+		case fmr_describe_class:
+			result->value = fmr_describe(call->index);
+		break;
+		case fmr_negotiate_class:
+			/* The size proposed by the host is the call's only parameter. */
+			lf_assert(fmr_decode_parameter(call, length, lf_uint32_t, &parameter), failure, E_FMR_OVERFLOW, "The size proposed runs past the end of the packet.");
+			result->value = fmr_negotiate(parameter);
+		break;
+		case fmr_configuration_class:
+			result->value = fmr_configuration();
+		break;
+		case fmr_sync_class:
+			/* Any deferred error is reported below. */
+			result->value = lf_success;
+		break;
+		case fmr_malloc_class:
+			/* The size of the buffer is the call's only parameter. */
+			lf_assert(fmr_decode_parameter(call, length, lf_uint32_t, &parameter), failure, E_FMR_OVERFLOW, "The size of the buffer runs past the end of the packet.");
+			result->value = fmr_malloc(parameter);
+		break;
+		case fmr_free_class:
+			/* The address of the buffer is the call's only parameter. */
+			lf_assert(fmr_decode_parameter(call, length, lf_ptr_t, &parameter), failure, E_FMR_OVERFLOW, "The address of the buffer runs past the end of the packet.");
+			result->value = fmr_free(parameter);
+		break;
+		case fmr_script_class:
+			/* The script extends from the header to the end of the packet. */
+			lf_assert(packet->header.length >= sizeof(struct _fmr_header), failure, E_FMR_OVERFLOW, "The script packet is shorter than its header.");
+			result->value = fmr_script(((struct _fmr_script_packet *)packet)->code, packet->header.length - sizeof(struct _fmr_header));
+		break;
+		case fmr_job_class:
+			result->value = fmr_job((struct _fmr_job_packet *)(packet));
+		break;
+		case fmr_drain_class: {
+			/* The largest number of samples the host will accept is the call's only parameter. */
+			lf_assert(fmr_decode_parameter(call, length, lf_uint32_t, &parameter), failure, E_FMR_OVERFLOW, "The number of samples runs past the end of the packet.");
+			struct _fmr_sample *samples;
+			result->value = fmr_drain(parameter, &samples);
+			/* The samples follow the result, which gives their number. */
+			result->error = fmr_report(lf_error_get());
+			fmr_reply(result, sizeof(struct _fmr_result));
+			if (result->value) fmr_reply(samples, result->value * sizeof(struct _fmr_sample));
+		} return FMR_REPLIED;
 		default:
-			lf_assert(true, failure, E_SUBCLASS, "An invalid message runtime subclass was provided.");
+			lf_assert(false, failure, E_SUBCLASS, "An invalid message runtime subclass was provided.");
 		break;
 	}
 
-	result->error = lf_error_get();
+	if (packet->header.type & fmr_no_reply_flag) {
+		fmr_defer(lf_error_get());
+		return FMR_REPLIED;
+	}
+	result->error = fmr_report(lf_error_get());
 	return lf_success;
 failure:
-	result->error = lf_error_get();
+	if (packet->header.type & fmr_no_reply_flag) {
+		fmr_defer(lf_error_get());
+		return FMR_REPLIED;
+	}
+	result->error = fmr_report(lf_error_get());
 	return lf_error;
 }
@@ -0,0 +1,16 @@
+#include <flipper/heap.h>
+
+#ifdef __use_heap__
+
+LF_MODULE(_heap, "heap", "Reports the usage of the device's heap.", NULL, NULL);
+
+/* Define the virtual interface for this module. */
+const struct _heap_interface heap = {
+	os_heap_stats
+};
+
+LF_WEAK int os_heap_stats(struct _heap_stats *stats) {
+	return lf_invoke(&_heap, _heap_stats, lf_int_t, lf_args(lf_out(stats, sizeof(struct _heap_stats))));
+}
+
+#endif
@@ -0,0 +1,259 @@
+#include <flipper.h>
+
+/* ~ Performs jobs on the device. ~ */
+
+/* A call performed periodically on behalf of the host. */
+struct _fmr_job {
+	/* The period of the job in microseconds, or zero if the job is not in use. */
+	volatile uint32_t period;
+	/* The time elapsed since the job was last performed. */
+	uint32_t elapsed;
+	/* The call performed by the job, followed by its parameters, and its length. */
+	uint8_t call[FMR_PACKET_SIZE];
+	lf_size_t length;
+};
+
+static struct _fmr_job fmr_jobs[FMR_MAX_JOBS];
+/* The interval between ticks of the job timer in microseconds. */
+static volatile uint32_t fmr_job_interval;
+/* The ticks of the job timer, and the ticks whose jobs have been performed. Each is written from one side only, so that neither needs a lock. */
+static volatile uint32_t fmr_job_ticked, fmr_job_performed;
+
+/* The ring of samples awaiting a drain. It is filled by the job timer and emptied by the host. */
+static struct _fmr_sample fmr_samples[FMR_JOB_SAMPLES];
+static volatile uint16_t fmr_sample_head, fmr_sample_tail;
+/* Whether samples were lost since the last sample was taken. */
+static bool fmr_sample_overrun;
+
+static uint32_t fmr_gcd(uint32_t a, uint32_t b) {
+	while (b) {
+		uint32_t t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+/* Ticks the job timer at the longest interval that divides the period of every job, so that each is performed on time. */
+static int fmr_job_retime(void) {
+	uint32_t period = 0;
+	for (int i = 0; i < FMR_MAX_JOBS; i ++) {
+		if (fmr_jobs[i].period) period = fmr_gcd(period, fmr_jobs[i].period);
+	}
+	/* Long intervals are counted out over several ticks, each of which must still divide the period of every job. */
+	uint32_t interval = (period > FMR_JOB_MAX_TICK) ? FMR_JOB_MAX_TICK : period;
+	while (interval >= FMR_JOB_MIN_PERIOD && period % interval) interval --;
+	lf_assert(!period || interval >= FMR_JOB_MIN_PERIOD, failure, E_TIMER, "The periods of the jobs cannot be counted out in ticks of at least %i microseconds.", FMR_JOB_MIN_PERIOD);
+	fmr_job_interval = interval;
+	return fmr_job_timer(interval);
+failure:
+	return lf_error;
+}
+
+static void fmr_sample_put(uint8_t job, lf_return_t value, lf_error_t error) {
+	uint16_t head = fmr_sample_head;
+	if ((uint16_t)(head - fmr_sample_tail) >= FMR_JOB_SAMPLES) {
+		fmr_sample_overrun = true;
+		return;
+	}
+	struct _fmr_sample *sample = &fmr_samples[head & (FMR_JOB_SAMPLES - 1)];
+	sample->job = (fmr_sample_overrun) ? (job | FMR_SAMPLE_OVERRUN) : job;
+	sample->value = value;
+	sample->error = error;
+	fmr_sample_overrun = false;
+	/* Publish the sample only once it is complete. */
+	fmr_sample_head = head + 1;
+}
+
+lf_return_t fmr_job(struct _fmr_job_packet *packet) {
+	if (!packet->period) {
+		lf_assert(packet->job < FMR_MAX_JOBS && fmr_jobs[packet->job].period, failure, E_BOUNDARY, "No job '%i' is running.", packet->job);
+		fmr_jobs[packet->job].period = 0;
+		return fmr_job_retime();
+	}
+	lf_assert(packet->period >= FMR_JOB_MIN_PERIOD, failure, E_TIMER, "A job cannot be performed every %i microseconds.", packet->period);
+	lf_size_t length = packet->header.length - offsetof(struct _fmr_job_packet, call);
+	lf_assert(packet->header.length >= sizeof(struct _fmr_job_packet) && length <= sizeof(fmr_jobs[0].call), failure, E_FMR_OVERFLOW, "The call of the job does not fit within a job.");
+	int i = 0;
+	while (i < FMR_MAX_JOBS && fmr_jobs[i].period) i ++;
+	lf_assert(i < FMR_MAX_JOBS, failure, E_TIMER, "No job is available to perform the call.");
+	struct _fmr_job *job = &fmr_jobs[i];
+	memcpy(job->call, &packet->call, length);
+	job->length = length;
+	job->elapsed = 0;
+	/* Setting the period makes the job visible to the timer, so it comes last. */
+	job->period = packet->period;
+	if (fmr_job_retime() != lf_success) {
+		job->period = 0;
+		fmr_job_retime();
+		return lf_error;
+	}
+	return i;
+failure:
+	return lf_error;
+}
+
+void fmr_job_tick(void) {
+	/* Only a tick that finds every earlier tick performed wakes the jobs, as the others are performed with it. */
+	if (fmr_job_ticked ++ == fmr_job_performed) fmr_job_signal();
+}
+
+void fmr_job_perform(void) {
+	while (fmr_job_performed != fmr_job_ticked) {
+		uint32_t interval = fmr_job_interval;
+		for (int i = 0; i < FMR_MAX_JOBS; i ++) {
+			struct _fmr_job *job = &fmr_jobs[i];
+			uint32_t period = job->period;
+			if (!period) continue;
+			job->elapsed += interval;
+			if (job->elapsed < period) continue;
+			job->elapsed -= period;
+			struct _fmr_invocation *call = (struct _fmr_invocation *)job->call;
+			lf_error_clear();
+			lf_return_t value = fmr_execute(call, job->length);
+			fmr_sample_put(i, value, lf_error_get());
+		}
+		fmr_job_performed ++;
+	}
+}
+
+lf_size_t fmr_drain(lf_size_t max, struct _fmr_sample **samples) {
+	/* The samples are copied out of the ring, so that it can go on filling while they are sent. */
+	static struct _fmr_sample drained[FMR_JOB_SAMPLES];
+	lf_size_t count = 0;
+	uint16_t tail = fmr_sample_tail;
+	while (count < max && tail != fmr_sample_head) {
+		drained[count ++] = fmr_samples[tail ++ & (FMR_JOB_SAMPLES - 1)];
+	}
+	fmr_sample_tail = tail;
+	*samples = drained;
+	return count;
+}
+
+/* ~ Starts, stops, and drains jobs from the host. ~ */
+
+struct _lf_job *lf_job_start(struct _lf_module *module, lf_function function, lf_type ret, struct _lf_ll *args, uint32_t period) {
+	struct _lf_job *job = NULL;
+	lf_assert(module, failure, E_NULL, "No module was specified for a job.");
+	if (!module->device) module->device = lf_get_current_device();
+	lf_assert(module->device, failure, E_NO_DEVICE, "The module '%s' has no target device. Did you attach?", module->name);
+	if (module->index == -1) lf_bind(module, module->device);
+	/* Jobs are performed without a scratch arena, so their calls cannot pass buffers. */
+	for (size_t i = 0; i < lf_ll_count(args); i ++) {
+		struct _lf_arg *arg = lf_ll_item(args, i);
+		lf_assert(!arg || !lf_is_buffer(arg->type), failure, E_TYPE, "Jobs cannot pass buffers to module '%s'.", module->name);
+	}
+	int index;
+	struct _lf_device *device = lf_route(module, function, &index);
+	lf_assert(device, failure, E_NO_DEVICE, "No device services the module '%s'.", module->name);
+	lf_assert(!(index & FMR_USER_INVOCATION_BIT), failure, E_MODULE, "Jobs cannot call the user module '%s'.", module->name);
+	lf_assert(lf_supports(device, fmr_job_class), failure, E_SUBCLASS, "Device '%s' does not perform jobs.", device->configuration.name);
+	lf_assert(period >= FMR_JOB_MIN_PERIOD, failure, E_TIMER, "A job cannot be performed every %i microseconds.", period);
+	job = calloc(1, sizeof(struct _lf_job));
+	lf_assert(job, failure, E_MALLOC, "Failed to allocate a job handle.");
+
+	/* Jobs hold their call within a standard packet on the device. */
+	struct _fmr_packet _packet;
+	memset(&_packet, 0, sizeof(struct _fmr_packet));
+	_packet.header.magic = FMR_MAGIC_NUMBER;
+	_packet.header.length = sizeof(struct _fmr_job_packet);
+	_packet.header.type = fmr_job_class;
+	struct _fmr_job_packet *packet = (struct _fmr_job_packet *)(&_packet);
+	packet->period = period;
+	int _e = lf_create_call((uint8_t)(index), function, ret, args, &_packet.header, &packet->call, sizeof(struct _fmr_packet), &device->configuration);
+	args = NULL;
+	lf_assert(_e == lf_success, failure, lf_error_get(), "Failed to generate a job calling module '%s'.", module->name);
+	_packet.header.checksum = lf_crc(packet, _packet.header.length);
+
+	_e = lf_lane_acquire(device->endpoint, lf_control_lane);
+	lf_assert(_e == lf_success, failure, E_ENDPOINT, "Failed to queue a job for device '%s'.", device->configuration.name);
+	_e = lf_transfer(device, &_packet);
+	lf_assert(_e == lf_success, release, E_FMR, "Failed to transfer a job to device '%s'.", device->configuration.name);
+
+	struct _fmr_result result;
+	_e = lf_get_result(device, &result);
+	lf_lane_release(device->endpoint);
+	lf_assert(_e == lf_success, failure, E_TIMER, "Failed to start a job on device '%s'.", device->configuration.name);
+	job->device = device;
+	job->id = result.value;
+	return job;
+
+release:
+	lf_lane_release(device->endpoint);
+failure:
+	free(job);
+	lf_ll_release(&args);
+	return NULL;
+}
+
+int lf_job_stop(struct _lf_job *job) {
+	lf_assert(job, failure, E_NULL, "No job specified.");
+	struct _lf_device *device = job->device;
+
+	struct _fmr_packet _packet;
+	memset(&_packet, 0, sizeof(struct _fmr_packet));
+	_packet.header.magic = FMR_MAGIC_NUMBER;
+	_packet.header.length = sizeof(struct _fmr_job_packet);
+	_packet.header.type = fmr_job_class;
+	struct _fmr_job_packet *packet = (struct _fmr_job_packet *)(&_packet);
+	packet->job = job->id;
+	_packet.header.checksum = lf_crc(packet, _packet.header.length);
+	free(job);
+
+	int _e = lf_lane_acquire(device->endpoint, lf_control_lane);
+	lf_assert(_e == lf_success, failure, E_ENDPOINT, "Failed to queue a job for device '%s'.", device->configuration.name);
+	_e = lf_transfer(device, &_packet);
+	lf_assert(_e == lf_success, release, E_FMR, "Failed to transfer a job to device '%s'.", device->configuration.name);
+
+	struct _fmr_result result;
+	_e = lf_get_result(device, &result);
+	lf_lane_release(device->endpoint);
+	return _e;
+
+release:
+	lf_lane_release(device->endpoint);
+failure:
+	return lf_error;
+}
+
+int lf_job_drain(struct _lf_device *device, struct _fmr_sample *samples, lf_size_t max) {
+	lf_assert(device, failure, E_NULL, "No device specified to drain samples from.");
+	lf_assert(samples, failure, E_NULL, "No buffer specified for the samples of device '%s'.", device->configuration.name);
+	lf_assert(lf_supports(device, fmr_drain_class), failure, E_SUBCLASS, "Device '%s' does not perform jobs.", device->configuration.name);
+
+	struct _fmr_packet _packet;
+	memset(&_packet, 0, sizeof(struct _fmr_packet));
+	_packet.header.magic = FMR_MAGIC_NUMBER;
+	_packet.header.length = sizeof(struct _fmr_invocation_packet);
+	_packet.header.type = fmr_drain_class;
+	struct _fmr_invocation_packet *packet = (struct _fmr_invocation_packet *)(&_packet);
+	int _e = lf_create_call(0, 0, lf_int_t, lf_args(lf_infer(max)), &_packet.header, &packet->call, sizeof(struct _fmr_packet), NULL);
+	lf_assert(_e == lf_success, failure, E_NULL, "Failed to generate a drain for device '%s'.", device->configuration.name);
+	_packet.header.checksum = lf_crc(packet, _packet.header.length);
+
+	_e = lf_lane_acquire(device->endpoint, lf_control_lane);
+	lf_assert(_e == lf_success, failure, E_ENDPOINT, "Failed to queue a drain for device '%s'.", device->configuration.name);
+	_e = lf_transfer(device, &_packet);
+	lf_assert(_e == lf_success, release, E_FMR, "Failed to transfer a drain to device '%s'.", device->configuration.name);
+
+	/* The result gives the number of samples that follow it. */
+	struct _fmr_result result;
+	_e = lf_retrieve(device, &result);
+	lf_debug_result(&result);
+	lf_assert(_e == lf_success, release, E_ENDPOINT, "Failed to obtain response from device '%s':", device->configuration.name);
+	lf_size_t count = result.value;
+	lf_assert(count <= max, release, E_OVERFLOW, "Device '%s' drained more samples than were requested.", device->configuration.name);
+	if (count) {
+		_e = device->endpoint->pull(device->endpoint, samples, count * sizeof(struct _fmr_sample));
+		lf_assert(_e == lf_success, release, E_FMR, "Failed to receive the samples of device '%s'.", device->configuration.name);
+	}
+	lf_lane_release(device->endpoint);
+	/* An error deferred by an earlier invocation is reported alongside the samples. */
+	lf_assert(result.error == E_OK, failure, result.error, "An error occured on the device '%s':", device->configuration.name);
+	return count;
+
+release:
+	lf_lane_release(device->endpoint);
+failure:
+	return lf_error;
+}
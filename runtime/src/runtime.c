@@ -12,8 +12,10 @@ failure:
 }
 
 int lf_transfer(struct _lf_device *device, struct _fmr_packet *packet) {
-	lf_debug_packet(packet, sizeof(struct _fmr_packet));
-	int _e = device->endpoint->push(device->endpoint, packet, sizeof(struct _fmr_packet));
+	/* Packets are never sent smaller than the standard packet size, so that devices can always read a whole packet. */
+	lf_size_t length = (packet->header.length > FMR_PACKET_SIZE) ? packet->header.length : FMR_PACKET_SIZE;
+	lf_debug_packet(packet, length);
+	int _e = device->endpoint->push(device->endpoint, packet, length);
 	lf_assert(_e == lf_success, failure, E_ENDPOINT, "Failed to transfer packet to device '%s'.", device->configuration.name);
 	return lf_success;
 failure:
@@ -28,7 +30,23 @@ failure:
 	return lf_error;
 }
 
-lf_return_t lf_invoke(struct _lf_module *module, lf_function function, lf_type ret, struct _lf_ll *parameters) {
+struct _lf_device *lf_route(struct _lf_module *module, lf_function function, int *index) {
+	struct _lf_device *device = module->device;
+	*index = module->index;
+	/* Devices composed of multiple chips decide which chip services each function. */
+	if (device && device->route) device = device->route(device, module, function, index);
+	return device;
+}
+
+lf_size_t lf_packet_size(struct _lf_device *device) {
+	return (device->packet_size > FMR_PACKET_SIZE) ? device->packet_size : FMR_PACKET_SIZE;
+}
+
+/* Builds an invocation of the given type and transfers it, giving the device that services it.
+   The device is held in the control lane until the caller has received the reply. */
+static struct _lf_device *lf_invoke_transfer(struct _lf_module *module, lf_function function, lf_type ret, struct _lf_ll *parameters, uint8_t flags) {
+	struct _fmr_packet *_packet = NULL;
+	struct _lf_device *device = NULL;
 	lf_assert(module, failure, E_NULL, "No module was specified for function invocation.");
 
 	/* If the module has no device, assume the invocation is for the current device. */
@@ -42,68 +60,263 @@ lf_return_t lf_invoke(struct _lf_module *module, lf_function function, lf_type r
 	/* If the module has no index, try to bind it. */
 	if (module->index == -1) lf_bind(module, module->device);
 
-	/* The raw packet into which the invocation information will be loaded .*/
-	struct _fmr_packet _packet;
-	memset(&_packet, 0, sizeof(struct _fmr_packet));
-	_packet.header.magic = FMR_MAGIC_NUMBER;
-	_packet.header.length = sizeof(struct _fmr_invocation_packet);
+	/* Resolve the device and module index that will service the call. */
+	int index;
+	struct _lf_device *route = lf_route(module, function, &index);
+	lf_assert(route, failure, E_NO_DEVICE, "No device services the module '%s'.", module->name);
+	lf_assert(!(flags & fmr_inline_flag) || (route->configuration.capabilities.classes & FMR_INLINE_CAPABILITY), failure, E_SUBCLASS, "Device '%s' does not return values or buffers alongside the result of a call.", route->configuration.name);
+	int _e = lf_lane_acquire(route->endpoint, lf_control_lane);
+	lf_assert(_e == lf_success, failure, E_ENDPOINT, "Failed to queue a call to module '%s'.", module->name);
+	device = route;
+
+	/* The raw packet into which the invocation information will be loaded, sized for the device. */
+	lf_size_t size = lf_packet_size(device);
+	_packet = calloc(1, size);
+	lf_assert(_packet, failure, E_MALLOC, "Failed to allocate a packet for module '%s'.", module->name);
+	_packet->header.magic = FMR_MAGIC_NUMBER;
+	_packet->header.length = sizeof(struct _fmr_invocation_packet);
 
 	#warning Remove this.
 	/* If the user module bit is set, make the invocation a user invocation. */
-	if (module->index & FMR_USER_INVOCATION_BIT) {
-		_packet.header.type = fmr_user_invocation_class;
+	if (index & FMR_USER_INVOCATION_BIT) {
+		lf_assert(!(flags & fmr_inline_flag), failure, E_MODULE, "Calls to the user module '%s' cannot pass buffers or return values alongside their result.", module->name);
+		_packet->header.type = fmr_user_invocation_class;
 	} else {
 		/* Otherwise, make it a standard invocation. */
-		_packet.header.type = fmr_standard_invocation_class;
+		_packet->header.type = fmr_standard_invocation_class;
 	}
+	_packet->header.type |= flags;
 
 	/* Generate the function call in the outgoing packet. */
-	struct _fmr_invocation_packet *packet = (struct _fmr_invocation_packet *)(&_packet);
-	int _e = lf_create_call((uint8_t)(module->index), function, ret, parameters, &_packet.header, &packet->call);
-	lf_assert(_e == lf_success, failure, E_NULL, "Failed to generate a valid call to module '%s'.", module->name);
-	_packet.header.checksum = lf_crc(&_packet, _packet.header.length);
+	struct _fmr_invocation_packet *packet = (struct _fmr_invocation_packet *)(_packet);
+	_e = lf_create_call((uint8_t)(index), function, ret, parameters, &_packet->header, &packet->call, size, &device->configuration);
+	parameters = NULL;
+	lf_assert(_e == lf_success, failure, lf_error_get(), "Failed to generate a valid call to module '%s'.", module->name);
+	_packet->header.checksum = lf_crc(_packet, _packet->header.length);
 
-	_e = lf_transfer(module->device, &_packet);
+	_e = lf_transfer(device, _packet);
 	lf_assert(_e == lf_success, failure, E_FMR, "Failed to transfer command to module '%s'.", module->name);
+	free(_packet);
+	return device;
+
+failure:
+	if (device) lf_lane_release(device->endpoint);
+	lf_ll_release(&parameters);
+	free(_packet);
+	return NULL;
+}
 
+lf_return_t lf_invoke(struct _lf_module *module, lf_function function, lf_type ret, struct _lf_ll *parameters) {
+	lf_assert(module, failure, E_NULL, "No module was specified for function invocation.");
+	/* Calls that pass buffers are marshalled with their buffers in a single transaction. */
+	for (size_t i = 0; i < lf_ll_count(parameters); i ++) {
+		struct _lf_arg *arg = lf_ll_item(parameters, i);
+		if (arg && lf_is_buffer(arg->type)) return lf_invoke_into(module, function, ret, parameters, NULL);
+	}
+	/* Calls that return nothing are not waited upon if the device can defer their errors until the next synchronous packet. */
+	struct _lf_device *device = (module->device) ? module->device : lf_get_current_device();
+	bool reply = !(ret == lf_void_t && device && lf_supports(device, fmr_sync_class));
+	device = lf_invoke_transfer(module, function, ret, parameters, (reply) ? 0 : fmr_no_reply_flag);
+	lf_assert(device, failure, E_FMR, "Failed to invoke a function of module '%s'.", module->name);
 	struct _fmr_result result;
-	lf_get_result(module->device, &result);
+	result.value = lf_success;
+	if (reply) lf_get_result(device, &result);
+	lf_lane_release(device->endpoint);
 	return result.value;
 
 failure:
 	return -1;
 }
 
-lf_return_t lf_push(struct _lf_module *module, lf_function function, void *source, lf_size_t length, struct _lf_ll *parameters) {
-	lf_assert(module, failure, E_NULL, "NULL module was specified for data push.");
-	lf_assert(module->index != -1, failure, E_MODULE, "The module '%s' has not been configured. Call '%s_configure()' first.", module->name, module->name);
-	lf_assert(module->device, failure, E_NO_DEVICE, "The module '%s' has no target device. Did you attach before configuring?", module->name);
-	if (!length) return lf_success;
+lf_return_t lf_invoke_into(struct _lf_module *module, lf_function function, lf_type ret, struct _lf_ll *parameters, lf_arg *value) {
+	uint8_t *reply = NULL;
+	lf_assert(module, failure, E_NULL, "No module was specified for function invocation.");
+	/* The reply is extended by the full return value, if it is wider than the result, and by every buffer returned to the host. */
+	lf_size_t extension = (lf_wide(ret)) ? sizeof(lf_arg) : 0;
+	/* The buffers are noted before the call is built, as building it consumes the arguments. */
+	struct _lf_buffer buffers[FMR_MAX_ARGC];
+	size_t count = 0;
+	for (size_t i = 0; i < lf_ll_count(parameters) && i < FMR_MAX_ARGC; i ++) {
+		struct _lf_arg *arg = lf_ll_item(parameters, i);
+		if (!arg || (arg->type != lf_out_t && arg->type != lf_inout_t)) continue;
+		lf_assert(arg->buffer || !arg->value, failure, E_NULL, "No storage was given for a buffer returned by module '%s'.", module->name);
+		buffers[count].data = arg->buffer;
+		buffers[count ++].length = arg->value;
+		extension += arg->value;
+	}
+	if (!module->device) module->device = lf_get_current_device();
+	lf_assert(module->device, failure, E_NO_DEVICE, "The module '%s' has no target device. Did you attach?", module->name);
+	if (module->index == -1) lf_bind(module, module->device);
+	/* The reply is sent by the chip that services the call, whose packets may be smaller than those of the module's device. */
+	int index;
+	struct _lf_device *device = lf_route(module, function, &index);
+	lf_assert(device, failure, E_NO_DEVICE, "No device services the module '%s'.", module->name);
+	lf_assert(sizeof(struct _fmr_result) + extension <= lf_packet_size(device), failure, E_FMR_OVERFLOW, "The values returned by module '%s' do not fit within a reply from device '%s'.", module->name, device->configuration.name);
+
+	/* The result and the values that follow it arrive as a single reply. */
+	reply = malloc(sizeof(struct _fmr_result) + extension);
+	lf_assert(reply, failure, E_MALLOC, "Failed to allocate a reply for module '%s'.", module->name);
+
+	device = lf_invoke_transfer(module, function, ret, parameters, fmr_inline_flag);
+	parameters = NULL;
+	lf_assert(device, failure, E_FMR, "Failed to invoke a function of module '%s'.", module->name);
+	int _e = device->endpoint->pull(device->endpoint, reply, sizeof(struct _fmr_result) + extension);
+	lf_lane_release(device->endpoint);
+	struct _fmr_result result;
+	memcpy(&result, reply, sizeof(struct _fmr_result));
+	lf_debug_result(&result);
+	lf_assert(_e == lf_success, failure, E_ENDPOINT, "Failed to obtain response from device '%s':", device->configuration.name);
+	uint8_t *offset = &reply[sizeof(struct _fmr_result)];
+	if (lf_wide(ret)) {
+		if (value) memcpy(value, offset, sizeof(lf_arg));
+		offset += sizeof(lf_arg);
+	} else if (value) {
+		*value = result.value;
+	}
+	/* Copy the returned buffers back into the host's storage. */
+	for (size_t i = 0; i < count; i ++) {
+		memcpy(buffers[i].data, offset, buffers[i].length);
+		offset += buffers[i].length;
+	}
+	free(reply);
+	reply = NULL;
+	lf_assert(result.error == E_OK, failure, result.error, "An error occured on the device '%s':", device->configuration.name);
+	return result.value;
 
-	struct _fmr_packet _packet;
-	memset(&_packet, 0, sizeof(struct _fmr_packet));
-	_packet.header.magic = FMR_MAGIC_NUMBER;
-	_packet.header.length = sizeof(struct _fmr_push_pull_packet);
-	_packet.header.type = fmr_push_class;
-	struct _fmr_push_pull_packet *packet = (struct _fmr_push_pull_packet *)(&_packet);
+failure:
+	free(reply);
+	lf_ll_release(&parameters);
+	return -1;
+}
+
+/* Pushes data to a module's function in a single transaction through the given lane. */
+static lf_return_t lf_push_segment(struct _lf_module *module, lf_function function, void *source, lf_size_t length, int lane) {
+	struct _fmr_packet *_packet = NULL;
+
+	/* Resolve the device and module index that will service the push. */
+	int index;
+	struct _lf_device *device = lf_route(module, function, &index);
+	lf_assert(device, done, E_NO_DEVICE, "No device services the module '%s'.", module->name);
+	int _e = lf_lane_acquire(device->endpoint, lane);
+	lf_assert(_e == lf_success, done, E_ENDPOINT, "Failed to queue a push to module '%s'.", module->name);
+
+	lf_size_t size = lf_packet_size(device);
+	_packet = calloc(1, size);
+	lf_assert(_packet, failure, E_MALLOC, "Failed to allocate a packet for module '%s'.", module->name);
+	_packet->header.magic = FMR_MAGIC_NUMBER;
+	_packet->header.length = sizeof(struct _fmr_push_pull_packet);
+	_packet->header.type = fmr_push_class;
+	struct _fmr_push_pull_packet *packet = (struct _fmr_push_pull_packet *)(_packet);
 	packet->length = length;
 
-	int _e = lf_create_call(module->index, function, lf_int_t, lf_args(lf_ptr(source), lf_infer(length)), &_packet.header, &packet->call);
+	_e = lf_create_call(index, function, lf_int_t, lf_args(lf_ptr(source), lf_infer(length)), &_packet->header, &packet->call, size, &device->configuration);
 	lf_assert(_e == lf_success, failure, E_NULL, "Failed to generate a valid push to module '%s'.", module->name);
-	_packet.header.checksum = lf_crc(packet, _packet.header.length);
+
+	/* If the data fits in the space left in the packet, it is carried inline rather than pushed separately. */
+	bool inline_data = (_packet->header.length + length <= size);
+	if (inline_data) {
+		memcpy((uint8_t *)_packet + _packet->header.length, source, length);
+		_packet->header.length += length;
+		_packet->header.type |= fmr_inline_flag;
+	}
+	_packet->header.checksum = lf_crc(packet, _packet->header.length);
 
 	/* Send the packet to the target device. */
-	_e = lf_transfer(module->device, &_packet);
+	_e = lf_transfer(device, _packet);
 	lf_assert(_e == lf_success, failure, E_FMR, "Failed to transfer push command to module '%s'.", module->name);
+	free(_packet);
+	_packet = NULL;
 
-	/* Transfer the data through to the address space of the device. */
-	_e = module->device->endpoint->push(module->device->endpoint, source, length);
-	lf_assert(_e == lf_success, failure, E_FMR, "Failed to push data to module '%s'.", module->name);
+	if (!inline_data) {
+		/* Transfer the data through to the address space of the device. */
+		_e = device->endpoint->push(device->endpoint, source, length);
+		lf_assert(_e == lf_success, failure, E_FMR, "Failed to push data to module '%s'.", module->name);
+	}
 
 	struct _fmr_result result;
-	lf_get_result(module->device, &result);
+	lf_get_result(device, &result);
+	lf_lane_release(device->endpoint);
 	return result.value;
 
+failure:
+	lf_lane_release(device->endpoint);
+	free(_packet);
+done:
+	return lf_error;
+}
+
+/* Pulls data from a module's function in a single transaction through the given lane. */
+static lf_return_t lf_pull_segment(struct _lf_module *module, lf_function function, void *destination, lf_size_t length, int lane) {
+	struct _fmr_packet *_packet = NULL;
+
+	/* Resolve the device and module index that will service the pull. */
+	int index;
+	struct _lf_device *device = lf_route(module, function, &index);
+	lf_assert(device, done, E_NO_DEVICE, "No device services the module '%s'.", module->name);
+	int _e = lf_lane_acquire(device->endpoint, lane);
+	lf_assert(_e == lf_success, done, E_ENDPOINT, "Failed to queue a pull from module '%s'.", module->name);
+
+	lf_size_t size = lf_packet_size(device);
+	_packet = calloc(1, size);
+	lf_assert(_packet, failure, E_MALLOC, "Failed to allocate a packet for module '%s'.", module->name);
+	_packet->header.magic = FMR_MAGIC_NUMBER;
+	_packet->header.length = sizeof(struct _fmr_push_pull_packet);
+	_packet->header.type = fmr_pull_class;
+	struct _fmr_push_pull_packet *packet = (struct _fmr_push_pull_packet *)(_packet);
+	packet->length = length;
+
+	/* Generate the function call in the outgoing packet. */
+	_e = lf_create_call(index, function, lf_int_t, lf_args(lf_ptr(destination), lf_infer(length)), &_packet->header, &packet->call, size, &device->configuration);
+	lf_assert(_e == lf_success, failure, E_NULL, "Failed to generate a valid pull from module '%s'.", module->name);
+
+	/* If the data fits in a packet alongside the result, the device returns both in a single reply. */
+	if (sizeof(struct _fmr_result) + length <= size) _packet->header.type |= fmr_inline_flag;
+	_packet->header.checksum = lf_crc(packet, _packet->header.length);
+
+	/* Send the packet to the target device. */
+	_e = lf_transfer(device, _packet);
+	lf_assert(_e == lf_success, failure, E_FMR, "Failed to transfer pull command to module '%s'.", module->name);
+
+	struct _fmr_result result;
+	if (_packet->header.type & fmr_inline_flag) {
+		/* The reply is the result, followed by the data. The packet is large enough to hold it. */
+		_e = device->endpoint->pull(device->endpoint, _packet, sizeof(struct _fmr_result) + length);
+		lf_assert(_e == lf_success, failure, E_FMR, "Failed to pull data from module '%s'.", module->name);
+		memcpy(&result, _packet, sizeof(struct _fmr_result));
+		memcpy(destination, (uint8_t *)_packet + sizeof(struct _fmr_result), length);
+		free(_packet);
+		_packet = NULL;
+		lf_lane_release(device->endpoint);
+		lf_debug_result(&result);
+		lf_assert(result.error == E_OK, done, result.error, "An error occured on the device '%s':", device->configuration.name);
+		return result.value;
+	}
+	free(_packet);
+	_packet = NULL;
+
+	/* Obtain the data from the address space of the device. */
+	_e = device->endpoint->pull(device->endpoint, destination, length);
+	lf_assert(_e == lf_success, failure, E_FMR, "Failed to pull data from module '%s'.", module->name);
+
+	lf_get_result(device, &result);
+	lf_lane_release(device->endpoint);
+	return result.value;
+
+failure:
+	lf_lane_release(device->endpoint);
+	free(_packet);
+done:
+	return lf_error;
+}
+
+/* Large transfers travel through the bulk lane, so that control transactions waiting upon the device go before them. */
+#define lf_lane_for(length) (((length) > LF_SEGMENT_SIZE) ? lf_bulk_lane : lf_control_lane)
+
+lf_return_t lf_push(struct _lf_module *module, lf_function function, void *source, lf_size_t length, struct _lf_ll *parameters) {
+	lf_assert(module, failure, E_NULL, "NULL module was specified for data push.");
+	lf_assert(module->index != -1, failure, E_MODULE, "The module '%s' has not been configured. Call '%s_configure()' first.", module->name, module->name);
+	lf_assert(module->device, failure, E_NO_DEVICE, "The module '%s' has no target device. Did you attach before configuring?", module->name);
+	return lf_push_segment(module, function, source, length, lf_lane_for(length));
 failure:
 	return lf_error;
 }
@@ -112,37 +325,341 @@ lf_return_t lf_pull(struct _lf_module *module, lf_function function, void *desti
 	lf_assert(module, failure, E_NULL, "NULL module was specified for data pull.");
 	lf_assert(module->index != -1, failure, E_MODULE, "The module '%s' has not been configured. Call '%s_configure()' first.", module->name, module->name);
 	lf_assert(module->device, failure, E_NO_DEVICE, "The module '%s' has no target device. Did you attach before configuring?", module->name);
-	if (!length) return lf_success;
+	return lf_pull_segment(module, function, destination, length, lf_lane_for(length));
+failure:
+	return lf_error;
+}
+
+lf_return_t lf_push_segments(struct _lf_module *module, lf_function function, void *source, lf_size_t length, struct _lf_ll *parameters) {
+	lf_assert(module, failure, E_NULL, "NULL module was specified for data push.");
+	lf_assert(module->index != -1, failure, E_MODULE, "The module '%s' has not been configured. Call '%s_configure()' first.", module->name, module->name);
+	lf_assert(module->device, failure, E_NO_DEVICE, "The module '%s' has no target device. Did you attach before configuring?", module->name);
+	lf_return_t value;
+	int lane = lf_lane_for(length);
+	/* An empty transfer still calls the function once, as 'lf_push' does. */
+	lf_size_t offset = 0;
+	do {
+		lf_size_t segment = (length - offset > LF_SEGMENT_SIZE) ? LF_SEGMENT_SIZE : length - offset;
+		value = lf_push_segment(module, function, (uint8_t *)source + offset, segment, lane);
+		if (value == (lf_return_t)lf_error) break;
+		offset += segment;
+	} while (offset < length);
+	return value;
+failure:
+	return lf_error;
+}
+
+lf_return_t lf_pull_segments(struct _lf_module *module, lf_function function, void *destination, lf_size_t length, struct _lf_ll *parameters) {
+	lf_assert(module, failure, E_NULL, "NULL module was specified for data pull.");
+	lf_assert(module->index != -1, failure, E_MODULE, "The module '%s' has not been configured. Call '%s_configure()' first.", module->name, module->name);
+	lf_assert(module->device, failure, E_NO_DEVICE, "The module '%s' has no target device. Did you attach before configuring?", module->name);
+	lf_return_t value;
+	int lane = lf_lane_for(length);
+	/* An empty transfer still calls the function once, as 'lf_pull' does. */
+	lf_size_t offset = 0;
+	do {
+		lf_size_t segment = (length - offset > LF_SEGMENT_SIZE) ? LF_SEGMENT_SIZE : length - offset;
+		value = lf_pull_segment(module, function, (uint8_t *)destination + offset, segment, lane);
+		if (value == (lf_return_t)lf_error) break;
+		offset += segment;
+	} while (offset < length);
+	return value;
+failure:
+	return lf_error;
+}
+
+struct _lf_remote *lf_remote_alloc(struct _lf_device *device, lf_size_t size) {
+	struct _lf_remote *remote = NULL;
+	lf_assert(device, failure, E_NULL, "No device specified to allocate a remote buffer on.");
+	lf_assert(size, failure, E_NULL, "No size specified for a remote buffer on device '%s'.", device->configuration.name);
+	lf_assert(lf_supports(device, fmr_malloc_class), failure, E_SUBCLASS, "Device '%s' does not allocate remote buffers.", device->configuration.name);
+	remote = calloc(1, sizeof(struct _lf_remote));
+	lf_assert(remote, failure, E_MALLOC, "Failed to allocate a remote buffer handle.");
+
+	struct _fmr_packet _packet;
+	memset(&_packet, 0, sizeof(struct _fmr_packet));
+	_packet.header.magic = FMR_MAGIC_NUMBER;
+	_packet.header.length = sizeof(struct _fmr_invocation_packet);
+	_packet.header.type = fmr_malloc_class;
+	struct _fmr_invocation_packet *packet = (struct _fmr_invocation_packet *)(&_packet);
+	int _e = lf_create_call(0, 0, lf_int_t, lf_args(lf_infer(size)), &_packet.header, &packet->call, sizeof(struct _fmr_packet), NULL);
+	lf_assert(_e == lf_success, failure, E_NULL, "Failed to generate an allocation for device '%s'.", device->configuration.name);
+	_packet.header.checksum = lf_crc(packet, _packet.header.length);
+
+	_e = lf_lane_acquire(device->endpoint, lf_control_lane);
+	lf_assert(_e == lf_success, failure, E_ENDPOINT, "Failed to queue a transaction for device '%s'.", device->configuration.name);
+	_e = lf_transfer(device, &_packet);
+	lf_assert(_e == lf_success, release, E_FMR, "Failed to transfer allocation to device '%s'.", device->configuration.name);
+
+	/* The device replies with the address of the buffer ahead of the result. */
+	_e = device->endpoint->pull(device->endpoint, &remote->address, sizeof(uint64_t));
+	lf_assert(_e == lf_success, release, E_FMR, "Failed to receive the address of a remote buffer from device '%s'.", device->configuration.name);
+
+	struct _fmr_result result;
+	_e = lf_get_result(device, &result);
+	lf_lane_release(device->endpoint);
+	lf_assert(_e == lf_success, failure, E_MALLOC, "Failed to allocate a %i byte buffer on device '%s'.", size, device->configuration.name);
+	remote->device = device;
+	remote->size = size;
+	return remote;
+
+release:
+	lf_lane_release(device->endpoint);
+failure:
+	free(remote);
+	return NULL;
+}
+
+/* Moves a segment of data between the host and a remote buffer using the send or receive class. */
+static int lf_remote_segment(struct _lf_remote *remote, fmr_class class, lf_size_t offset, void *buffer, lf_size_t length, int lane) {
+	struct _lf_device *device = remote->device;
 
 	struct _fmr_packet _packet;
 	memset(&_packet, 0, sizeof(struct _fmr_packet));
 	_packet.header.magic = FMR_MAGIC_NUMBER;
 	_packet.header.length = sizeof(struct _fmr_push_pull_packet);
-	_packet.header.type = fmr_pull_class;
+	_packet.header.type = class;
 	struct _fmr_push_pull_packet *packet = (struct _fmr_push_pull_packet *)(&_packet);
 	packet->length = length;
+	int _e = lf_create_call(0, 0, lf_int_t, lf_args(lf_remote_ptr(remote, offset), lf_infer(length)), &_packet.header, &packet->call, sizeof(struct _fmr_packet), NULL);
+	lf_assert(_e == lf_success, failure, E_NULL, "Failed to generate a remote buffer transfer for device '%s'.", device->configuration.name);
+	_packet.header.checksum = lf_crc(packet, _packet.header.length);
 
-	/* Generate the function call in the outgoing packet. */
-	int _e = lf_create_call(module->index, function, lf_int_t, lf_args(lf_ptr(destination), lf_infer(length)), &_packet.header, &packet->call);
-	lf_assert(_e == lf_success, failure, E_NULL, "Failed to generate a valid pull from module '%s'.", module->name);
+	_e = lf_lane_acquire(device->endpoint, lane);
+	lf_assert(_e == lf_success, failure, E_ENDPOINT, "Failed to queue a transaction for device '%s'.", device->configuration.name);
+	_e = lf_transfer(device, &_packet);
+	lf_assert(_e == lf_success, release, E_FMR, "Failed to transfer remote buffer command to device '%s'.", device->configuration.name);
+
+	/* The data follows the packet, or precedes the result. */
+	if (class == fmr_send_class) {
+		_e = device->endpoint->push(device->endpoint, buffer, length);
+	} else {
+		_e = device->endpoint->pull(device->endpoint, buffer, length);
+	}
+	lf_assert(_e == lf_success, release, E_FMR, "Failed to move data to or from a remote buffer on device '%s'.", device->configuration.name);
+
+	struct _fmr_result result;
+	_e = lf_get_result(device, &result);
+	lf_lane_release(device->endpoint);
+	return _e;
+
+release:
+	lf_lane_release(device->endpoint);
+failure:
+	return lf_error;
+}
+
+/* Moves data between the host and a remote buffer, a segment at a time. */
+static int lf_remote_transfer(struct _lf_remote *remote, fmr_class class, lf_size_t offset, void *buffer, lf_size_t length) {
+	lf_assert(remote, failure, E_NULL, "No remote buffer specified.");
+	lf_assert(buffer, failure, E_NULL, "No host buffer specified for remote buffer on device '%s'.", remote->device->configuration.name);
+	lf_assert(offset <= remote->size && length <= remote->size - offset, failure, E_BOUNDARY, "The transfer exceeds the %i byte remote buffer on device '%s'.", remote->size, remote->device->configuration.name);
+	int lane = lf_lane_for(length);
+	for (lf_size_t moved = 0; moved < length; moved += LF_SEGMENT_SIZE) {
+		lf_size_t segment = (length - moved > LF_SEGMENT_SIZE) ? LF_SEGMENT_SIZE : length - moved;
+		int _e = lf_remote_segment(remote, class, offset + moved, (uint8_t *)buffer + moved, segment, lane);
+		if (_e != lf_success) return _e;
+	}
+	return lf_success;
+failure:
+	return lf_error;
+}
+
+int lf_remote_write(struct _lf_remote *remote, lf_size_t offset, void *source, lf_size_t length) {
+	return lf_remote_transfer(remote, fmr_send_class, offset, source, length);
+}
+
+int lf_remote_read(struct _lf_remote *remote, lf_size_t offset, void *destination, lf_size_t length) {
+	return lf_remote_transfer(remote, fmr_receive_class, offset, destination, length);
+}
+
+int lf_remote_free(struct _lf_remote *remote) {
+	lf_assert(remote, failure, E_NULL, "No remote buffer specified to free.");
+	struct _lf_device *device = remote->device;
+
+	struct _fmr_packet _packet;
+	memset(&_packet, 0, sizeof(struct _fmr_packet));
+	_packet.header.magic = FMR_MAGIC_NUMBER;
+	_packet.header.length = sizeof(struct _fmr_invocation_packet);
+	_packet.header.type = fmr_free_class;
+	struct _fmr_invocation_packet *packet = (struct _fmr_invocation_packet *)(&_packet);
+	int _e = lf_create_call(0, 0, lf_int_t, lf_args(lf_remote_ptr(remote, 0)), &_packet.header, &packet->call, sizeof(struct _fmr_packet), NULL);
+	/* The handle is released even if the device cannot be reached, as the buffer can no longer be referenced. */
+	free(remote);
+	lf_assert(_e == lf_success, failure, E_NULL, "Failed to generate a free for device '%s'.", device->configuration.name);
 	_packet.header.checksum = lf_crc(packet, _packet.header.length);
 
-	/* Send the packet to the target device. */
-	_e = lf_transfer(module->device, &_packet);
-	lf_assert(_e == lf_success, failure, E_FMR, "Failed to transfer pull command to module '%s'.", module->name);
+	_e = lf_lane_acquire(device->endpoint, lf_control_lane);
+	lf_assert(_e == lf_success, failure, E_ENDPOINT, "Failed to queue a transaction for device '%s'.", device->configuration.name);
+	_e = lf_transfer(device, &_packet);
+	lf_assert(_e == lf_success, release, E_FMR, "Failed to transfer free to device '%s'.", device->configuration.name);
 
-	/* Obtain the data from the address space of the device. */
-	_e = module->device->endpoint->pull(module->device->endpoint, destination, length);
-	lf_assert(_e == lf_success, failure, E_FMR, "Failed to pull data from module '%s'.", module->name);
+	struct _fmr_result result;
+	_e = lf_get_result(device, &result);
+	lf_lane_release(device->endpoint);
+	return _e;
+
+release:
+	lf_lane_release(device->endpoint);
+failure:
+	return lf_error;
+}
+
+int lf_sync(struct _lf_device *device) {
+	lf_assert(device, failure, E_NULL, "No device specified to synchronize with.");
+
+	/* Devices composed of multiple chips synchronize with each of them. */
+	if (device->sync) return device->sync(device);
+
+	/* Devices that cannot defer errors always reply, so there is nothing to report. */
+	if (!lf_supports(device, fmr_sync_class)) return lf_success;
+
+	struct _fmr_packet _packet;
+	memset(&_packet, 0, sizeof(struct _fmr_packet));
+	_packet.header.magic = FMR_MAGIC_NUMBER;
+	_packet.header.length = sizeof(struct _fmr_header);
+	_packet.header.type = fmr_sync_class;
+	_packet.header.checksum = lf_crc(&_packet, _packet.header.length);
+
+	int _e = lf_lane_acquire(device->endpoint, lf_control_lane);
+	lf_assert(_e == lf_success, failure, E_ENDPOINT, "Failed to queue a transaction for device '%s'.", device->configuration.name);
+	_e = lf_transfer(device, &_packet);
+	lf_assert(_e == lf_success, release, E_FMR, "Failed to transfer synchronization to device '%s'.", device->configuration.name);
 
 	struct _fmr_result result;
-	lf_get_result(module->device, &result);
-	return result.value;
+	_e = lf_get_result(device, &result);
+	lf_lane_release(device->endpoint);
+	return _e;
+
+release:
+	lf_lane_release(device->endpoint);
 
 failure:
 	return lf_error;
 }
 
+int lf_negotiate(struct _lf_device *device) {
+	lf_assert(device, failure, E_NULL, "No device specified for packet size negotiation.");
+
+	/* Every device and endpoint supports the standard packet size, so there is nothing to negotiate over small endpoints. */
+	device->packet_size = FMR_PACKET_SIZE;
+	if (device->endpoint->packet_size <= FMR_PACKET_SIZE) return lf_success;
+
+	/* If the device reported its largest packet in its configuration, no round trip is needed. */
+	lf_size_t reported = device->configuration.capabilities.packet_size;
+	if (reported) {
+		device->packet_size = (reported < device->endpoint->packet_size) ? reported : device->endpoint->packet_size;
+		if (device->packet_size < FMR_PACKET_SIZE) device->packet_size = FMR_PACKET_SIZE;
+		return lf_success;
+	}
+
+	struct _fmr_packet _packet;
+	memset(&_packet, 0, sizeof(struct _fmr_packet));
+	_packet.header.magic = FMR_MAGIC_NUMBER;
+	_packet.header.length = sizeof(struct _fmr_invocation_packet);
+	_packet.header.type = fmr_negotiate_class;
+	struct _fmr_invocation_packet *packet = (struct _fmr_invocation_packet *)(&_packet);
+	/* Propose the largest packet the endpoint can carry. */
+	int _e = lf_create_call(0, 0, lf_int_t, lf_args(lf_infer(device->endpoint->packet_size)), &_packet.header, &packet->call, sizeof(struct _fmr_packet), NULL);
+	lf_assert(_e == lf_success, failure, E_NULL, "Failed to generate a negotiation for device '%s'.", device->configuration.name);
+	_packet.header.checksum = lf_crc(packet, _packet.header.length);
+
+	_e = lf_lane_acquire(device->endpoint, lf_control_lane);
+	lf_assert(_e == lf_success, failure, E_ENDPOINT, "Failed to queue a transaction for device '%s'.", device->configuration.name);
+	_e = lf_transfer(device, &_packet);
+	lf_assert(_e == lf_success, release, E_FMR, "Failed to transfer negotiation to device '%s'.", device->configuration.name);
+
+	struct _fmr_result result;
+	_e = lf_get_result(device, &result);
+	lf_lane_release(device->endpoint);
+	lf_assert(_e == lf_success, failure, E_FMR, "Device '%s' did not negotiate a packet size.", device->configuration.name);
+	/* Never exceed what was proposed, in case the device answers with something unexpected. */
+	if (result.value > FMR_PACKET_SIZE && result.value <= device->endpoint->packet_size) device->packet_size = result.value;
+	return lf_success;
+
+release:
+	lf_lane_release(device->endpoint);
+failure:
+	return lf_error;
+}
+
+int lf_describe(struct _lf_device *device, uint8_t index, lf_return_t *description) {
+	lf_assert(device, failure, E_NULL, "No device specified to describe.");
+	lf_assert(description, failure, E_NULL, "No description provided for device '%s'.", device->configuration.name);
+
+	struct _fmr_packet _packet;
+	memset(&_packet, 0, sizeof(struct _fmr_packet));
+	_packet.header.magic = FMR_MAGIC_NUMBER;
+	_packet.header.length = sizeof(struct _fmr_invocation_packet);
+	_packet.header.type = fmr_describe_class;
+	struct _fmr_invocation_packet *packet = (struct _fmr_invocation_packet *)(&_packet);
+	/* The index of the module to be described. */
+	packet->call.index = index;
+	_packet.header.checksum = lf_crc(packet, _packet.header.length);
+
+	int _e = lf_lane_acquire(device->endpoint, lf_control_lane);
+	lf_assert(_e == lf_success, failure, E_ENDPOINT, "Failed to queue a transaction for device '%s'.", device->configuration.name);
+	_e = lf_transfer(device, &_packet);
+	lf_assert(_e == lf_success, release, E_FMR, "Failed to transfer describe command to device '%s'.", device->configuration.name);
+
+	struct _fmr_result result;
+	_e = lf_get_result(device, &result);
+	lf_lane_release(device->endpoint);
+	lf_assert(_e == lf_success, failure, E_FMR, "Failed to describe module '%i' of device '%s'.", index, device->configuration.name);
+	*description = result.value;
+	return lf_success;
+
+release:
+	lf_lane_release(device->endpoint);
+failure:
+	return lf_error;
+}
+
+int lf_load_configuration(struct _lf_device *device) {
+	lf_assert(device, failure, E_NULL, "No device specified to load the configuration of.");
+
+	struct _fmr_packet _packet;
+	memset(&_packet, 0, sizeof(struct _fmr_packet));
+	_packet.header.magic = FMR_MAGIC_NUMBER;
+	_packet.header.length = sizeof(struct _fmr_header);
+	_packet.header.type = fmr_configuration_class;
+	_packet.header.checksum = lf_crc(&_packet, _packet.header.length);
+
+	int _e = lf_lane_acquire(device->endpoint, lf_control_lane);
+	lf_assert(_e == lf_success, failure, E_ENDPOINT, "Failed to queue a transaction for the device.");
+	_e = lf_transfer(device, &_packet);
+	lf_assert(_e == lf_success, release, E_FMR, "Failed to transfer configuration command to device.");
+
+	/* The device replies with its configuration ahead of the result. Firmware that predates configurations refuses the
+	   packet with E_SUBCLASS, replying with a result alone, or does not answer it at all, which is not an error here. */
+	struct _lf_configuration configuration;
+	struct _fmr_result result;
+	lf_error_pause();
+	_e = device->endpoint->pull(device->endpoint, &configuration, sizeof(struct _lf_configuration));
+	if (_e == lf_success) _e = lf_get_result(device, &result);
+	lf_error_resume();
+	lf_lane_release(device->endpoint);
+	if (_e != lf_success) {
+		/* Such firmware is attached as it was before configurations, and is left to negotiate its packet size. */
+		lf_error_clear();
+		memset(&device->configuration.capabilities, 0, sizeof(struct _lf_capabilities));
+		device->configuration.capabilities.classes = FMR_LEGACY_CLASSES;
+		lf_debug("Device '%s' did not report its configuration, so its capabilities are assumed.", device->configuration.name);
+		return lf_success;
+	}
+
+	/* Cache the configuration so that it is only obtained once per device. */
+	configuration.name[sizeof(configuration.name) - 1] = '\0';
+	device->configuration = configuration;
+	lf_debug("Loaded configuration of device '%s' (version 0x%04x, %i byte packets, classes 0x%08x).", configuration.name, configuration.version, configuration.capabilities.packet_size, configuration.capabilities.classes);
+	return lf_success;
+
+release:
+	lf_lane_release(device->endpoint);
+failure:
+	return lf_error;
+}
+
 int lf_load(void *source, lf_size_t length, struct _lf_device *device) {
 	lf_assert(device, failure, E_NULL, "No device specified for RAM load.");
 	lf_assert(source, failure, E_NULL, "No source specified for RAM load to device '%s'.", device->configuration.name);
@@ -157,18 +674,25 @@ int lf_load(void *source, lf_size_t length, struct _lf_device *device) {
 	packet->length = length;
 	_packet.header.checksum = lf_crc(packet, _packet.header.length);
 
+	/* The image is loaded in one piece, so it holds the bulk lane throughout. */
+	int _e = lf_lane_acquire(device->endpoint, lf_bulk_lane);
+	lf_assert(_e == lf_success, failure, E_ENDPOINT, "Failed to queue a transaction for device '%s'.", device->configuration.name);
+
 	/* Send the packet to the target device. */
-	int _e = lf_transfer(device, &_packet);
-	lf_assert(_e == lf_success, failure, E_FMR, "Failed to transfer load command to device '%s'.", device->configuration.name);
+	_e = lf_transfer(device, &_packet);
+	lf_assert(_e == lf_success, release, E_FMR, "Failed to transfer load command to device '%s'.", device->configuration.name);
 
 	/* Transfer the data through to the address space of the device. */
 	_e = device->endpoint->push(device->endpoint, source, length);
-	lf_assert(_e == lf_success, failure, E_FMR, "Failed to push image data to device '%s'.", device->configuration.name);
+	lf_assert(_e == lf_success, release, E_FMR, "Failed to push image data to device '%s'.", device->configuration.name);
 
 	struct _fmr_result result;
 	lf_get_result(device, &result);
+	lf_lane_release(device->endpoint);
 	return result.value;
 
+release:
+	lf_lane_release(device->endpoint);
 failure:
 	return lf_error;
 }
@@ -0,0 +1,271 @@
+#include <flipper.h>
+
+/* ~ Performs scripts on the device. ~ */
+
+#if defined(ATMEGAU2)
+
+lf_return_t fmr_script(const uint8_t *code, lf_size_t length) {
+	/* The interpreter's registers and call would take a fifth of the U2's SRAM, and its loops would outlast the watchdog, so scripts are left to the 4S. */
+	lf_error_raise(E_SUBCLASS, error_message("Scripts are not performed by the U2."));
+	return lf_error;
+}
+
+#else
+
+/* Returns whether a register compares with a value as given by a condition. */
+static bool fmr_script_test(lf_return_t reg, uint8_t condition, lf_return_t value) {
+	switch (condition) {
+		case fmr_condition_always: return true;
+		case fmr_condition_equal: return reg == value;
+		case fmr_condition_not_equal: return reg != value;
+		case fmr_condition_less: return reg < value;
+		case fmr_condition_greater_equal: return reg >= value;
+	}
+	return false;
+}
+
+lf_return_t fmr_script(const uint8_t *code, lf_size_t length) {
+	lf_return_t registers[FMR_SCRIPT_REGISTERS] = { 0 };
+	/* Each call is copied out of the code, so that its arguments can be replaced by registers. */
+	uint8_t invocation[sizeof(struct _fmr_invocation) + fmr_types_size(FMR_MAX_ARGC) + FMR_MAX_ARGC * FMR_MAX_ARG_SIZE];
+	struct _fmr_invocation *call = (struct _fmr_invocation *)invocation;
+	lf_size_t pc = 0;
+	uint32_t steps = 0;
+	while (pc < length) {
+		lf_assert(++ steps <= FMR_SCRIPT_MAX_STEPS, failure, E_OVERFLOW, "The script did not finish within %i steps.", FMR_SCRIPT_MAX_STEPS);
+		lf_assert(pc + 2 <= length, failure, E_BOUNDARY, "The script ends within an instruction.");
+		uint8_t op = code[pc];
+		uint8_t reg = code[pc + 1];
+		lf_assert(reg < FMR_SCRIPT_REGISTERS, failure, E_BOUNDARY, "The script uses register '%i', which does not exist.", reg);
+		pc += 2;
+		switch (op) {
+			case fmr_op_return:
+				return registers[reg];
+			case fmr_op_load:
+			case fmr_op_and:
+			case fmr_op_add: {
+				lf_return_t value;
+				lf_assert(pc + sizeof(lf_return_t) <= length, failure, E_BOUNDARY, "The script ends within an instruction.");
+				memcpy(&value, &code[pc], sizeof(lf_return_t));
+				pc += sizeof(lf_return_t);
+				if (op == fmr_op_load) registers[reg] = value;
+				else if (op == fmr_op_and) registers[reg] &= value;
+				else registers[reg] += value;
+			} break;
+			case fmr_op_invoke: {
+				uint16_t sources;
+				lf_assert(pc + sizeof(uint16_t) + sizeof(struct _fmr_invocation) <= length, failure, E_BOUNDARY, "The script ends within an instruction.");
+				memcpy(&sources, &code[pc], sizeof(uint16_t));
+				pc += sizeof(uint16_t);
+				memcpy(call, &code[pc], sizeof(struct _fmr_invocation));
+				pc += sizeof(struct _fmr_invocation);
+				lf_assert(call->argc <= FMR_MAX_ARGC, failure, E_OVERFLOW, "The script passes too many arguments to a call.");
+				lf_assert(pc + fmr_types_size(call->argc) <= length, failure, E_BOUNDARY, "The script ends within an instruction.");
+				memcpy(call->parameters, &code[pc], fmr_types_size(call->argc));
+				pc += fmr_types_size(call->argc);
+				/* Re-encode each argument, replacing those whose bit is set in the sources with the register named by their value. */
+				uint8_t *offset = fmr_arguments(call);
+				for (lf_argc i = 0; i < call->argc; i ++) {
+					lf_type type = (call->parameters[i / 2] >> ((i % 2) * 4)) & lf_max_t;
+					lf_arg value;
+					uint8_t consumed = fmr_decode_arg(type, &code[pc], length - pc, &value);
+					lf_assert(consumed, failure, E_BOUNDARY, "The script ends within an instruction.");
+					pc += consumed;
+					if (sources & (1 << i)) {
+						lf_assert(value < FMR_SCRIPT_REGISTERS, failure, E_BOUNDARY, "The script uses register '%i', which does not exist.", (int)value);
+						value = registers[value];
+					}
+					offset += fmr_encode_arg(type, value, offset);
+				}
+				registers[reg] = fmr_execute(call, offset - invocation);
+				/* Stop at the first call that raises an error. */
+				lf_assert(lf_error_get() == E_OK, failure, lf_error_get(), "A call made by the script failed.");
+			} break;
+			case fmr_op_branch: {
+				uint8_t condition;
+				lf_return_t value;
+				uint16_t target;
+				lf_assert(pc + 1 + sizeof(lf_return_t) + sizeof(uint16_t) <= length, failure, E_BOUNDARY, "The script ends within an instruction.");
+				condition = code[pc];
+				memcpy(&value, &code[pc + 1], sizeof(lf_return_t));
+				memcpy(&target, &code[pc + 1 + sizeof(lf_return_t)], sizeof(uint16_t));
+				pc += 1 + sizeof(lf_return_t) + sizeof(uint16_t);
+				if (fmr_script_test(registers[reg], condition, value)) pc = target;
+			} break;
+			case fmr_op_loop: {
+				uint16_t target;
+				lf_assert(pc + sizeof(uint16_t) <= length, failure, E_BOUNDARY, "The script ends within an instruction.");
+				memcpy(&target, &code[pc], sizeof(uint16_t));
+				pc += sizeof(uint16_t);
+				if (registers[reg] && -- registers[reg]) pc = target;
+			} break;
+			default:
+				lf_assert(false, failure, E_SUBCLASS, "The script contains an invalid instruction '%i'.", op);
+			break;
+		}
+	}
+	/* Scripts that end without returning give nothing. */
+	return lf_success;
+failure:
+	return lf_error;
+}
+
+#endif
+
+/* ~ Assembles scripts on the host. ~ */
+
+struct _lf_script *lf_script_create(struct _lf_device *device) {
+	lf_assert(device, failure, E_NULL, "No device specified to perform the script.");
+	struct _lf_script *script = calloc(1, sizeof(struct _lf_script));
+	lf_assert(script, failure, E_MALLOC, "Failed to allocate a script for device '%s'.", device->configuration.name);
+	script->device = device;
+	return script;
+failure:
+	return NULL;
+}
+
+void lf_script_release(struct _lf_script *script) {
+	free(script);
+}
+
+/* Appends an instruction to the script. */
+static int lf_script_emit(struct _lf_script *script, const void *instruction, lf_size_t length) {
+	lf_assert(script, failure, E_NULL, "No script specified.");
+	lf_assert(script->length + length <= sizeof(script->code), failure, E_FMR_OVERFLOW, "The script does not fit within a packet.");
+	memcpy(&script->code[script->length], instruction, length);
+	script->length += length;
+	return lf_success;
+failure:
+	return lf_error;
+}
+
+/* Appends an instruction that operates upon a register with a value. */
+static int lf_script_emit_value(struct _lf_script *script, uint8_t op, uint8_t reg, lf_return_t value) {
+	struct LF_PACKED { uint8_t op; uint8_t reg; lf_return_t value; } instruction = { op, reg, value };
+	return lf_script_emit(script, &instruction, sizeof(instruction));
+}
+
+int lf_script_load(struct _lf_script *script, uint8_t reg, lf_return_t value) {
+	return lf_script_emit_value(script, fmr_op_load, reg, value);
+}
+
+int lf_script_and(struct _lf_script *script, uint8_t reg, lf_return_t value) {
+	return lf_script_emit_value(script, fmr_op_and, reg, value);
+}
+
+int lf_script_add(struct _lf_script *script, uint8_t reg, lf_return_t value) {
+	return lf_script_emit_value(script, fmr_op_add, reg, value);
+}
+
+int lf_script_return(struct _lf_script *script, uint8_t reg) {
+	uint8_t instruction[] = { fmr_op_return, reg };
+	return lf_script_emit(script, instruction, sizeof(instruction));
+}
+
+int lf_script_invoke(struct _lf_script *script, uint8_t reg, struct _lf_module *module, lf_function function, lf_type ret, uint16_t sources, struct _lf_ll *args) {
+	lf_assert(script, failure, E_NULL, "No script specified.");
+	lf_assert(module, failure, E_NULL, "No module was specified for a call within a script.");
+	if (!module->device) module->device = lf_get_current_device();
+	lf_assert(module->device, failure, E_NO_DEVICE, "The module '%s' has no target device. Did you attach?", module->name);
+	if (module->index == -1) lf_bind(module, module->device);
+	/* Scripts are performed without a scratch arena, so their calls cannot pass buffers. */
+	for (size_t i = 0; i < lf_ll_count(args); i ++) {
+		struct _lf_arg *arg = lf_ll_item(args, i);
+		lf_assert(!arg || !lf_is_buffer(arg->type), failure, E_TYPE, "Scripts cannot pass buffers to module '%s'.", module->name);
+	}
+	/* Every call within a script must be serviced by the device that performs it. */
+	int index;
+	struct _lf_device *device = lf_route(module, function, &index);
+	/* Scripts created for a device composed of several chips are performed by the chip that services their first call. */
+	if (!script->calls && script->device->route) script->device = device;
+	lf_assert(device == script->device, failure, E_MODULE, "The module '%s' is not serviced by the device performing the script.", module->name);
+	struct LF_PACKED { uint8_t op; uint8_t reg; uint16_t sources; } prefix = { fmr_op_invoke, reg, sources };
+	lf_size_t start = script->length;
+	int _e = lf_script_emit(script, &prefix, sizeof(prefix));
+	lf_assert(_e == lf_success, failure, E_FMR_OVERFLOW, "The script does not fit within a packet.");
+	/* Encode the call in place, using a header that tracks the length of the script. */
+	struct _fmr_header header = { .length = script->length + sizeof(struct _fmr_invocation) };
+	lf_assert(header.length <= sizeof(script->code), rewind, E_FMR_OVERFLOW, "The script does not fit within a packet.");
+	struct _fmr_invocation *call = (struct _fmr_invocation *)&script->code[script->length];
+	memset(call, 0, sizeof(struct _fmr_invocation));
+	/* The arguments are released once encoded, whether or not they fit. */
+	_e = lf_create_call((uint8_t)(index), function, ret, args, &header, call, sizeof(script->code), &device->configuration);
+	args = NULL;
+	lf_assert(_e == lf_success, rewind, lf_error_get(), "Failed to encode a call to module '%s' within the script.", module->name);
+	script->length = header.length;
+	script->calls ++;
+	return lf_success;
+rewind:
+	script->length = start;
+failure:
+	lf_ll_release(&args);
+	return lf_error;
+}
+
+lf_size_t lf_script_label(struct _lf_script *script) {
+	return script->length;
+}
+
+int lf_script_branch(struct _lf_script *script, uint8_t reg, uint8_t condition, lf_return_t value, lf_size_t target) {
+	lf_assert(script, failure, E_NULL, "No script specified.");
+	struct LF_PACKED { uint8_t op; uint8_t reg; uint8_t condition; lf_return_t value; uint16_t target; } instruction = { fmr_op_branch, reg, condition, value, target };
+	int branch = script->length;
+	int _e = lf_script_emit(script, &instruction, sizeof(instruction));
+	lf_assert(_e == lf_success, failure, E_FMR_OVERFLOW, "The script does not fit within a packet.");
+	return branch;
+failure:
+	return lf_error;
+}
+
+int lf_script_resolve(struct _lf_script *script, int branch) {
+	lf_assert(script, failure, E_NULL, "No script specified.");
+	lf_assert(branch >= 0 && (lf_size_t)branch < script->length && script->code[branch] == fmr_op_branch, failure, E_BOUNDARY, "No branch exists at offset '%i' of the script.", branch);
+	/* The target is the last field of the branch. */
+	uint16_t target = script->length;
+	memcpy(&script->code[branch + 3 + sizeof(lf_return_t)], &target, sizeof(uint16_t));
+	return lf_success;
+failure:
+	return lf_error;
+}
+
+int lf_script_loop(struct _lf_script *script, uint8_t reg, lf_size_t target) {
+	struct LF_PACKED { uint8_t op; uint8_t reg; uint16_t target; } instruction = { fmr_op_loop, reg, target };
+	return lf_script_emit(script, &instruction, sizeof(instruction));
+}
+
+lf_return_t lf_script_run(struct _lf_script *script) {
+	struct _fmr_packet *_packet = NULL;
+	lf_assert(script, failure, E_NULL, "No script specified.");
+	struct _lf_device *device = script->device;
+	lf_assert(lf_supports(device, fmr_script_class), failure, E_SUBCLASS, "Device '%s' does not perform scripts.", device->configuration.name);
+
+	lf_size_t size = lf_packet_size(device);
+	lf_assert(sizeof(struct _fmr_header) + script->length <= size, failure, E_FMR_OVERFLOW, "The script does not fit within a %i byte packet.", size);
+	_packet = calloc(1, size);
+	lf_assert(_packet, failure, E_MALLOC, "Failed to allocate a packet for a script.");
+	_packet->header.magic = FMR_MAGIC_NUMBER;
+	_packet->header.length = sizeof(struct _fmr_header) + script->length;
+	_packet->header.type = fmr_script_class;
+	struct _fmr_script_packet *packet = (struct _fmr_script_packet *)(_packet);
+	memcpy(packet->code, script->code, script->length);
+	_packet->header.checksum = lf_crc(packet, _packet->header.length);
+
+	int _e = lf_lane_acquire(device->endpoint, lf_control_lane);
+	lf_assert(_e == lf_success, failure, E_ENDPOINT, "Failed to queue a script for device '%s'.", device->configuration.name);
+	_e = lf_transfer(device, _packet);
+	lf_assert(_e == lf_success, release, E_FMR, "Failed to transfer a script to device '%s'.", device->configuration.name);
+	free(_packet);
+	_packet = NULL;
+
+	struct _fmr_result result;
+	_e = lf_get_result(device, &result);
+	lf_lane_release(device->endpoint);
+	lf_assert(_e == lf_success, failure, E_FMR, "The script failed on device '%s'.", device->configuration.name);
+	return result.value;
+
+release:
+	lf_lane_release(device->endpoint);
+failure:
+	free(_packet);
+	return lf_error;
+}
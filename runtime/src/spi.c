@@ -21,11 +21,11 @@ LF_WEAK int spi_configure() {
 }
 
 LF_WEAK void spi_enable(void) {
-	lf_invoke(&_spi, _spi_enable, lf_int_t, NULL);
+	lf_invoke(&_spi, _spi_enable, lf_void_t, NULL);
 }
 
 LF_WEAK void spi_disable(void) {
-	lf_invoke(&_spi, _spi_disable, lf_int_t, NULL);
+	lf_invoke(&_spi, _spi_disable, lf_void_t, NULL);
 }
 
 LF_WEAK uint8_t spi_ready(void) {
@@ -33,7 +33,7 @@ LF_WEAK uint8_t spi_ready(void) {
 }
 
 LF_WEAK void spi_put(uint8_t byte) {
-	lf_invoke(&_spi, _spi_put, lf_int_t, lf_args(lf_infer(byte)));
+	lf_invoke(&_spi, _spi_put, lf_void_t, lf_args(lf_infer(byte)));
 }
 
 LF_WEAK uint8_t spi_get(void) {
@@ -41,11 +41,11 @@ LF_WEAK uint8_t spi_get(void) {
 }
 
 LF_WEAK int spi_push(void *source, uint32_t length) {
-	return lf_push(&_spi, _spi_push, source, length, NULL);
+	return lf_push_segments(&_spi, _spi_push, source, length, NULL);
 }
 
 LF_WEAK int spi_pull(void *destination, uint32_t length) {
-	return lf_pull(&_spi, _spi_pull, destination, length, NULL);
+	return lf_pull_segments(&_spi, _spi_pull, destination, length, NULL);
 }
 
 #endif
@@ -8,7 +8,9 @@ LF_MODULE(_task, "task", "Pause, resume, or stop tasks running in the scheduler.
 const struct _task_interface task = {
 	os_task_pause,
 	os_task_resume,
-	os_task_stop
+	os_task_stop,
+	os_task_priority,
+	os_task_stack
 };
 
 LF_WEAK int os_task_pause(int pid) {
@@ -23,4 +25,12 @@ LF_WEAK int os_task_stop(int pid) {
 	return lf_invoke(&_task, _task_stop, lf_int_t, lf_args(lf_infer(pid)));
 }
 
+LF_WEAK int os_task_priority(int pid, int priority) {
+	return lf_invoke(&_task, _task_priority, lf_int_t, lf_args(lf_infer(pid), lf_infer(priority)));
+}
+
+LF_WEAK int os_task_stack(int pid) {
+	return lf_invoke(&_task, _task_stack, lf_int_t, lf_args(lf_infer(pid)));
+}
+
 #endif
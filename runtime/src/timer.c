@@ -6,11 +6,21 @@ LF_MODULE(_timer, "timer", "Interfaces with the device's timer peripheral.", NUL
 
 /* Define the virtual interface for this module. */
 const struct _timer_interface timer = {
-	timer_configure
+	timer_configure,
+	timer_start,
+	timer_stop
 };
 
 LF_WEAK int timer_configure(void) {
 	return lf_invoke(&_timer, _timer_configure, lf_int_t, NULL);
 }
 
+LF_WEAK int timer_start(void *callback, void *ctx, uint32_t delay, uint32_t period) {
+	return lf_invoke(&_timer, _timer_start, lf_int_t, lf_args(lf_ptr(callback), lf_ptr(ctx), lf_infer(delay), lf_infer(period)));
+}
+
+LF_WEAK int timer_stop(int id) {
+	return lf_invoke(&_timer, _timer_stop, lf_int_t, lf_args(lf_infer(id)));
+}
+
 #endif
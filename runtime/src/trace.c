@@ -0,0 +1,30 @@
+#include <flipper/trace.h>
+
+#ifdef __use_trace__
+
+LF_MODULE(_trace, "trace", "Records the events of the device's kernel.", NULL, NULL);
+
+/* Define the virtual interface for this module. */
+const struct _trace_interface trace = {
+	os_trace_enable,
+	os_trace_read,
+	os_trace_frequency
+};
+
+LF_WEAK int os_trace_enable(uint32_t mask) {
+	return lf_invoke(&_trace, _trace_enable, lf_int_t, lf_args(lf_infer(mask)));
+}
+
+LF_WEAK int os_trace_read(void *destination, lf_size_t length) {
+	/* The read gives the number of events it took, so it is kept to a single segment rather than split, and the caller reads again for more. */
+	lf_size_t segment = LF_SEGMENT_SIZE - LF_SEGMENT_SIZE % sizeof(struct _trace_event);
+	if (length <= segment) return lf_pull(&_trace, _trace_read, destination, length, NULL);
+	memset((uint8_t *)destination + segment, 0, length - segment);
+	return lf_pull(&_trace, _trace_read, destination, segment, NULL);
+}
+
+LF_WEAK uint32_t os_trace_frequency(void) {
+	return lf_invoke(&_trace, _trace_frequency, lf_uint32_t, NULL);
+}
+
+#endif
@@ -22,11 +22,11 @@ LF_WEAK int uart0_ready(void) {
 }
 
 LF_WEAK int uart0_push(void *source, lf_size_t length) {
-	return lf_push(&_uart0, _uart0_push, source, length, NULL);
+	return lf_push_segments(&_uart0, _uart0_push, source, length, NULL);
 }
 
 LF_WEAK int uart0_pull(void *destination, lf_size_t length) {
-	return lf_pull(&_uart0, _uart0_pull, destination, length, NULL);
+	return lf_pull_segments(&_uart0, _uart0_pull, destination, length, NULL);
 }
 
 #endif
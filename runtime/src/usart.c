@@ -22,11 +22,11 @@ LF_WEAK int usart_ready(void) {
 }
 
 LF_WEAK int usart_push(void *source, lf_size_t length) {
-	return lf_push(&_usart, _usart_push, source, length, NULL);
+	return lf_push_segments(&_usart, _usart_push, source, length, NULL);
 }
 
 LF_WEAK int usart_pull(void *destination, lf_size_t length) {
-	return lf_pull(&_usart, _usart_pull, destination, length, NULL);
+	return lf_pull_segments(&_usart, _usart_pull, destination, length, NULL);
 }
 
 #endif
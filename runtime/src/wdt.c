@@ -15,7 +15,7 @@ LF_WEAK int wdt_configure(void) {
 }
 
 LF_WEAK void wdt_fire(void) {
-	lf_invoke(&_wdt, _wdt_fire, lf_int_t, NULL);
+	lf_invoke(&_wdt, _wdt_fire, lf_void_t, NULL);
 }
 
 #endif
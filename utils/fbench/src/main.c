@@ -0,0 +1,106 @@
+#include <flipper.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+/* The number of invocations timed per measurement. */
+#define FBENCH_ITERATIONS 1000
+/* The size of each write made by the thread that streams data while latency is measured. It is larger than a segment, so that it
+   travels through the bulk lane. */
+#define FBENCH_STREAM_SIZE (16 * 1024)
+
+/* Returns the current time in microseconds. */
+static uint64_t fbench_now(void) {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/* Times repeated reads of the button, which both chips of a carbon device implement. */
+static void fbench_measure(const char *label) {
+	uint64_t min = UINT64_MAX, max = 0, total = 0;
+	for (int i = 0; i < FBENCH_ITERATIONS; i ++) {
+		uint64_t start = fbench_now();
+		button_read();
+		uint64_t elapsed = fbench_now() - start;
+		if (elapsed < min) min = elapsed;
+		if (elapsed > max) max = elapsed;
+		total += elapsed;
+	}
+	printf("%-10s mean %8.1fus  min %6llu us  max %6llu us\n", label, (double)total / FBENCH_ITERATIONS, (unsigned long long)min, (unsigned long long)max);
+}
+
+static int fbench_compare(const void *a, const void *b) {
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return (x > y) - (x < y);
+}
+
+/* Times each read of the button, reporting the median and 99th percentile of their latency. */
+static void fbench_latency(const char *label) {
+	static uint64_t samples[FBENCH_ITERATIONS];
+	for (int i = 0; i < FBENCH_ITERATIONS; i ++) {
+		uint64_t start = fbench_now();
+		button_read();
+		samples[i] = fbench_now() - start;
+	}
+	qsort(samples, FBENCH_ITERATIONS, sizeof(uint64_t), fbench_compare);
+	printf("%-10s p50 %6llu us  p99 %6llu us  max %6llu us\n", label, (unsigned long long)samples[FBENCH_ITERATIONS / 2], (unsigned long long)samples[FBENCH_ITERATIONS * 99 / 100], (unsigned long long)samples[FBENCH_ITERATIONS - 1]);
+}
+
+/* Set once the latency has been measured, ending the stream. */
+static volatile bool fbench_streaming;
+/* The number of bytes streamed while the latency was measured. */
+static uint64_t fbench_streamed;
+
+/* Streams data into a scratch buffer on the device until the measurement ends. The buffer is only written, so the stream has no
+   effect on the device beyond the time it takes. */
+static void *fbench_stream(void *ctx) {
+	struct _lf_remote *remote = ctx;
+	uint8_t *data = calloc(1, FBENCH_STREAM_SIZE);
+	if (!data) return NULL;
+	while (fbench_streaming) {
+		if (lf_remote_write(remote, 0, data, FBENCH_STREAM_SIZE) != lf_success) break;
+		fbench_streamed += FBENCH_STREAM_SIZE;
+	}
+	free(data);
+	return NULL;
+}
+
+int main(int argc, char *argv[]) {
+
+	/* Attach over the network if a hostname is given, otherwise over USB. */
+	struct _lf_device *device = (argc > 1) ? carbon_attach_hostname(argv[1]) : flipper.attach();
+	if (!device) {
+		fprintf(stderr, "Failed to attach to a carbon device.\n");
+		exit(EXIT_FAILURE);
+	}
+
+	/* Measure the calls as routed by the device. */
+	fbench_measure("routed");
+
+	/* Measure the latency of the same calls, first alone and then while another thread streams data to the device. */
+	fbench_latency("idle");
+	pthread_t stream;
+	struct _lf_remote *remote = lf_remote_alloc(device, FBENCH_STREAM_SIZE);
+	fbench_streaming = true;
+	if (!remote) {
+		fprintf(stderr, "The device could not allocate a buffer to stream into; skipping the streaming measurement.\n");
+	} else if (!pthread_create(&stream, NULL, fbench_stream, remote)) {
+		uint64_t start = fbench_now();
+		fbench_latency("streaming");
+		fbench_streaming = false;
+		pthread_join(stream, NULL);
+		printf("%-10s %.1f KB/s alongside\n", "", (double)fbench_streamed * 1000000 / 1024 / (fbench_now() - start));
+	} else {
+		fprintf(stderr, "Failed to start a thread to stream data; skipping the streaming measurement.\n");
+	}
+	if (remote) lf_remote_free(remote);
+
+	/* Measure the same calls when forced across the bridge to the 4s. */
+	if (carbon_pin_module(device, &_button, carbon_4s_chip) == lf_success) {
+		fbench_measure("bridged");
+	} else {
+		fprintf(stderr, "The device does not route its calls; skipping the bridged measurement.\n");
+	}
+
+	return EXIT_SUCCESS;
+}
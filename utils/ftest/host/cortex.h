@@ -0,0 +1,16 @@
+/* cortex.h - Host stand-ins for the Cortex-M intrinsics used by the kernel, so that its sources can be tested natively. */
+
+#ifndef __cortex_h__
+#define __cortex_h__
+
+#include <stdint.h>
+
+/* Interrupts are never taken by a test, so masking them does nothing. */
+static inline uint32_t __get_PRIMASK(void) { return 0; }
+static inline void __set_PRIMASK(uint32_t primask) { (void)primask; }
+static inline void __disable_irq(void) { }
+static inline void __enable_irq(void) { }
+/* A test always runs in thread mode. */
+static inline uint32_t __get_IPSR(void) { return 0; }
+
+#endif
@@ -0,0 +1,118 @@
+/* Performs inline pushes, whole and cut short, checking that only the whole ones reach their call and that they carry their data intact,
+   then creates calls for each kind of device, checking that those it cannot pass are refused. */
+
+#include "harness.h"
+#include <flipper.h>
+
+/* The longest push tried. */
+#define FMR_DATA 64
+
+/* The index of uart0 in the host's module table, whose push is the call made by each packet. */
+static uint8_t fmr_uart0;
+
+static uint8_t fmr_received[FMR_MAX_PACKET_SIZE];
+static lf_size_t fmr_received_length;
+static int fmr_calls;
+
+/* Stands in for the host's uart0_push, keeping what the packet gave it. */
+int uart0_push(void *source, lf_size_t length) {
+	fmr_calls ++;
+	if (length > sizeof(fmr_received)) test_fail("a push of %u bytes reached its call.", (unsigned)length);
+	memcpy(fmr_received, source, length);
+	fmr_received_length = length;
+	return lf_success;
+}
+
+/* Builds an inline push of the data into the packet, as lf_push does, and gives its length. */
+static uint16_t fmr_build_push(uint8_t *buffer, const uint8_t *data, lf_size_t length) {
+	struct _fmr_packet *_packet = (struct _fmr_packet *)buffer;
+	struct _fmr_push_pull_packet *packet = (struct _fmr_push_pull_packet *)buffer;
+	memset(buffer, 0, FMR_MAX_PACKET_SIZE);
+	_packet->header.magic = FMR_MAGIC_NUMBER;
+	_packet->header.length = sizeof(struct _fmr_push_pull_packet);
+	_packet->header.type = fmr_push_class | fmr_inline_flag;
+	packet->length = length;
+	int _e = lf_create_call(fmr_uart0, _uart0_push, lf_int_t, lf_args(lf_ptr(NULL), lf_infer(length)), &_packet->header, &packet->call, FMR_MAX_PACKET_SIZE, NULL);
+	if (_e != lf_success) test_fail("the call of a push of %u bytes could not be created.", (unsigned)length);
+	memcpy(buffer + _packet->header.length, data, length);
+	_packet->header.length += length;
+	return _packet->header.length;
+}
+
+/* Performs the packet as though it were 'length' bytes long, giving the value returned by its call. */
+static int fmr_perform_as(uint8_t *buffer, uint16_t length) {
+	struct _fmr_packet *packet = (struct _fmr_packet *)buffer;
+	struct _fmr_result result = { 0 };
+	packet->header.length = length;
+	packet->header.checksum = 0;
+	packet->header.checksum = lf_crc(packet, length);
+	lf_error_clear();
+	if (fmr_perform(packet, &result) != lf_success) return lf_error;
+	return (result.error == E_OK) ? (int)result.value : lf_error;
+}
+
+/* Creates a call to uart0 with the arguments given, as it would be sent to the device described by 'configuration', giving the error it raised. */
+static lf_error_t fmr_create_as(const struct _lf_configuration *configuration, struct _lf_ll *args) {
+	uint8_t buffer[FMR_MAX_PACKET_SIZE] = { 0 };
+	struct _fmr_invocation_packet *packet = (struct _fmr_invocation_packet *)buffer;
+	packet->header.length = sizeof(struct _fmr_invocation_packet);
+	lf_error_clear();
+	lf_create_call(fmr_uart0, _uart0_push, lf_int_t, args, &packet->header, &packet->call, sizeof(buffer), configuration);
+	return lf_error_get();
+}
+
+/* Checks that each device is refused the calls its 'fmr_call' cannot pass, and only those. */
+static void fmr_check_callable(void) {
+	const struct _lf_configuration u2 = { "carbon-u2", 0, LF_VERSION, lf_device_8bit, { FMR_PACKET_SIZE, FMR_COMMON_CLASSES | FMR_INLINE_CAPABILITY, 1, fmr_compression_none, 0 } };
+	const struct _lf_configuration s4 = { "carbon-4s", 0, LF_VERSION, lf_device_32bit, { FMR_PACKET_SIZE, FMR_COMMON_CLASSES | FMR_INLINE_CAPABILITY, 1, fmr_compression_none, 0 } };
+	const struct _lf_configuration fvm = { "fvm", 0, LF_VERSION, lf_device_32bit, { FMR_PACKET_SIZE, FMR_COMMON_CLASSES | FMR_INLINE_CAPABILITY | FMR_WIDE_CAPABILITY, 1, fmr_compression_none, 0 } };
+	struct { const struct _lf_configuration *device; struct _lf_ll *args; lf_error_t error; const char *call; } cases[] = {
+		{ &u2, lf_args(lf_uint16(1), lf_uint16(2), lf_uint16(3), lf_uint16(4), lf_uint16(5), lf_uint16(6), lf_uint16(7), lf_uint16(8)), E_OK, "8 16-bit arguments" },
+		{ &u2, lf_args(lf_uint8(1), lf_uint8(2), lf_uint8(3), lf_uint8(4), lf_uint8(5), lf_uint8(6), lf_uint8(7), lf_uint8(8), lf_uint8(9)), E_OVERFLOW, "9 8-bit arguments" },
+		{ &u2, lf_args(lf_uint32(1), lf_uint32(2), lf_uint32(3), lf_uint32(4), lf_uint8(5)), E_OK, "18 bytes of arguments" },
+		{ &u2, lf_args(lf_uint32(1), lf_uint32(2), lf_uint32(3), lf_uint32(4), lf_uint32(5)), E_OVERFLOW, "20 bytes of arguments" },
+		{ &u2, lf_args(lf_intx(lf_uint64_t, 1)), E_TYPE, "a 64-bit argument" },
+		{ &s4, lf_args(lf_uint8(1), lf_uint8(2), lf_uint8(3), lf_uint8(4), lf_uint8(5), lf_uint8(6), lf_uint8(7), lf_uint8(8), lf_uint8(9), lf_uint8(10), lf_uint8(11), lf_uint8(12), lf_uint8(13), lf_uint8(14), lf_uint8(15), lf_uint8(16)), E_OK, "16 arguments" },
+		{ &s4, lf_args(lf_uint32(1), lf_intx(lf_int64_t, -1)), E_TYPE, "a 64-bit argument" },
+		{ &fvm, lf_args(lf_uint32(1), lf_intx(lf_int64_t, -1)), E_OK, "a 64-bit argument" }
+	};
+	for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i ++) {
+		lf_error_t error = fmr_create_as(cases[i].device, cases[i].args);
+		if (error != cases[i].error) test_fail("a call with %s to '%s' raised %i rather than %i.", cases[i].call, cases[i].device->name, error, cases[i].error);
+	}
+	test_report("%u calls were refused or created as their devices allow.", (unsigned)(sizeof(cases) / sizeof(cases[0])));
+}
+
+int main(int argc, char *argv[]) {
+	test_name = "fmr";
+	/* The packets cut short are expected to raise errors, which are checked rather than printed. */
+	lf_error_pause();
+	while (strcmp(lf_module_descriptors[fmr_uart0].name, "uart0")) fmr_uart0 ++;
+
+	uint8_t packet[FMR_MAX_PACKET_SIZE], data[FMR_DATA];
+	int refused = 0;
+	for (lf_size_t length = 1; length <= FMR_DATA; length ++) {
+		for (lf_size_t i = 0; i < length; i ++) data[i] = (uint8_t)(length + i * 7);
+		/* The whole packet reaches its call with its data. */
+		uint16_t whole = fmr_build_push(packet, data, length);
+		fmr_calls = 0;
+		if (fmr_perform_as(packet, whole) != lf_success) test_fail("a whole push of %u bytes failed.", (unsigned)length);
+		if (fmr_calls != 1 || fmr_received_length != length || memcmp(fmr_received, data, length)) test_fail("a whole push of %u bytes did not carry its data.", (unsigned)length);
+		/* Every shorter packet, down to a bare header, is refused before its call. */
+		for (uint16_t cut = sizeof(struct _fmr_header); cut < whole; cut ++) {
+			fmr_build_push(packet, data, length);
+			fmr_calls = 0;
+			if (fmr_perform_as(packet, cut) != lf_error || fmr_calls) test_fail("a push of %u bytes cut to %u bytes was performed.", (unsigned)length, cut);
+			refused ++;
+		}
+		/* As is a packet claiming more data than it carries. */
+		fmr_build_push(packet, data, length);
+		((struct _fmr_push_pull_packet *)packet)->length = whole;
+		fmr_calls = 0;
+		if (fmr_perform_as(packet, whole) != lf_error || fmr_calls) test_fail("a push of %u bytes claiming %u was performed.", (unsigned)length, whole);
+		refused ++;
+	}
+	test_report("%u whole pushes passed, and %d pushes cut short were refused.", FMR_DATA, refused);
+	fmr_check_callable();
+	return EXIT_SUCCESS;
+}
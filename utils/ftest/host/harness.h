@@ -0,0 +1,49 @@
+/* harness.h - The harness shared by the host tests, which replay seeded random traces and stop at the first failure. */
+
+#ifndef __harness_h__
+#define __harness_h__
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* The name of the running test, which prefixes what it reports. */
+static const char *test_name = "test";
+
+/* Reports a failure and ends the test. */
+#define test_fail(...) do { fprintf(stderr, "%s: ", test_name); fprintf(stderr, __VA_ARGS__); fprintf(stderr, "\n"); exit(EXIT_FAILURE); } while (0)
+
+/* Reports the progress of the test. */
+#define test_report(...) do { printf("%s: ", test_name); printf(__VA_ARGS__); printf("\n"); } while (0)
+
+/* Chooses one of 'count' cases at random, each as likely as its weight is of the total. */
+static inline int test_choose(const unsigned *weights, int count) {
+	unsigned total = 0;
+	for (int i = 0; i < count; i ++) total += weights[i];
+	unsigned pick = rand() % total;
+	for (int i = 0; i < count; i ++) {
+		if (pick < weights[i]) return i;
+		pick -= weights[i];
+	}
+	return count - 1;
+}
+
+/* Chooses among the cases whose weights are given, in order. */
+#define test_choice(...) test_choose((const unsigned []){ __VA_ARGS__ }, sizeof((const unsigned []){ __VA_ARGS__ }) / sizeof(unsigned))
+
+/* Replays the trace of each seed from 1 to 'traces', or only that of the seed given on the command line. */
+static inline int test_replay(const char *name, int argc, char *argv[], void (* trace)(unsigned seed), unsigned traces) {
+	test_name = name;
+	if (argc > 1) {
+		unsigned seed = strtoul(argv[1], NULL, 0);
+		srand(seed);
+		trace(seed);
+		return EXIT_SUCCESS;
+	}
+	for (unsigned seed = 1; seed <= traces; seed ++) {
+		srand(seed);
+		trace(seed);
+	}
+	return EXIT_SUCCESS;
+}
+
+#endif
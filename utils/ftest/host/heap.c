@@ -0,0 +1,177 @@
+/* Allocates, resizes, and frees at random from the kernel's heap, walking its blocks and free lists to see that they still tile the heap. */
+
+#include "cortex.h"
+#include "harness.h"
+#include <flipper.h>
+
+/* The heap replaces the C library's allocator on the device. Here it is built under other names, so that the test keeps the host's. */
+#define malloc os_test_malloc
+#define calloc os_test_calloc
+#define realloc os_test_realloc
+#define free os_test_free
+#define _malloc_r os_test_malloc_r
+#define _calloc_r os_test_calloc_r
+#define _realloc_r os_test_realloc_r
+#define _free_r os_test_free_r
+#include "../../../kernel/arch/armv7/heap.c"
+#undef malloc
+#undef calloc
+#undef realloc
+#undef free
+
+volatile uint32_t os_trace_mask;
+void os_trace_record(uint8_t kind, uint32_t arg) { }
+unsigned char __heap_end__;
+char *_sbrk(int increment) { return (char *)(-1); }
+
+/* The size of the memory given to the heap. */
+#define HEAP_SIZE (256 * 1024)
+/* The most allocations held at once, and the number of steps of each trace. */
+#define HEAP_SLOTS 256
+#define HEAP_STEPS 50000
+#define HEAP_TRACES 8
+
+static uint8_t heap_memory[HEAP_SIZE + OS_HEAP_ALIGN];
+/* The size of the region set aside for the pools, ahead of the blocks of the heap. */
+static size_t heap_reserve;
+
+/* An allocation held by the trace, filled with a pattern so that blocks overwritten by the heap are caught. */
+static struct {
+	uint8_t *pointer;
+	size_t size;
+	uint8_t pattern;
+} heap_slots[HEAP_SLOTS];
+
+/* Gives a size, mostly small enough for the pools, sometimes of a few blocks, and rarely large. */
+static size_t heap_size(void) {
+	switch (test_choice(60, 35, 5)) {
+		case 0: return rand() % (8 * OS_HEAP_ALIGN) + 1;
+		case 1: return rand() % 2048 + 1;
+		default: return rand() % (HEAP_SIZE / 8) + 1;
+	}
+}
+
+static void heap_fill(int i) {
+	heap_slots[i].pattern = (uint8_t)rand();
+	for (size_t j = 0; j < heap_slots[i].size; j ++) heap_slots[i].pointer[j] = (uint8_t)(heap_slots[i].pattern + j);
+}
+
+static void heap_verify(int i, size_t size) {
+	for (size_t j = 0; j < size; j ++) {
+		if (heap_slots[i].pointer[j] != (uint8_t)(heap_slots[i].pattern + j)) test_fail("the allocation in slot %d was overwritten at byte %zu.", i, j);
+	}
+}
+
+/* Walks the blocks of the heap and its free lists, checking that they agree with each other and with the usage counted. */
+static void heap_check(void) {
+	size_t free_blocks = 0, free_bytes = 0, heap_bytes = 0;
+	bool prev_free = false;
+	struct _os_block *prev = NULL;
+	struct _os_block *block = (struct _os_block *)os_heap.pool_end;
+	/* The blocks tile the heap, up to the empty block that marks its end. */
+	while (os_block_size(block)) {
+		if ((uintptr_t)block % OS_HEAP_ALIGN) test_fail("a block is misaligned.");
+		if (!!(block->size & OS_BLOCK_PREV_FREE) != prev_free) test_fail("a block does not know whether the block before it is free.");
+		if (prev_free && block->prev != prev) test_fail("a block does not point to the free block before it.");
+		if (block->size & OS_BLOCK_POOLED) test_fail("a block of the heap is marked as pooled.");
+		if (block->size & OS_BLOCK_FREE) {
+			if (prev_free) test_fail("two free blocks were not merged.");
+			free_blocks ++;
+			free_bytes += OS_HEAP_HEADER + os_block_size(block);
+		}
+		heap_bytes += OS_HEAP_HEADER + os_block_size(block);
+		prev_free = (block->size & OS_BLOCK_FREE);
+		prev = block;
+		block = os_block_next(block);
+		if ((uint8_t *)block >= heap_memory + sizeof(heap_memory)) test_fail("the blocks run past the end of the heap.");
+	}
+	if (!!(block->size & OS_BLOCK_PREV_FREE) != prev_free) test_fail("the end of the heap does not know whether the block before it is free.");
+	if (heap_bytes + OS_HEAP_HEADER + heap_reserve != os_heap.stats.size) test_fail("the blocks do not tile the heap.");
+	/* Every free block is in the list of its size class, and a class has a bit set in the maps exactly when its list is not empty. */
+	size_t listed = 0;
+	for (int fl = 0; fl < OS_HEAP_FL_COUNT; fl ++) {
+		if (!!(os_heap.fl_map & (1UL << fl)) != !!os_heap.sl_map[fl]) test_fail("the map of powers of two disagrees with the map of class %d.", fl);
+		for (int sl = 0; sl < OS_HEAP_SL_COUNT; sl ++) {
+			struct _os_block *head = os_heap.blocks[fl][sl];
+			if (!!(os_heap.sl_map[fl] & (1UL << sl)) != !!head) test_fail("the map of class %d disagrees with its list %d.", fl, sl);
+			for (struct _os_block *free_block = head; free_block; free_block = free_block->next_free) {
+				int _fl, _sl;
+				os_heap_mapping(os_block_size(free_block), &_fl, &_sl);
+				if (_fl != fl || _sl != sl) test_fail("a free block is in the list of another size class.");
+				if (!(free_block->size & OS_BLOCK_FREE)) test_fail("a block in use is in a free list.");
+				if (free_block->next_free && free_block->next_free->prev_free != free_block) test_fail("a free list is not linked both ways.");
+				listed ++;
+			}
+		}
+	}
+	if (listed != free_blocks) test_fail("%zu blocks are free, but %zu are listed.", free_blocks, listed);
+	if (free_bytes != os_heap.stats.available) test_fail("%zu bytes are free, but %u are counted.", free_bytes, os_heap.stats.available);
+	if (os_heap.stats.used + os_heap.stats.available != os_heap.stats.size) test_fail("the bytes in use and free do not add up to the heap.");
+}
+
+/* Checks that the allocations held are aligned, as large as asked for, and do not overlap. */
+static void heap_check_slots(void) {
+	uint32_t held = 0;
+	for (int i = 0; i < HEAP_SLOTS; i ++) {
+		if (!heap_slots[i].pointer) continue;
+		held ++;
+		if ((uintptr_t)heap_slots[i].pointer % OS_HEAP_ALIGN) test_fail("an allocation is misaligned.");
+		if (os_block_size(os_block_from(heap_slots[i].pointer)) < heap_slots[i].size) test_fail("an allocation is smaller than was asked for.");
+		for (int j = i + 1; j < HEAP_SLOTS; j ++) {
+			if (!heap_slots[j].pointer) continue;
+			if (heap_slots[i].pointer < heap_slots[j].pointer + heap_slots[j].size && heap_slots[j].pointer < heap_slots[i].pointer + heap_slots[i].size) test_fail("two allocations overlap.");
+		}
+	}
+	if (held != os_heap.stats.allocations) test_fail("%u allocations are held, but %u are counted.", held, os_heap.stats.allocations);
+}
+
+static void heap_trace(unsigned seed) {
+	memset(heap_slots, 0, sizeof(heap_slots));
+	if (os_heap_init(heap_memory + seed % OS_HEAP_ALIGN, HEAP_SIZE) != lf_success) test_fail("the heap could not be initialized.");
+	heap_reserve = os_heap.pool_end - os_heap.pool_next;
+	size_t available = os_heap.stats.available;
+	for (int step = 0; step < HEAP_STEPS; step ++) {
+		int i = rand() % HEAP_SLOTS;
+		if (!heap_slots[i].pointer) {
+			/* Allocate into an empty slot. */
+			size_t size = heap_size();
+			uint8_t *pointer = os_heap_alloc(size);
+			if (!pointer) continue;
+			heap_slots[i].pointer = pointer;
+			heap_slots[i].size = size;
+			heap_fill(i);
+		} else if (test_choice(1, 2) == 0) {
+			/* Resize an allocation, which keeps its contents. */
+			size_t size = heap_size();
+			uint8_t *pointer = os_heap_realloc(heap_slots[i].pointer, size);
+			if (!pointer) {
+				heap_verify(i, heap_slots[i].size);
+				continue;
+			}
+			heap_slots[i].pointer = pointer;
+			heap_verify(i, (size < heap_slots[i].size) ? size : heap_slots[i].size);
+			heap_slots[i].size = size;
+			heap_fill(i);
+		} else {
+			heap_verify(i, heap_slots[i].size);
+			os_heap_free(heap_slots[i].pointer);
+			heap_slots[i].pointer = NULL;
+		}
+		heap_check();
+		if (!(step % 64)) heap_check_slots();
+	}
+	for (int i = 0; i < HEAP_SLOTS; i ++) {
+		if (!heap_slots[i].pointer) continue;
+		heap_verify(i, heap_slots[i].size);
+		os_heap_free(heap_slots[i].pointer);
+		heap_slots[i].pointer = NULL;
+	}
+	heap_check();
+	/* Once everything is freed, the heap outside the pools is a single free block again. */
+	if (os_heap.stats.available != available || os_heap.stats.allocations) test_fail("the heap was not whole once every allocation was freed.");
+	test_report("trace %u passed, with %u failures and a peak of %u bytes.", seed, os_heap.stats.failures, os_heap.stats.peak);
+}
+
+int main(int argc, char *argv[]) {
+	return test_replay("heap", argc, argv, heap_trace, HEAP_TRACES);
+}
@@ -0,0 +1,51 @@
+/* Streams a counting sequence from a producer thread to a consumer thread through rings, checking that every byte arrives once and in order. */
+
+#include "harness.h"
+#include <flipper.h>
+#include <flipper/ring.h>
+#include <pthread.h>
+#include <sched.h>
+
+/* The number of bytes streamed through each ring. */
+#define RING_ITEMS 5000000u
+
+/* The largest ring, whose indices wrap with their byte, and a small one, which fills and empties far more often. */
+LF_RING(ring_large, 256);
+LF_RING(ring_small, 8);
+
+/* Puts the sequence into the ring, yielding whenever it is full. */
+static void *ring_produce(void *ctx) {
+	struct _lf_ring *ring = ctx;
+	for (uint32_t i = 0; i < RING_ITEMS; ) {
+		if (lf_ring_put(ring, (uint8_t)i)) i ++;
+		else sched_yield();
+	}
+	return NULL;
+}
+
+static void ring_stream(const char *name, struct _lf_ring *ring) {
+	pthread_t producer;
+	if (pthread_create(&producer, NULL, ring_produce, ring)) test_fail("failed to start the producer of the %s ring.", name);
+	uint32_t full = 0;
+	for (uint32_t i = 0; i < RING_ITEMS; ) {
+		uint8_t byte;
+		if (!lf_ring_get(ring, &byte)) {
+			sched_yield();
+			continue;
+		}
+		if (byte != (uint8_t)i) test_fail("byte %u of the %s ring was %u rather than %u.", i, name, byte, (uint8_t)i);
+		/* The ring was full before this byte was taken. */
+		if (lf_ring_count(ring) == ring->mask - 1) full ++;
+		i ++;
+	}
+	pthread_join(producer, NULL);
+	if (!lf_ring_empty(ring) || lf_ring_count(ring)) test_fail("the %s ring was not empty once the sequence was consumed.", name);
+	test_report("the %s ring passed %u bytes in order, taking %u of them from a full ring.", name, RING_ITEMS, full);
+}
+
+int main(int argc, char *argv[]) {
+	test_name = "ring";
+	ring_stream("large", &ring_large);
+	ring_stream("small", &ring_small);
+	return EXIT_SUCCESS;
+}
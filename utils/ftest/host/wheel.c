@@ -0,0 +1,175 @@
+/* Starts, stops, and turns the kernel's timer wheel at random alongside a model of when each timer should expire, and compares the two. */
+
+#include "cortex.h"
+#include "harness.h"
+#include <flipper.h>
+#include <os/scheduler.h>
+#include <os/sync.h>
+
+/* Whether the platform's tick is running. */
+static bool wheel_clock;
+
+void os_timer_clock(bool run) { wheel_clock = run; }
+void os_semaphore_init(struct _os_semaphore *semaphore, uint32_t count) { semaphore->count = count; }
+void os_semaphore_post(struct _os_semaphore *semaphore) { semaphore->count ++; }
+int os_semaphore_wait(struct _os_semaphore *semaphore) { return lf_success; }
+struct _os_task *os_task_create(void *_entry, void (* _exit)(void *_ctx), void *_ctx, uint32_t stack_size) { static struct _os_task task; return &task; }
+int os_task_add(struct _os_task *task) { return lf_success; }
+
+/* The wheel's callbacks are taken from the expired timers by the test, rather than by its task. */
+#include "../../../kernel/arch/armv7/timer.c"
+
+/* The number of timers, and the number of steps of each trace. */
+#define WHEEL_TIMERS 256
+#define WHEEL_STEPS 200000
+#define WHEEL_TRACES 4
+
+static struct _os_timer wheel_timers[WHEEL_TIMERS];
+
+/* What the wheel should hold for each timer. */
+static struct {
+	bool armed;
+	bool expired;
+	uint32_t expires;
+	uint32_t period;
+	uint32_t overruns;
+} wheel_model[WHEEL_TIMERS];
+
+/* The timers the model expects to have expired, in the order in which they expired. */
+static int wheel_expired[WHEEL_TIMERS];
+static int wheel_expired_count;
+
+static void wheel_callback(void *ctx) { }
+
+/* Gives a delay in ticks, mostly within the lowest levels of the wheel, and sometimes as long as can be given in microseconds. */
+static uint32_t wheel_ticks(void) {
+	switch (test_choice(50, 30, 15, 5)) {
+		case 0: return rand() % OS_TIMER_SLOTS;
+		case 1: return rand() % (OS_TIMER_SLOTS * OS_TIMER_SLOTS);
+		case 2: return rand() % (1UL << (OS_TIMER_SLOT_BITS * 3));
+		default: return rand() % (UINT32_MAX / OS_TIMER_TICK_US);
+	}
+}
+
+/* Takes a timer out of the timers the model expects to have expired. */
+static void wheel_unexpire(int i) {
+	if (!wheel_model[i].expired) return;
+	wheel_model[i].expired = false;
+	int j = 0;
+	while (wheel_expired[j] != i) j ++;
+	memmove(&wheel_expired[j], &wheel_expired[j + 1], (wheel_expired_count - j - 1) * sizeof(int));
+	wheel_expired_count --;
+}
+
+static void wheel_start(int i) {
+	/* Times are given in microseconds, short of whole ticks, as the wheel rounds them up. */
+	uint32_t delay = wheel_ticks(), period = (rand() % 3) ? 0 : wheel_ticks() % (OS_TIMER_SLOTS * 4) + 1;
+	uint32_t delay_us = (delay) ? delay * OS_TIMER_TICK_US - rand() % OS_TIMER_TICK_US : 0;
+	uint32_t period_us = (period) ? period * OS_TIMER_TICK_US - rand() % OS_TIMER_TICK_US : 0;
+	if (os_timer_start(&wheel_timers[i], delay_us, period_us) != lf_success) test_fail("timer %d could not be started.", i);
+	wheel_unexpire(i);
+	wheel_model[i].armed = true;
+	wheel_model[i].expires = os_timers.now + ((delay) ? delay : 1);
+	wheel_model[i].period = period;
+	wheel_model[i].overruns = 0;
+}
+
+static void wheel_stop(int i) {
+	os_timer_stop(&wheel_timers[i]);
+	wheel_unexpire(i);
+	wheel_model[i].armed = false;
+}
+
+/* Turns the wheel, expiring the timers the model expects to expire. */
+static void wheel_tick(void) {
+	os_timer_tick();
+	uint32_t now = os_timers.now;
+	bool expiring[WHEEL_TIMERS] = { false };
+	int count = 0;
+	for (int i = 0; i < WHEEL_TIMERS; i ++) {
+		if (!wheel_model[i].armed || wheel_model[i].expires != now) continue;
+		if (wheel_model[i].expired) {
+			wheel_model[i].overruns ++;
+		} else {
+			wheel_model[i].expired = true;
+			expiring[i] = true;
+			count ++;
+		}
+		if (wheel_model[i].period) wheel_model[i].expires += wheel_model[i].period;
+		else wheel_model[i].armed = false;
+	}
+	/* Timers that expire on the same tick may be listed in any order, but after every timer that expired before them. */
+	struct _os_timer *timer = os_timers.expired_head;
+	for (int j = 0; j < wheel_expired_count && timer; j ++) timer = timer->next_expired;
+	for (; timer; timer = timer->next_expired) {
+		int i = timer - wheel_timers;
+		if (!expiring[i]) test_fail("timer %d expired at tick %u, which the model did not expect.", i, now);
+		expiring[i] = false;
+		wheel_expired[wheel_expired_count ++] = i;
+		count --;
+	}
+	if (count) test_fail("%d timers did not expire at tick %u.", count, now);
+}
+
+/* Takes the oldest expired timer, as the timer task would before calling its callback. */
+static void wheel_drain(void) {
+	struct _os_timer *timer = os_timers.expired_head;
+	if (!wheel_expired_count) {
+		if (timer) test_fail("a timer expired that the model did not expect to.");
+		return;
+	}
+	if (timer != &wheel_timers[wheel_expired[0]]) test_fail("timer %d should have been the first to expire.", wheel_expired[0]);
+	os_timer_unexpire(timer);
+	wheel_unexpire(wheel_expired[0]);
+}
+
+/* Checks that every timer and the list of expired timers agree with the model. */
+static void wheel_check(void) {
+	uint32_t armed = 0;
+	for (int i = 0; i < WHEEL_TIMERS; i ++) {
+		struct _os_timer *timer = &wheel_timers[i];
+		if (timer->armed != wheel_model[i].armed) test_fail("timer %d is %sarmed at tick %u.", i, (timer->armed) ? "" : "not ", os_timers.now);
+		if (timer->expired != wheel_model[i].expired) test_fail("timer %d has %sexpired at tick %u.", i, (timer->expired) ? "" : "not ", os_timers.now);
+		if (timer->armed && timer->expires != wheel_model[i].expires) test_fail("timer %d expires at tick %u rather than %u.", i, timer->expires, wheel_model[i].expires);
+		if (timer->overruns != wheel_model[i].overruns) test_fail("timer %d overran %u times rather than %u.", i, timer->overruns, wheel_model[i].overruns);
+		armed += timer->armed;
+	}
+	if (armed != os_timers.armed) test_fail("%u timers are armed, but %u are counted.", armed, os_timers.armed);
+	if (wheel_clock != (armed > 0)) test_fail("the tick is %srunning with %u timers armed.", (wheel_clock) ? "" : "not ", armed);
+	int count = 0;
+	for (struct _os_timer *timer = os_timers.expired_head; timer; timer = timer->next_expired) {
+		if (count >= wheel_expired_count || timer != &wheel_timers[wheel_expired[count]]) test_fail("the expired timers are out of order at tick %u.", os_timers.now);
+		count ++;
+	}
+	if (count != wheel_expired_count) test_fail("%d timers have expired, but %d were expected to.", count, wheel_expired_count);
+}
+
+static void wheel_trace(unsigned seed) {
+	memset(wheel_model, 0, sizeof(wheel_model));
+	wheel_expired_count = 0;
+	wheel_clock = false;
+	os_timer_init();
+	/* The trace begins shortly before the tick wraps, so that timers are placed across it. */
+	os_timers.now = UINT32_MAX - (rand() % (OS_TIMER_SLOTS * OS_TIMER_SLOTS));
+	for (int i = 0; i < WHEEL_TIMERS; i ++) os_timer_create(&wheel_timers[i], wheel_callback, NULL);
+	uint32_t start = os_timers.now, expired = 0;
+	for (int step = 0; step < WHEEL_STEPS; step ++) {
+		int i = rand() % WHEEL_TIMERS;
+		switch (test_choice(3, 1, 66, 25, 5)) {
+			case 0: wheel_start(i); break;
+			case 1: wheel_stop(i); break;
+			case 2: wheel_tick(); break;
+			case 3:
+				if (wheel_expired_count) expired ++;
+				wheel_drain();
+			break;
+			default: break;
+		}
+		wheel_check();
+	}
+	test_report("trace %u passed over %u ticks, taking %u expired timers.", seed, os_timers.now - start, expired);
+}
+
+int main(int argc, char *argv[]) {
+	return test_replay("wheel", argc, argv, wheel_trace, WHEEL_TRACES);
+}
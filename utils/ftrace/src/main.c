@@ -0,0 +1,161 @@
+#include <flipper.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+/* The number of events read from the device at a time. */
+#define FTRACE_CHUNK 64
+/* How long to trace for by default, in milliseconds. */
+#define FTRACE_DEFAULT_DURATION 1000
+
+/* The threads of the trace that are not tasks. PIDs are below these. */
+#define FTRACE_FMR_TID 0x10000
+#define FTRACE_ISR_TID 0x10001
+
+/* Returns the current time in microseconds. */
+static uint64_t ftrace_now(void) {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/* The events read from the device. */
+static struct _trace_event *events;
+static size_t count, capacity;
+
+/* Reads the events recorded by the device so far, giving the number read. */
+static int ftrace_read(void) {
+	if (count + FTRACE_CHUNK > capacity) {
+		size_t grown = (capacity) ? capacity * 2 : 1024;
+		struct _trace_event *resized = realloc(events, grown * sizeof(struct _trace_event));
+		if (!resized) return lf_error;
+		events = resized;
+		capacity = grown;
+	}
+	int read = trace.read(&events[count], FTRACE_CHUNK * sizeof(struct _trace_event));
+	if (read > 0) count += read;
+	return read;
+}
+
+/* Writes an event of the Chrome trace format. The 'extra' members, if any, are written within it. */
+static void ftrace_emit(FILE *out, bool *first, const char *phase, double ts, uint32_t tid, const char *name, const char *extra) {
+	fprintf(out, "%s\n{\"ph\":\"%s\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"name\":\"%s\"%s%s}", (*first) ? "" : ",", phase, tid, ts, name, (extra) ? "," : "", (extra) ? extra : "");
+	*first = false;
+}
+
+/* Writes the events in the Chrome trace format, which chrome://tracing and Perfetto display. */
+static void ftrace_export(FILE *out, uint32_t frequency) {
+	bool first = true;
+	char name[64], extra[64];
+	fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+	ftrace_emit(out, &first, "M", 0, FTRACE_FMR_TID, "thread_name", "\"args\":{\"name\":\"fmr\"}");
+	ftrace_emit(out, &first, "M", 0, FTRACE_ISR_TID, "thread_name", "\"args\":{\"name\":\"interrupts\"}");
+
+	/* The cycle count wraps, so the time of each event is found from its distance to the event before it. */
+	uint64_t cycles = 0;
+	uint32_t last = (count) ? events[0].cycles : 0;
+	/* The bytes allocated since tracing began. */
+	int64_t allocated = 0;
+	/* The task that is running, which is only known once the first switch is seen. */
+	int64_t running = -1;
+	/* The tasks that have been named. */
+	static uint8_t named[(UINT16_MAX + 1) / 8];
+
+	for (size_t i = 0; i < count; i ++) {
+		struct _trace_event *event = &events[i];
+		cycles += (int32_t)(event->cycles - last);
+		last = event->cycles;
+		double ts = (double)cycles * 1000000 / frequency;
+		/* Events that happen within an interrupt are shown alongside the interrupts. */
+		uint32_t tid = (event->exception) ? FTRACE_ISR_TID : event->task;
+
+		if (i && event->sequence != events[i - 1].sequence + 1) {
+			snprintf(name, sizeof(name), "lost %u events", event->sequence - events[i - 1].sequence - 1);
+			ftrace_emit(out, &first, "i", ts, tid, name, "\"s\":\"g\"");
+		}
+
+		switch (event->kind) {
+			case lf_trace_switch:
+				if (running >= 0) ftrace_emit(out, &first, "E", ts, (uint32_t)running, "running", NULL);
+				if (!(named[(event->arg & UINT16_MAX) / 8] & (1 << (event->arg % 8)))) {
+					named[(event->arg & UINT16_MAX) / 8] |= (1 << (event->arg % 8));
+					snprintf(extra, sizeof(extra), "\"args\":{\"name\":\"task %u\"}", event->arg);
+					ftrace_emit(out, &first, "M", 0, event->arg, "thread_name", extra);
+				}
+				ftrace_emit(out, &first, "B", ts, event->arg, "running", NULL);
+				running = event->arg;
+			break;
+			case lf_trace_isr_enter:
+				snprintf(name, sizeof(name), "exception %u", event->exception);
+				ftrace_emit(out, &first, "B", ts, FTRACE_ISR_TID, name, NULL);
+			break;
+			case lf_trace_isr_exit:
+				ftrace_emit(out, &first, "E", ts, FTRACE_ISR_TID, "", NULL);
+			break;
+			case lf_trace_receive:
+				snprintf(name, sizeof(name), "receive class %u", event->arg);
+				ftrace_emit(out, &first, "i", ts, FTRACE_FMR_TID, name, "\"s\":\"t\"");
+			break;
+			case lf_trace_execute:
+				snprintf(name, sizeof(name), "perform class %u", event->arg);
+				ftrace_emit(out, &first, "B", ts, FTRACE_FMR_TID, name, NULL);
+			break;
+			case lf_trace_respond:
+				ftrace_emit(out, &first, "E", ts, FTRACE_FMR_TID, "", NULL);
+			break;
+			case lf_trace_alloc:
+			case lf_trace_free:
+				allocated += (event->kind == lf_trace_alloc) ? (int64_t)event->arg : -(int64_t)event->arg;
+				snprintf(extra, sizeof(extra), "\"s\":\"t\",\"args\":{\"size\":%u}", event->arg);
+				ftrace_emit(out, &first, "i", ts, tid, (event->kind == lf_trace_alloc) ? "malloc" : "free", extra);
+				snprintf(extra, sizeof(extra), "\"args\":{\"bytes\":%lld}", (long long)allocated);
+				ftrace_emit(out, &first, "C", ts, 0, "allocated", extra);
+			break;
+			default:
+			break;
+		}
+	}
+	fprintf(out, "\n]}\n");
+}
+
+int main(int argc, char *argv[]) {
+
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s <output.json> [milliseconds] [hostname]\n", argv[0]);
+		exit(EXIT_FAILURE);
+	}
+	uint64_t duration = (argc > 2) ? strtoull(argv[2], NULL, 10) : FTRACE_DEFAULT_DURATION;
+
+	/* Attach over the network if a hostname is given, otherwise over USB. */
+	struct _lf_device *device = (argc > 3) ? carbon_attach_hostname(argv[3]) : flipper.attach();
+	if (!device) {
+		fprintf(stderr, "Failed to attach to a carbon device.\n");
+		exit(EXIT_FAILURE);
+	}
+
+	uint32_t frequency = trace.frequency();
+	if (!frequency || trace.enable(LF_TRACE_ALL) != lf_success) {
+		fprintf(stderr, "The device does not trace its events.\n");
+		exit(EXIT_FAILURE);
+	}
+
+	/* Read the events as they are recorded, so that the device's ring does not overflow. */
+	uint64_t end = ftrace_now() + duration * 1000;
+	while (ftrace_now() < end) {
+		int read = ftrace_read();
+		if (read < 0) break;
+		if (read < FTRACE_CHUNK) usleep(1000);
+	}
+	trace.enable(0);
+	while (ftrace_read() == FTRACE_CHUNK);
+
+	FILE *out = fopen(argv[1], "w");
+	if (!out) {
+		fprintf(stderr, "Failed to open '%s'.\n", argv[1]);
+		exit(EXIT_FAILURE);
+	}
+	ftrace_export(out, frequency);
+	fclose(out);
+	fprintf(stderr, "Wrote %zu events to '%s'.\n", count, argv[1]);
+
+	return EXIT_SUCCESS;
+}
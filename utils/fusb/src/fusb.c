@@ -0,0 +1,272 @@
+/* fusb - A stand-in for libusb that emulates a Carbon board on top of fvm. */
+
+/*
+ * When preloaded in place of libusb, fusb presents a single Carbon device to
+ * the host. Bulk traffic sent to the device's FMR interface is forwarded to an
+ * fvm instance over UDP, and the replies from fvm are returned as bulk traffic.
+ * Every transfer is paced to the boundaries of USB full speed frames, so that
+ * the latency and throughput of the USB path can be measured without hardware.
+ *
+ * The emulation is configured through the environment:
+ *
+ *   FUSB_HOST     The host running fvm. (default: localhost)
+ *   FUSB_PORT     The port on which fvm is listening. (default: LF_UDP_PORT)
+ *   FUSB_FRAME_US The length of a USB frame in microseconds, or 0 to disable pacing. (default: 1000)
+ *   FUSB_PACKETS  The number of packets an endpoint can move per frame. (default: 1)
+ */
+
+#define _GNU_SOURCE
+#include <flipper.h>
+#include <libusb.h>
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+
+/* The number of bytes of protocol overhead carried by each full speed packet. */
+#define FUSB_PACKET_OVERHEAD 13
+/* The number of bits per microsecond transferred on a full speed bus. */
+#define FUSB_BITS_PER_US 12
+
+struct libusb_context {
+	int debug;
+};
+
+struct libusb_device {
+	struct libusb_device_descriptor descriptor;
+};
+
+struct libusb_device_handle {
+	/* The socket connected to fvm. */
+	int fd;
+	/* The bitmask of claimed interfaces. */
+	int claimed;
+	/* The packet that begins the push being assembled, if any. */
+	struct _fmr_packet packet;
+	/* The payload of the push being assembled. */
+	uint8_t *push;
+	/* The number of payload bytes received and expected for the push. */
+	lf_size_t pushed, pushing;
+	/* The datagram from fvm being returned to the host, and the number of bytes already returned. */
+	uint8_t datagram[UINT16_MAX];
+	ssize_t datagram_length, datagram_offset;
+};
+
+/* The single Carbon device presented to the host. */
+static struct libusb_device fusb_device = {
+	.descriptor = {
+		.bLength = 18,
+		.bDescriptorType = 1,
+		.bcdUSB = 0x0200,
+		.bMaxPacketSize0 = 16,
+		.idVendor = CARBON_USB_VENDOR_ID,
+		.idProduct = CARBON_USB_PRODUCT_ID,
+		.bNumConfigurations = 1
+	}
+};
+
+/* The start of the first frame, in microseconds. */
+static uint64_t fusb_origin;
+/* The time at which the bus is next free, in microseconds since the origin. */
+static uint64_t fusb_bus;
+/* Guards the origin and the bus, which are shared by every thread transferring through the emulated device. */
+static pthread_mutex_t fusb_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t fusb_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static long fusb_env(const char *name, long fallback) {
+	char *value = getenv(name);
+	return (value) ? strtol(value, NULL, 0) : fallback;
+}
+
+/* Sets the start of the first frame, once. */
+static void fusb_start(void) {
+	pthread_mutex_lock(&fusb_lock);
+	if (!fusb_origin) fusb_origin = fusb_now();
+	pthread_mutex_unlock(&fusb_lock);
+}
+
+/* Blocks until a transfer of the given length would have completed on the bus. */
+static void fusb_pace(int length) {
+	uint64_t frame = fusb_env("FUSB_FRAME_US", 1000);
+	if (!frame) return;
+	long per_frame = fusb_env("FUSB_PACKETS", 1);
+	if (per_frame < 1) per_frame = 1;
+	/* The bus is reserved for the transfer under the lock, and the wait for it to complete happens outside of it. */
+	pthread_mutex_lock(&fusb_lock);
+	uint64_t now = fusb_now() - fusb_origin;
+	if (fusb_bus < now) fusb_bus = now;
+	/* Transactions are only scheduled at the start of a frame. */
+	uint64_t start = lf_ceiling(fusb_bus, frame) * frame;
+	int packets = (length) ? lf_ceiling(length, BULK_OUT_SIZE) : 1;
+	/* Each frame moves a limited number of packets; the last frame is partially used. */
+	uint64_t frames = (packets - 1) / per_frame;
+	uint64_t last = packets - frames * per_frame;
+	uint64_t wire = (last * (BULK_OUT_SIZE + FUSB_PACKET_OVERHEAD) * 8) / FUSB_BITS_PER_US;
+	fusb_bus = start + frames * frame + wire;
+	uint64_t until = fusb_origin + fusb_bus;
+	pthread_mutex_unlock(&fusb_lock);
+	struct timespec ts = { until / 1000000, (until % 1000000) * 1000 };
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL));
+}
+
+int libusb_init(libusb_context **ctx) {
+	static struct libusb_context context;
+	if (ctx) *ctx = &context;
+	fusb_start();
+	return LIBUSB_SUCCESS;
+}
+
+void libusb_exit(libusb_context *ctx) {
+}
+
+void libusb_set_debug(libusb_context *ctx, int level) {
+	if (ctx) ctx->debug = level;
+}
+
+ssize_t libusb_get_device_list(libusb_context *ctx, libusb_device ***list) {
+	static libusb_device *devices[] = { &fusb_device, NULL };
+	*list = devices;
+	return 1;
+}
+
+void libusb_free_device_list(libusb_device **list, int unref_devices) {
+}
+
+int libusb_get_device_descriptor(libusb_device *dev, struct libusb_device_descriptor *desc) {
+	*desc = dev->descriptor;
+	return LIBUSB_SUCCESS;
+}
+
+int libusb_open(libusb_device *dev, libusb_device_handle **handle) {
+	struct libusb_device_handle *h = calloc(1, sizeof(struct libusb_device_handle));
+	if (!h) return LIBUSB_ERROR_NO_MEM;
+	h->fd = -1;
+	/* Connect to fvm, which plays the part of the board's firmware. */
+	char *hostname = getenv("FUSB_HOST");
+	struct hostent *host = gethostbyname((hostname) ? hostname : "localhost");
+	if (!host) goto failure;
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(struct sockaddr_in));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = ((struct in_addr **)host->h_addr_list)[0]->s_addr;
+	addr.sin_port = htons(fusb_env("FUSB_PORT", LF_UDP_PORT));
+	h->fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (h->fd < 0) goto failure;
+	if (connect(h->fd, (struct sockaddr *)&addr, sizeof(struct sockaddr_in))) goto failure;
+	fusb_start();
+	*handle = h;
+	return LIBUSB_SUCCESS;
+failure:
+	if (h->fd >= 0) close(h->fd);
+	free(h);
+	return LIBUSB_ERROR_NO_DEVICE;
+}
+
+libusb_device_handle *libusb_open_device_with_vid_pid(libusb_context *ctx, uint16_t vendor_id, uint16_t product_id) {
+	libusb_device_handle *handle = NULL;
+	if (vendor_id != CARBON_USB_VENDOR_ID || product_id != CARBON_USB_PRODUCT_ID) return NULL;
+	libusb_open(&fusb_device, &handle);
+	return handle;
+}
+
+void libusb_close(libusb_device_handle *handle) {
+	if (!handle) return;
+	close(handle->fd);
+	free(handle->push);
+	free(handle);
+}
+
+int libusb_claim_interface(libusb_device_handle *handle, int interface_number) {
+	if (interface_number != FMR_INTERFACE && interface_number != DEBUG_INTERFACE) return LIBUSB_ERROR_NOT_FOUND;
+	if (handle->claimed & (1 << interface_number)) return LIBUSB_ERROR_BUSY;
+	handle->claimed |= (1 << interface_number);
+	return LIBUSB_SUCCESS;
+}
+
+int libusb_release_interface(libusb_device_handle *handle, int interface_number) {
+	handle->claimed &= ~(1 << interface_number);
+	return LIBUSB_SUCCESS;
+}
+
+/* Receives data sent by the host to the FMR interface, reassembling it into the datagrams fvm expects. */
+static int fusb_receive(libusb_device_handle *handle, unsigned char *data, int length, int *actual_length) {
+	fusb_pace(length);
+	*actual_length = length;
+	/* Data that follows a push packet is sent to fvm as a single datagram once complete. */
+	if (handle->pushing) {
+		lf_size_t count = handle->pushing - handle->pushed;
+		if (count > (lf_size_t)length) count = length;
+		memcpy(handle->push + handle->pushed, data, count);
+		handle->pushed += count;
+		if (handle->pushed < handle->pushing) return LIBUSB_SUCCESS;
+		ssize_t _e = send(handle->fd, handle->push, handle->pushing, 0);
+		free(handle->push);
+		handle->push = NULL;
+		handle->pushing = handle->pushed = 0;
+		return (_e < 0) ? LIBUSB_ERROR_IO : LIBUSB_SUCCESS;
+	}
+	/* Otherwise, the data is the start of a new packet. */
+	memset(&handle->packet, 0, sizeof(struct _fmr_packet));
+	memcpy(&handle->packet, data, (length < (int)sizeof(struct _fmr_packet)) ? length : (int)sizeof(struct _fmr_packet));
+	if (send(handle->fd, &handle->packet, sizeof(struct _fmr_packet), 0) < 0) return LIBUSB_ERROR_IO;
+	/* Inline pushes carry their data within the packet, and so are never followed by data. */
+	if (handle->packet.header.type == fmr_push_class || handle->packet.header.type == fmr_send_class) {
+		struct _fmr_push_pull_packet *packet = (struct _fmr_push_pull_packet *)&handle->packet;
+		if (packet->length) {
+			handle->push = malloc(packet->length);
+			if (!handle->push) return LIBUSB_ERROR_NO_MEM;
+			handle->pushing = packet->length;
+		}
+	}
+	return LIBUSB_SUCCESS;
+}
+
+/* Transmits the replies of fvm to the host, one packet of each datagram at a time. */
+static int fusb_transmit(libusb_device_handle *handle, unsigned char *data, int length, int *actual_length, unsigned int timeout) {
+	if (handle->datagram_offset >= handle->datagram_length) {
+		struct pollfd pfd = { handle->fd, POLLIN, 0 };
+		if (poll(&pfd, 1, (timeout) ? (int)timeout : -1) <= 0) {
+			*actual_length = 0;
+			return LIBUSB_ERROR_TIMEOUT;
+		}
+		handle->datagram_length = recv(handle->fd, handle->datagram, sizeof(handle->datagram), 0);
+		if (handle->datagram_length < 0) return LIBUSB_ERROR_IO;
+		handle->datagram_offset = 0;
+	}
+	ssize_t count = handle->datagram_length - handle->datagram_offset;
+	if (count > length) count = length;
+	memset(data, 0, length);
+	memcpy(data, handle->datagram + handle->datagram_offset, count);
+	handle->datagram_offset += count;
+	/* A packet always fills the endpoint, as the firmware sends whole packets. */
+	*actual_length = length;
+	fusb_pace(length);
+	return LIBUSB_SUCCESS;
+}
+
+int libusb_bulk_transfer(libusb_device_handle *handle, unsigned char endpoint, unsigned char *data, int length, int *actual_length, unsigned int timeout) {
+	if (!(handle->claimed & (1 << FMR_INTERFACE))) return LIBUSB_ERROR_ACCESS;
+	if (endpoint == BULK_OUT_ENDPOINT) return fusb_receive(handle, data, length, actual_length);
+	if (endpoint == BULK_IN_ENDPOINT) return fusb_transmit(handle, data, length, actual_length, timeout);
+	return LIBUSB_ERROR_PIPE;
+}
+
+int libusb_interrupt_transfer(libusb_device_handle *handle, unsigned char endpoint, unsigned char *data, int length, int *actual_length, unsigned int timeout) {
+	*actual_length = 0;
+	/* fvm has no debug output, so the debug endpoint only ever times out after polling a frame. */
+	if (endpoint == DEBUG_IN_ENDPOINT) {
+		if (!(handle->claimed & (1 << DEBUG_INTERFACE))) return LIBUSB_ERROR_ACCESS;
+		fusb_pace(0);
+		return LIBUSB_ERROR_TIMEOUT;
+	}
+	if (!(handle->claimed & (1 << FMR_INTERFACE))) return LIBUSB_ERROR_ACCESS;
+	/* The interrupt endpoints share the FMR interface with the bulk endpoints. */
+	if (endpoint == INTERRUPT_OUT_ENDPOINT) return fusb_receive(handle, data, length, actual_length);
+	if (endpoint == INTERRUPT_IN_ENDPOINT) return fusb_transmit(handle, data, length, actual_length, timeout);
+	return LIBUSB_ERROR_PIPE;
+}
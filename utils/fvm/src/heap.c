@@ -0,0 +1,20 @@
+#include <flipper.h>
+#include <malloc.h>
+
+#ifdef __use_heap__
+#include <flipper/heap.h>
+
+int os_heap_stats(struct _heap_stats *stats) {
+	/* The virtual machine reports the usage of its own heap. */
+	struct mallinfo2 info = mallinfo2();
+	memset(stats, 0, sizeof(struct _heap_stats));
+	stats->size = info.arena;
+	stats->used = info.uordblks;
+	stats->peak = info.usmblks;
+	stats->available = info.fordblks;
+	stats->largest = info.keepcost;
+	stats->allocations = info.hblks;
+	return lf_success;
+}
+
+#endif
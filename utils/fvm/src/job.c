@@ -0,0 +1,43 @@
+#include <flipper.h>
+#include <poll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+/* Jobs are ticked by a timerfd, standing in for the hardware timer of a device. It is waited upon alongside the socket, so that jobs are performed by the thread that performs packets. */
+
+static int fvm_job_fd = -1;
+
+int fmr_job_timer(uint32_t period) {
+	if (fvm_job_fd < 0) {
+		fvm_job_fd = timerfd_create(CLOCK_MONOTONIC, 0);
+		lf_assert(fvm_job_fd >= 0, failure, E_TIMER, "Failed to create a timer for jobs.");
+	}
+	/* A period of zero disarms the timer. */
+	struct itimerspec spec = { { period / 1000000, (period % 1000000) * 1000 }, { period / 1000000, (period % 1000000) * 1000 } };
+	int _e = timerfd_settime(fvm_job_fd, 0, &spec, NULL);
+	lf_assert(_e == 0, failure, E_TIMER, "Failed to set the period of the timer for jobs.");
+	return lf_success;
+failure:
+	return lf_error;
+}
+
+void fmr_job_signal(void) {
+	/* The jobs are performed as soon as the ticks are counted, by the same thread. */
+}
+
+/* Waits until a packet can be received on the socket, performing the jobs that fall due in the meantime. */
+void fvm_job_wait(int sd) {
+	while (1) {
+		struct pollfd fds[2] = { { sd, POLLIN, 0 }, { fvm_job_fd, POLLIN, 0 } };
+		if (poll(fds, (fvm_job_fd < 0) ? 1 : 2, -1) < 0) continue;
+		if (fds[1].revents & POLLIN) {
+			uint64_t expirations;
+			if (read(fvm_job_fd, &expirations, sizeof(uint64_t)) == sizeof(uint64_t)) {
+				/* A tick is counted for every expiration, so that no sample is skipped when the thread falls behind. */
+				while (expirations --) fmr_job_tick();
+				fmr_job_perform();
+			}
+		}
+		if (fds[0].revents & POLLIN) return;
+	}
+}
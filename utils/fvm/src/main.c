@@ -17,6 +17,8 @@ int modulec = 0;
 
 struct _lf_endpoint *nep = NULL;
 
+extern void fvm_job_wait(int sd);
+
 int fld_index(lf_crc_t identifier) {
 	lf_debug("Searching for counterpart module to '0x%04x'.", identifier);
 	for (int i = 0; i < modulec; i ++) {
@@ -48,11 +50,26 @@ failure:
 	return lf_error;
 }
 
-lf_return_t fmr_perform_user_invocation(struct _fmr_invocation *invocation, struct _fmr_result *result) {
+lf_return_t fmr_perform_user_invocation(struct _fmr_invocation *invocation, lf_size_t length, struct _fmr_result *result) {
 	lf_assert(invocation->index < modulec, failure, E_BOUNDARY, "Module index was out of bounds.");
 	lf_return_t (* function)(void) = fvm_modules[invocation->index].functions[invocation->function];
 	lf_assert(function, failure, E_NULL, "NULL function for user invocation.");
-	return fmr_call(function, invocation->ret, invocation->argc, invocation->types, invocation->parameters);
+	lf_types argt;
+	uint8_t argv[FMR_MAX_ARGC * sizeof(lf_arg)];
+	int _e = fmr_unpack(invocation, length, &argt, argv, NULL, 0);
+	lf_assert(_e == lf_success, failure, E_OVERFLOW, "Failed to unpack the arguments of a user invocation.");
+	return fmr_call(function, invocation->ret, invocation->argc, argt, argv);
+failure:
+	return lf_error;
+}
+
+/* Receives the next packet from the host. Unlike the pulls of the endpoint, which expect a datagram of the length asked for,
+   a packet is only as long as the host made it. */
+static int fvm_receive(struct _lf_network_context *context, struct _fmr_packet *packet, lf_size_t size) {
+	socklen_t length = sizeof(context->device);
+	ssize_t _e = recvfrom(context->fd, packet, size, 0, (struct sockaddr *)&context->device, &length);
+	lf_assert(_e >= (ssize_t)sizeof(struct _fmr_header), failure, E_COMMUNICATION, "Received a packet of %zi bytes, which is shorter than its header.", _e);
+	return lf_success;
 failure:
 	return lf_error;
 }
@@ -78,7 +95,9 @@ int main(int argc, char *argv[]) {
 	}
 	bzero(&addr, sizeof(addr));
 	addr.sin_family = AF_INET;
-	addr.sin_port = htons(LF_UDP_PORT);
+	/* Allow several virtual devices to run side by side, such as the two chips of an emulated carbon. */
+	char *port = getenv("FVM_PORT");
+	addr.sin_port = htons((port) ? atoi(port) : LF_UDP_PORT);
 	addr.sin_addr.s_addr = htonl(INADDR_ANY);
 	int _e = bind(sd, (struct sockaddr*)&addr, sizeof(addr));
 	if (_e < 0) {
@@ -100,15 +119,20 @@ int main(int argc, char *argv[]) {
 
 	printf("Flipper Virtual Machine (FVM) v0.1.0\nListening on 'localhost'.\n\n");
 
+	/* Packets may be as large as the host has negotiated. */
+	struct _fmr_packet *packet = malloc(FMR_MAX_PACKET_SIZE);
+	lf_assert(packet, failure, E_MALLOC, "Failed to allocate packet buffer.");
+
 	while (1) {
-		struct _fmr_packet packet;
-		nep->pull(nep, &packet, sizeof(struct _fmr_packet));
-		lf_debug_packet(&packet, sizeof(struct _fmr_packet));
+		fvm_job_wait(sd);
+		if (fvm_receive(context, packet, FMR_MAX_PACKET_SIZE) != lf_success) continue;
+		lf_debug_packet(packet, FMR_MAX_PACKET_SIZE);
 		struct _fmr_result result;
 		lf_error_clear();
-		fmr_perform(&packet, &result);
+		_e = fmr_perform(packet, &result);
 		lf_debug_result(&result);
-		nep->push(nep, &result, sizeof(struct _fmr_result));
+		/* Send the result, unless it was already sent as part of the reply. */
+		if (_e != FMR_REPLIED) nep->push(nep, &result, sizeof(struct _fmr_result));
 	}
 
 	close(sd);
@@ -117,25 +141,44 @@ failure:
 	return EXIT_FAILURE;
 }
 
+int fmr_reply(void *source, lf_size_t length) {
+	return nep->push(nep, source, length);
+}
+
 lf_return_t fmr_push(struct _fmr_push_pull_packet *packet) {
 	int retval;
-	void *swap = malloc(packet->length);
+	int _e;
+	void *swap = NULL;
+	if (packet->header.type == fmr_send_class) {
+		/* If we are sending data, write it directly to the address given. */
+		_e = nep->pull(nep, (void *)(uintptr_t)*(uint64_t *)fmr_arguments(&packet->call), packet->length);
+		lf_assert(_e == lf_success, failure, E_COMMUNICATION, "Failed to receive the %i bytes sent to the device.", packet->length);
+		return lf_success;
+	}
+	swap = malloc(packet->length);
 	lf_assert(swap, failure, E_MALLOC, "Failed to allocate push buffer");
-	nep->pull(nep, swap, packet->length);
-	*(uint64_t *)(packet->call.parameters) = (uintptr_t)swap;
-	retval = fmr_execute(packet->call.index, packet->call.function, packet->call.ret, packet->call.argc, packet->call.types, (void *)(packet->call.parameters));
+	/* The call is only made once all of its data has arrived. */
+	_e = nep->pull(nep, swap, packet->length);
+	lf_assert(_e == lf_success, failure, E_COMMUNICATION, "Failed to receive the %i bytes pushed to the device.", packet->length);
+	*(uint64_t *)fmr_arguments(&packet->call) = (uintptr_t)swap;
+	retval = fmr_execute(&packet->call, fmr_length_from(packet, &packet->call));
 	free(swap);
 	return retval;
 failure:
+	free(swap);
 	return lf_error;
 }
 
 lf_return_t fmr_pull(struct _fmr_push_pull_packet *packet) {
 	lf_return_t retval;
+	if (packet->header.type == fmr_receive_class) {
+		/* If we are receiving data, simply push the memory. */
+		return nep->push(nep, (void *)(uintptr_t)*(uint64_t *)fmr_arguments(&packet->call), packet->length);
+	}
 	void *swap = malloc(packet->length);
 	lf_assert(swap, failure, E_MALLOC, "Failed to allocate pull buffer");
-	*(uint64_t *)(packet->call.parameters) = (uintptr_t)swap;
-	retval = fmr_execute(packet->call.index, packet->call.function, packet->call.ret, packet->call.argc, packet->call.types, (void *)(packet->call.parameters));
+	*(uint64_t *)fmr_arguments(&packet->call) = (uintptr_t)swap;
+	retval = fmr_execute(&packet->call, fmr_length_from(packet, &packet->call));
 	nep->push(nep, swap, packet->length);
 	free(swap);
 	return retval;
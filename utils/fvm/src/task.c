@@ -18,4 +18,14 @@ int os_task_stop(int pid) {
 	return lf_success;
 }
 
+int os_task_priority(int pid, int priority) {
+	printf("Setting the priority of the task with pid %i to %i.\n", pid, priority);
+	return lf_success;
+}
+
+int os_task_stack(int pid) {
+	printf("Measuring the stack of the task with pid %i.\n", pid);
+	return 0;
+}
+
 #endif
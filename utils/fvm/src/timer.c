@@ -8,4 +8,14 @@ int timer_configure(void) {
 	return lf_success;
 }
 
+int timer_start(void *callback, void *ctx, uint32_t delay, uint32_t period) {
+	printf("Starting a timer calling %p after %u microseconds, then every %u microseconds.\n", callback, delay, period);
+	return 0;
+}
+
+int timer_stop(int id) {
+	printf("Stopping the timer %i.\n", id);
+	return lf_success;
+}
+
 #endif
@@ -0,0 +1,21 @@
+#include <flipper.h>
+
+#ifdef __use_trace__
+#include <flipper/trace.h>
+
+int os_trace_enable(uint32_t mask) {
+	printf("Tracing the events in the mask 0x%08x.\n", mask);
+	return lf_success;
+}
+
+int os_trace_read(void *destination, lf_size_t length) {
+	/* The virtual machine has no kernel to trace. */
+	memset(destination, 0, length);
+	return 0;
+}
+
+uint32_t os_trace_frequency(void) {
+	return 1000000;
+}
+
+#endif
@@ -2,6 +2,10 @@
 
 #ifdef __use_uart0__
 #include <flipper/uart0.h>
+#include <arpa/inet.h>
+
+/* The socket connected to the virtual device on the other end of the bus, if any. */
+static int uart0_fd = -1;
 
 int uart0_configure(uint8_t baud, uint8_t interrupts) {
 	printf("Configuring the uart0.\n");
@@ -13,14 +17,46 @@ int uart0_ready(void) {
 	return lf_success;
 }
 
+/* If FVM_BRIDGE names a port, the bus is connected to the virtual device listening there, like the bridge of a carbon. */
+static int uart0_bridge(void) {
+	char *port = getenv("FVM_BRIDGE");
+	if (!port || uart0_fd >= 0) return uart0_fd;
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(struct sockaddr_in));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(atoi(port));
+	uart0_fd = socket(AF_INET, SOCK_DGRAM, 0);
+	lf_assert(uart0_fd >= 0, failure, E_SOCKET, "Failed to create socket for the uart0 bridge.");
+	int _e = connect(uart0_fd, (struct sockaddr *)&addr, sizeof(struct sockaddr_in));
+	lf_assert(_e == 0, failure, E_SOCKET, "Failed to connect the uart0 bridge to port '%s'.", port);
+	return uart0_fd;
+failure:
+	return -1;
+}
+
 int uart0_push(void *source, lf_size_t length) {
-	printf("Pushing to the uart0 bus: %s\n", source);
+	if (uart0_bridge() >= 0) {
+		ssize_t _e = send(uart0_fd, source, length, 0);
+		lf_assert(_e == (ssize_t)length, failure, E_UART0_PUSH_TIMEOUT, "Failed to push to the uart0 bridge.");
+		return lf_success;
+	}
+	printf("Pushing to the uart0 bus: %s\n", (char *)source);
 	return lf_success;
+failure:
+	return lf_error;
 }
 
 int uart0_pull(void *destination, lf_size_t length) {
+	if (uart0_bridge() >= 0) {
+		ssize_t _e = recv(uart0_fd, destination, length, 0);
+		lf_assert(_e > 0, failure, E_UART0_PULL_TIMEOUT, "Failed to pull from the uart0 bridge.");
+		return lf_success;
+	}
 	printf("Pulling from the uart0 bus.\n");
 	return lf_success;
+failure:
+	return lf_error;
 }
 
 #endif